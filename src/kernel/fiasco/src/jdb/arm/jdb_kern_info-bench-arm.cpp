@@ -3,7 +3,9 @@ IMPLEMENTATION[arm]:
 IMPLEMENT
 void
 Jdb_kern_info_bench::show_arch()
-{}
+{
+  do_outer_cache_benchmark();
+}
 
 IMPLEMENTATION[arm && pf_realview]:
 
@@ -14,7 +16,7 @@ Unsigned64
 Jdb_kern_info_bench::get_time_now()
 { return Platform::sys->read<Mword>(Platform::Sys::Cnt_24mhz); }
 
-IMPLEMENTATION[arm && !pf_realview]:
+IMPLEMENTATION[arm && !pf_realview && !perf_cnt]:
 
 #include "kip.h"
 
@@ -22,3 +24,92 @@ IMPLEMENT inline NEEDS["kip.h"]
 Unsigned64
 Jdb_kern_info_bench::get_time_now()
 { return Kip::k()->clock; }
+
+IMPLEMENTATION[arm && !pf_realview && perf_cnt]:
+
+#include "perf_cnt.h"
+
+/*
+ * The KIP clock does not advance while JDB runs, so count CPU cycles.
+ */
+IMPLEMENT inline NEEDS["perf_cnt.h"]
+Unsigned64
+Jdb_kern_info_bench::get_time_now()
+{ return Perf_cnt::read_cycle_cnt(); }
+
+/*
+ * The cycle counter is only 32 bits wide on 32-bit ARM, so take the
+ * difference in the width of a register to survive a wrap.
+ */
+IMPLEMENT_OVERRIDE inline
+Unsigned64
+Jdb_kern_info_bench::time_since(Unsigned64 start)
+{ return (Mword)(get_time_now() - start); }
+
+IMPLEMENTATION[arm && !outer_cache]:
+
+PRIVATE static inline
+void
+Jdb_kern_info_bench::do_outer_cache_benchmark()
+{}
+
+IMPLEMENTATION[arm && outer_cache]:
+
+#include "kmem.h"
+#include "outer_cache.h"
+
+enum
+{
+  L2_bench_ranges = 64,
+  L2_bench_stride = 1024,
+  L2_bench_len    = 256,
+  L2_bench_runs2  = 6,
+};
+
+static char l2_bench_buf[L2_bench_ranges * L2_bench_stride]
+  __attribute__((aligned(L2_bench_stride)));
+
+/**
+ * Compare outer-cache flushes of many small, scattered ranges done one
+ * range at a time against a single batched request.
+ *
+ * The ranges never cross a page, so each one is physically contiguous.
+ * The result is given in units of get_time_now() per request.
+ */
+PRIVATE static
+void
+Jdb_kern_info_bench::do_outer_cache_benchmark()
+{
+  Outer_cache::Phys_range r[L2_bench_ranges];
+
+  for (unsigned i = 0; i < L2_bench_ranges; ++i)
+    {
+      Address v = (Address)&l2_bench_buf[i * L2_bench_stride];
+      r[i].start = Kmem::kdir->virt_to_phys(v);
+      r[i].end = r[i].start + L2_bench_len;
+    }
+
+  Unsigned64 t = get_time_now();
+  for (unsigned n = 0; n < (1 << L2_bench_runs2); ++n)
+    {
+      for (unsigned i = 0; i < L2_bench_ranges; ++i)
+        Outer_cache::flush(r[i].start, r[i].end, false);
+      Outer_cache::sync();
+    }
+  Unsigned64 t_single = time_since(t) >> L2_bench_runs2;
+
+  t = get_time_now();
+  for (unsigned n = 0; n < (1 << L2_bench_runs2); ++n)
+    Outer_cache::flush(r, L2_bench_ranges);
+  Unsigned64 t_batch = time_since(t) >> L2_bench_runs2;
+
+  t = get_time_now();
+  for (unsigned n = 0; n < (1 << L2_bench_runs2); ++n)
+    Outer_cache::flush();
+  Unsigned64 t_way = time_since(t) >> L2_bench_runs2;
+
+  printf("L2 flush (%u x %u bytes): per-range %llu, batched %llu, by-way %llu"
+         " (threshold %lu)\n",
+         (unsigned)L2_bench_ranges, (unsigned)L2_bench_len,
+         t_single, t_batch, t_way, Outer_cache::by_way_threshold);
+}
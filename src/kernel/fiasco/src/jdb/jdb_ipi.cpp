@@ -5,6 +5,7 @@ IMPLEMENTATION [mp]:
 
 #include "jdb.h"
 #include "jdb_module.h"
+#include "map_util.h"
 #include "static_init.h"
 #include "types.h"
 
@@ -21,8 +22,14 @@ void
 Jdb_ipi_module::print_info(Cpu_number cpu)
 {
   Ipi &ipi = Ipi::_ipi.cpu(cpu);
-  printf("CPU%02u sent/rcvd: %lu/%lu\n",
-         cxx::int_value<Cpu_number>(cpu), ipi._stat_sent, ipi._stat_received);
+  typedef Mu::Auto_tlb_flush<Mem_space> Tlb;
+  Cpu_call::Mcast_stats const &tlb = Tlb::stats.cpu(cpu);
+  Tlb::Flush_stats const &fs = Tlb::flush_stats.cpu(cpu);
+  printf("CPU%02u sent/rcvd: %lu/%lu  TLB shootdowns: %lu IPIs: %lu (unicast %lu)\n",
+         cxx::int_value<Cpu_number>(cpu), ipi._stat_sent, ipi._stat_received,
+         tlb.calls, tlb.ipis, tlb.targets);
+  printf("      TLB flushes: page %lu  page-bcast %lu  space %lu  all %lu\n",
+         fs.pages, fs.pages_bcast, fs.spaces, fs.all);
 }
 
 PUBLIC
@@ -6,6 +6,7 @@ class Jdb_kern_info_bench : public Jdb_kern_info_module
 {
 private:
   static Unsigned64 get_time_now();
+  static Unsigned64 time_since(Unsigned64 start);
   static void show_arch();
 };
 
@@ -14,6 +15,12 @@ IMPLEMENTATION:
 
 static Jdb_kern_info_bench k_a INIT_PRIORITY(JDB_MODULE_INIT_PRIO+1);
 
+/// Time passed since `start`, a value of get_time_now().
+IMPLEMENT_DEFAULT inline
+Unsigned64
+Jdb_kern_info_bench::time_since(Unsigned64 start)
+{ return get_time_now() - start; }
+
 PUBLIC
 Jdb_kern_info_bench::Jdb_kern_info_bench()
   : Jdb_kern_info_module('b', "Benchmark privileged instructions")
@@ -26,9 +33,86 @@ void
 Jdb_kern_info_bench::show()
 {
   do_mp_benchmark();
+  do_ready_queue_benchmark();
   show_arch();
 }
 
+//---------------------------------------------------------------------------
+IMPLEMENTATION [!(sched_fixed_prio || sched_fp_wfq)]:
+
+PRIVATE
+void
+Jdb_kern_info_bench::do_ready_queue_benchmark()
+{}
+
+//---------------------------------------------------------------------------
+IMPLEMENTATION [sched_fixed_prio || sched_fp_wfq]:
+
+#include <cxx/dlist>
+#include "ready_queue_fp.h"
+
+/**
+ * Minimal ready-queue element used to measure Ready_queue_fp in isolation,
+ * i.e., without touching the ready queues of the running system.
+ */
+struct Jdb_rq_bench_elem : cxx::D_list_item
+{
+  typedef cxx::Sd_list<Jdb_rq_bench_elem> Fp_list;
+
+  unsigned short _prio;
+
+  unsigned short prio() const { return _prio; }
+  Mword in_ready_list() const { return Fp_list::in_list(this); }
+};
+
+enum
+{
+  Rq_bench_elems = 64,
+  Rq_bench_runs2 = 8,
+};
+
+static Jdb_rq_bench_elem rq_bench_elems[Rq_bench_elems];
+static Ready_queue_fp<Jdb_rq_bench_elem> rq_bench_queue;
+
+/**
+ * Measure enqueue and dequeue of the fixed-priority ready queue.
+ *
+ * The elements are spread over the whole priority range and are dequeued
+ * highest priority first, just as the scheduler picks them. The result is
+ * given in units of get_time_now() per 1000 operations.
+ */
+PRIVATE
+void
+Jdb_kern_info_bench::do_ready_queue_benchmark()
+{
+  typedef Ready_queue_fp<Jdb_rq_bench_elem> Rq;
+
+  enum { Ops = Rq_bench_elems << Rq_bench_runs2 };
+
+  Unsigned64 t_enq = 0, t_deq = 0;
+  Rq *rq = &rq_bench_queue;
+
+  for (unsigned i = 0; i < Rq_bench_elems; ++i)
+    rq_bench_elems[i]._prio = (i * 37) & 0xff;
+
+  for (unsigned r = 0; r < (1 << Rq_bench_runs2); ++r)
+    {
+      Unsigned64 t = get_time_now();
+      for (unsigned i = 0; i < Rq_bench_elems; ++i)
+        rq->enqueue(&rq_bench_elems[i], false);
+      t_enq += time_since(t);
+
+      t = get_time_now();
+      while (Jdb_rq_bench_elem *e = rq->next_to_run())
+        rq->dequeue(e);
+      t_deq += time_since(t);
+    }
+
+  printf("Ready queue (%s, %u elems): enqueue %llu, dequeue %llu per 1000 ops\n",
+         Rq::variant_name(), (unsigned)Rq_bench_elems,
+         t_enq * 1000 / Ops, t_deq * 1000 / Ops);
+}
+
 //---------------------------------------------------------------------------
 IMPLEMENTATION [!mp]:
 
@@ -110,7 +194,7 @@ Jdb_kern_info_bench::do_ipi_bench(Cpu_number my_cpu, Cpu_number partner)
     Jdb::remote_work_ipi(my_cpu, partner, empty_func, 0, true);
 
   printf(" %2u:%8llu", cxx::int_value<Cpu_number>(partner),
-         (get_time_now() - time) >> Runs2);
+         time_since(time) >> Runs2);
 
   if (ipi_cnt != Rounds)
     printf("\nCounter mismatch: cnt=%d v %d\n", ipi_cnt, Rounds);
@@ -27,7 +27,46 @@ Jdb_kern_info_memory::show()
   // Slab allocators
   for (Iter alloc = Kmem_slab::reap_list.begin();
        alloc != Kmem_slab::reap_list.end(); ++alloc)
-    alloc->debug_dump();
+    {
+      alloc->debug_dump();
+      show_magazines(*alloc);
+    }
+}
+
+//---------------------------------------------------------------------------
+IMPLEMENTATION [!mp]:
+
+PRIVATE static inline
+void
+Jdb_kern_info_memory::show_magazines(Kmem_slab const &)
+{}
+
+//---------------------------------------------------------------------------
+IMPLEMENTATION [mp]:
+
+#include <cstdio>
+
+PRIVATE static
+void
+Jdb_kern_info_memory::show_magazines(Kmem_slab const &s)
+{
+  if (!s._mag_rounds)
+    return;
+
+  unsigned long hits = 0, misses = 0;
+  for (auto const *c: s._cpu_cache)
+    if (c)
+      {
+        hits += c->hits;
+        misses += c->misses;
+      }
+
+  unsigned long total = hits + misses;
+  printf("  magazines: %lu hits, %lu misses (%lu%% hit rate)\n"
+         "  depot: %lu full, %lu empty, %lu handed out, %lu taken back\n",
+         hits, misses, total ? hits * 100 / total : 0UL,
+         (unsigned long)s._depot_full_cnt, (unsigned long)s._depot_empty_cnt,
+         (unsigned long)s._depot_gets, (unsigned long)s._depot_puts);
 }
 
 
@@ -52,6 +52,12 @@ Jdb_rcupdate::action(int cmd, void *&, char const *&, int &)
       printf("  active cpus=");
       Jdb::cpu_mask_print(Rcu::_rcu._active_cpus);
       puts("");
+      printf("  expedite until=");
+      print_batch(Rcu::_rcu._expedite_until);
+      printf(" (%lu requests)\n  expedite cpus=", Rcu::_rcu._expedited);
+      Jdb::cpu_mask_print(Rcu::_rcu._expedite_cpus);
+      puts("");
+      printf("  objects pending release=%ld\n", (long)Rcu::_rcu._pending_objs);
 
       for (Cpu_number i = Cpu_number::first(); i < Config::max_num_cpus(); ++i)
 	{
@@ -69,6 +75,8 @@ Jdb_rcupdate::action(int cmd, void *&, char const *&, int &)
 	  printf("    next list:    h=%p len=%ld\n", d->_n.front(), d->_len);
 	  printf("    current list: h=%p \n", d->_c.front());
 	  printf("    done list:    h=%p\n", d->_d.front());
+	  printf("    deferred:     %lu (limit %d)\n", d->_deferred,
+	         (int)Rcu::Batch_limit);
 	}
     }
   return NOTHING;
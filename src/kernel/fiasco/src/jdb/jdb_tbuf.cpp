@@ -5,6 +5,7 @@ INTERFACE:
 #include "l4_types.h"
 #include "std_macros.h"
 #include "tb_entry.h"
+#include "config.h"
 #include "spin_lock.h"
 
 class Context;
@@ -26,19 +27,64 @@ public:
   static void set_entry_status(Tb_log_table_entry const *e,
                                unsigned char value);
 
+  /**
+   * Descriptor of the trace-buffer ring of one CPU.
+   *
+   * The descriptors are located in the second half of the status page and
+   * are visible to user space together with the rings, so that a user-level
+   * consumer can stream out events without stopping the system. Events are
+   * ordered globally by their event number.
+   *
+   * Descriptors are handed out to CPUs as they come online. The ring of a
+   * descriptor may shrink to make room for the rings of later CPUs, so a
+   * consumer must re-read `tracebuffer` and `size` after each wrap.
+   */
+  struct Cpu_ring
+  {
+    Address tracebuffer; ///< user-visible start address of the ring
+    Mword   size;        ///< size of the ring in bytes, 0 if not yet in use
+    Mword   head;        ///< number of entries completed on this CPU
+    Mword   tail;        ///< entries read so far, set by the consumer
+    Mword   consumer;    ///< != 0 if a consumer maintains `tail`
+    Mword   dropped;     ///< entries lost before the consumer read them
+    Mword   cpu;         ///< CPU logging to this ring, ~0UL if unused
+  };
+
+  enum
+  {
+    Cpu_ring_offset = Config::PAGE_SIZE / 2,
+    /// Number of ring descriptors fitting into the status page.
+    Max_rings = (Config::PAGE_SIZE - Cpu_ring_offset) / sizeof(Cpu_ring),
+  };
+
 protected:
-  static Tb_entry_union *_tbuf_act;	// current entry
-  static Tb_entry_union *_tbuf_max;
-  static Mword		_entries;	// number of occupied entries
+  /// Logging state of one CPU, only used by the kernel.
+  struct Cpu_log
+  {
+    Tb_entry_union *ring; ///< ring of the CPU, 0 while the CPU cannot log
+    Mword entries;        ///< number of entries in `ring`, a power of 2
+    Mword write;          ///< number of reserved entries
+    Mword base;           ///< first reserved entry still kept in `ring`
+    Mword nested;         ///< number of reserved entries not yet committed
+    Mword lost;           ///< event number up to which events may be lost
+    Mword slot;           ///< index of the ring descriptor, ~0UL if none
+  };
+
   static Mword		_max_entries;	// maximum number of entries
+  static Mword		_ring_entries;	// number of entries per CPU ring
+  static Mword		_nr_rings;	// number of rings in the buffer
+  static Mword		_used_rings;	// number of rings handed out
   static Mword          _filter_enabled;// !=0 if filter is active
   static Mword		_number;	// current event number
+  static Mword		_clear_number;	// event number at last clear
   static Mword		_count_mask1;
   static Mword		_count_mask2;
   static Address        _size;		// size of memory area for tbuffer
   static Tracebuffer_status *_status;
   static Tb_entry_union *_buffer;
-  static Spin_lock<>    _lock;
+  static Cpu_ring      *_cpu_ring;
+  static Cpu_log	_cpu_log[Config::Max_num_cpus];
+  static Spin_lock<>	_layout_lock;
 };
 
 #ifdef CONFIG_JDB_LOGGING
@@ -62,30 +108,36 @@ protected:
 
 IMPLEMENTATION:
 
+#include "atomic.h"
 #include "config.h"
 #include "cpu_lock.h"
+#include "globals.h"
 #include "initcalls.h"
 #include "lock_guard.h"
+#include "mem.h"
 #include "mem_unit.h"
 #include "std_macros.h"
 
 // read only: initialized at boot
 Tracebuffer_status *Jdb_tbuf::_status;
 Tb_entry_union *Jdb_tbuf::_buffer;
+Jdb_tbuf::Cpu_ring *Jdb_tbuf::_cpu_ring;
 Address Jdb_tbuf::_size;
 Mword Jdb_tbuf::_max_entries;
-Tb_entry_union *Jdb_tbuf::_tbuf_max;
+Mword Jdb_tbuf::_ring_entries;
+Mword Jdb_tbuf::_nr_rings;
+Mword Jdb_tbuf::_used_rings;
+Spin_lock<> Jdb_tbuf::_layout_lock;
 Mword Jdb_tbuf::_count_mask1;
 Mword Jdb_tbuf::_count_mask2;
 
 // read mostly (only modified in JDB)
 Mword Jdb_tbuf::_filter_enabled;
+Mword Jdb_tbuf::_clear_number;
 
 // modified often (for each new entry)
-Tb_entry_union *Jdb_tbuf::_tbuf_act;
-Mword Jdb_tbuf::_entries;
 Mword Jdb_tbuf::_number;
-Spin_lock<> Jdb_tbuf::_lock;
+Jdb_tbuf::Cpu_log Jdb_tbuf::_cpu_log[Config::Max_num_cpus];
 
 
 static void direct_log_dummy(Tb_entry*, const char*)
@@ -97,6 +149,104 @@ PUBLIC static inline Tracebuffer_status *Jdb_tbuf::status() { return _status; }
 PROTECTED static inline Tb_entry_union *Jdb_tbuf::buffer() { return _buffer; }
 PUBLIC static inline Address Jdb_tbuf::size() { return _size; }
 
+/**
+ * Return the ring of descriptor `slot` in the current layout.
+ *
+ * When the number of rings doubles, ring `slot + _nr_rings / 2` takes the
+ * second half of ring `slot`. Hence, rings are placed at their bit-reversed
+ * slot numbers and each ring lies within the rings of its ancestors, that
+ * is, the slots obtained by repeatedly clearing the highest bit.
+ */
+PROTECTED static
+Tb_entry_union *
+Jdb_tbuf::ring_of_slot(Mword slot)
+{
+  Mword idx = 0;
+  for (Mword r = 1; r < _nr_rings; r <<= 1, slot >>= 1)
+    idx = (idx << 1) | (slot & 1);
+
+  return _buffer + idx * _ring_entries;
+}
+
+/**
+ * Assign a ring descriptor to a CPU coming online.
+ *
+ * If all descriptors are in use, the number of rings doubles, each CPU
+ * giving up half of its ring at its next top-level event. CPUs beyond
+ * `Max_rings` or beyond the capacity of the buffer cannot log.
+ */
+PUBLIC static
+void
+Jdb_tbuf::add_cpu(Cpu_number cpu)
+{
+  Cpu_log &l = _cpu_log[cxx::int_value<Cpu_number>(cpu)];
+  auto guard = lock_guard(_layout_lock);
+
+  if (l.slot != ~0UL)
+    return;
+
+  if (_used_rings == _nr_rings)
+    {
+      if (_nr_rings * 2 > Max_rings || _ring_entries < 2)
+        return;
+
+      _ring_entries /= 2;
+      _nr_rings *= 2;
+    }
+
+  Mword s = _used_rings++;
+  _cpu_ring[s].cpu = cxx::int_value<Cpu_number>(cpu);
+  l.slot = s;
+}
+
+/**
+ * Adapt the ring of the current CPU to the current layout.
+ *
+ * Called with cpu_lock held and without a pending entry on this CPU. A CPU
+ * owning a ring shrinks it to the current ring size. A CPU without a ring
+ * takes its ring once all CPUs with an enclosing ring have shrunk theirs.
+ */
+PRIVATE static
+void
+Jdb_tbuf::update_ring(Cpu_log *l)
+{
+  if (l->slot == ~0UL)
+    return;
+
+  auto guard = lock_guard(_layout_lock);
+  Cpu_ring *r = &_cpu_ring[l->slot];
+
+  if (!l->ring)
+    {
+      for (Mword a = l->slot; a; )
+        {
+          a &= ~(1UL << (sizeof(Mword) * 8 - 1 - __builtin_clzl(a)));
+          Cpu_log const *p = &_cpu_log[_cpu_ring[a].cpu];
+          if (access_once(&p->entries) > _ring_entries)
+            return;
+        }
+
+      // do not write to the new ring before its old owners stopped
+      Mem::mp_mb();
+      l->ring = ring_of_slot(l->slot);
+      l->base = l->write;
+    }
+  else
+    {
+      // entries not yet read by the consumer are lost
+      if (r->consumer)
+        r->dropped += l->write - r->tail;
+      l->base = l->write;
+      l->lost = _number;
+      // complete all writes to the released half before giving it up
+      Mem::mp_wmb();
+    }
+
+  write_now(&l->entries, _ring_entries);
+  r->tracebuffer = (Address)l->ring;
+  r->size = l->entries * sizeof(Tb_entry_union);
+}
+
 /** Clear tracebuffer. */
 PUBLIC static
 void
@@ -107,32 +257,65 @@ Jdb_tbuf::clear_tbuf()
   for (i = 0; i < _max_entries; i++)
     buffer()[i].clear();
 
-  _tbuf_act = buffer();
-  _entries = 0;
+  for (i = 0; i < Config::Max_num_cpus; ++i)
+    {
+      Cpu_log *l = &_cpu_log[i];
+      l->write = l->base = l->lost = 0;
+      if (l->slot == ~0UL)
+        continue;
+
+      _cpu_ring[l->slot].head = 0;
+      _cpu_ring[l->slot].tail = 0;
+      _cpu_ring[l->slot].dropped = 0;
+    }
+
+  _clear_number = _number;
 }
 
-/** Return pointer to new tracebuffer entry. */
+/**
+ * Return pointer to new tracebuffer entry.
+ *
+ * Each CPU appends to its own ring, so the only shared write is the atomic
+ * increment of the global event number.
+ *
+ * \return the entry, to be committed with commit_entry(), or nullptr if
+ *         the current CPU has no ring. Then the event is counted as
+ *         dropped and the caller neither fills nor commits an entry.
+ */
 PUBLIC static
 Tb_entry*
 Jdb_tbuf::new_entry()
 {
   Tb_entry *tb;
   {
-    auto guard = lock_guard(_lock);
+    auto guard = lock_guard(cpu_lock);
+
+    Cpu_log *l = &_cpu_log[cxx::int_value<Cpu_number>(current_cpu())];
+
+    if (EXPECT_FALSE(!l->nested && l->entries != access_once(&_ring_entries)))
+      update_ring(l);
 
-    tb = _tbuf_act;
+    if (EXPECT_FALSE(!l->ring))
+      {
+        if (l->slot != ~0UL)
+          _cpu_ring[l->slot].dropped++;
+        return nullptr;
+      }
 
-    status()->current = (Address)tb;
+    ++l->nested;
 
-    if (++_tbuf_act >= _tbuf_max)
-      _tbuf_act = buffer();
+    Cpu_ring *r = &_cpu_ring[l->slot];
+    Mword w = l->write++;
 
-    if (_entries < _max_entries)
-      _entries++;
+    if (EXPECT_FALSE(r->consumer && w - r->tail >= l->entries))
+      r->dropped++;
 
-    tb->number(++_number);
+    tb = l->ring + (w & (l->entries - 1));
+    tb->number(atomic_add_fetch(&_number, 1));
   }
 
+  status()->current = (Address)tb;
+
   tb->rdtsc();
   tb->rdpmc1();
   tb->rdpmc2();
@@ -148,11 +331,28 @@ Jdb_tbuf::new_entry()
   return static_cast<T*>(new_entry());
 }
 
-/** Commit tracebuffer entry. */
+/**
+ * Commit tracebuffer entry.
+ *
+ * An entry reserved by an interrupt handler while another entry was being
+ * filled becomes visible to a streaming consumer only together with the
+ * interrupted entry.
+ */
 PUBLIC static
 void
 Jdb_tbuf::commit_entry()
 {
+  {
+    auto guard = lock_guard(cpu_lock);
+
+    Cpu_log *l = &_cpu_log[cxx::int_value<Cpu_number>(current_cpu())];
+    if (l->nested && !--l->nested && l->ring)
+      {
+        Mem::mp_wmb();
+        _cpu_ring[l->slot].head = l->write;
+      }
+  }
+
   if (EXPECT_FALSE((_number & _count_mask2) == 0))
     {
       if (_number & _count_mask1)
@@ -171,13 +371,90 @@ Jdb_tbuf::commit_entry()
     }
 }
 
+/**
+ * Return the event number preceding the oldest event that is still
+ * available on all CPUs.
+ *
+ * If a CPU overwrote its oldest entries or shrank its ring, all events older
+ * than its oldest remaining entry are hidden. Thus, the remaining events are
+ * numbered consecutively.
+ */
+PRIVATE static
+Mword
+Jdb_tbuf::window_start()
+{
+  Mword start = _clear_number;
+
+  for (unsigned cpu = 0; cpu < Config::Max_num_cpus; ++cpu)
+    {
+      Cpu_log const *l = &_cpu_log[cpu];
+      if (!l->ring)
+        continue;
+
+      if (l->lost > start)
+        start = l->lost;
+
+      if (l->write - l->base <= l->entries)
+        continue;
+
+      Mword n = l->ring[l->write & (l->entries - 1)].number() - 1;
+      if (n > start)
+        start = n;
+    }
+
+  return start;
+}
+
+/**
+ * Find an event by its number.
+ * @return pointer to the event or 0 if the event is not available.
+ */
+PRIVATE static
+Tb_entry*
+Jdb_tbuf::find(Mword nr)
+{
+  if (nr <= window_start() || nr > _number)
+    return 0;
+
+  for (unsigned cpu = 0; cpu < Config::Max_num_cpus; ++cpu)
+    {
+      Cpu_log const *l = &_cpu_log[cpu];
+      Mword w = l->write;
+      if (!l->ring || w == l->base)
+        continue;
+
+      // the entries of one ring are ordered by their event number
+      Mword mask = l->entries - 1;
+      Mword lo = w - l->base > l->entries ? w - l->entries : l->base;
+      Mword hi = w;
+      Tb_entry_union *r = l->ring;
+
+      if (nr < r[lo & mask].number() || nr > r[(hi - 1) & mask].number())
+        continue;
+
+      while (lo < hi)
+        {
+          Mword m = lo + (hi - lo) / 2;
+          Mword n = r[m & mask].number();
+          if (n == nr)
+            return r + (m & mask);
+          if (n < nr)
+            lo = m + 1;
+          else
+            hi = m;
+        }
+    }
+
+  return 0;
+}
+
 /** Return number of entries currently allocated in tracebuffer.
  * @return number of entries */
-PUBLIC static inline
+PUBLIC static
 Mword
 Jdb_tbuf::unfiltered_entries()
 {
-  return _entries;
+  return _number - window_start();
 }
 
 PUBLIC static
@@ -188,9 +465,10 @@ Jdb_tbuf::entries()
     return unfiltered_entries();
 
   Mword cnt = 0;
+  Mword start = window_start();
 
-  for (Mword idx = 0; idx<unfiltered_entries(); idx++)
-    if (!buffer()[idx].hidden())
+  for (Mword idx = 0; idx < _max_entries; idx++)
+    if (buffer()[idx].number() > start && !buffer()[idx].hidden())
       cnt++;
 
   return cnt;
@@ -220,7 +498,7 @@ PUBLIC static inline
 int
 Jdb_tbuf::event_valid(Mword idx)
 {
-  return idx < _entries;
+  return idx < unfiltered_entries();
 }
 
 /** Return pointer to tracebuffer event.
@@ -237,12 +515,7 @@ Jdb_tbuf::unfiltered_lookup(Mword idx)
   if (!event_valid(idx))
     return 0;
 
-  Tb_entry_union *e = _tbuf_act - idx - 1;
-
-  if (e < buffer())
-    e += _max_entries;
-
-  return e;
+  return find(_number - idx);
 }
 
 /** Return pointer to tracebuffer event.
@@ -277,13 +550,7 @@ PUBLIC static
 Mword
 Jdb_tbuf::unfiltered_idx(Tb_entry const *e)
 {
-  Tb_entry_union const *ef = static_cast<Tb_entry_union const *>(e);
-  Mword idx = _tbuf_act - ef - 1;
-
-  if (idx > _max_entries)
-    idx += _max_entries;
-
-  return idx;
+  return _number - e->number();
 }
 
 /** Tb_entry => tracebuffer index. */
@@ -294,18 +561,13 @@ Jdb_tbuf::idx(Tb_entry const *e)
   if (!_filter_enabled)
     return unfiltered_idx(e);
 
-  Tb_entry_union const *ef = static_cast<Tb_entry_union const*>(e);
   Mword idx = (Mword) - 1;
 
-  for (;;)
+  for (Mword nr = e->number(); nr <= _number; ++nr)
     {
-      if (!ef->hidden())
+      Tb_entry const *ef = find(nr);
+      if (ef && !ef->hidden())
 	idx++;
-      ef++;
-      if (ef >= buffer() + _max_entries)
-	ef -= _max_entries;
-      if (ef == _tbuf_act)
-	break;
     }
 
   return idx;
@@ -316,13 +578,7 @@ PUBLIC static inline
 Tb_entry*
 Jdb_tbuf::search(Mword nr)
 {
-  Tb_entry *e;
-
-  for (Mword idx = 0; (e = unfiltered_lookup(idx)); idx++)
-    if (e->number() == nr)
-      return e;
-
-  return 0;
+  return find(nr);
 }
 
 /** Event number => tracebuffer index.
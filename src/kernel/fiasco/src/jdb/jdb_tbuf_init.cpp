@@ -25,10 +25,21 @@ IMPLEMENTATION:
 #include "jdb_ktrace.h"
 #include "koptions.h"
 #include "mem_layout.h"
+#include "per_cpu_data.h"
 #include "vmem_alloc.h"
 
 STATIC_INITIALIZE_P(Jdb_tbuf_init, JDB_MODULE_INIT_PRIO);
 
+/// Hands out trace-buffer rings to CPUs as they come online.
+struct Jdb_tbuf_cpu_init
+{
+  explicit Jdb_tbuf_cpu_init(Cpu_number cpu)
+  { Jdb_tbuf_init::add_cpu(cpu); }
+};
+
+DEFINE_PER_CPU_LATE static Per_cpu<Jdb_tbuf_cpu_init>
+  tbuf_cpu_init(Per_cpu_data::Cpu_num);
+
 IMPLEMENT_DEFAULT FIASCO_INIT
 unsigned
 Jdb_tbuf_init::allocate(unsigned size)
@@ -106,7 +117,20 @@ void Jdb_tbuf_init::init()
       status()->scaler_tsc_to_us = Cpu::boot_cpu()->get_scaler_tsc_to_us();
       status()->scaler_ns_to_tsc = Cpu::boot_cpu()->get_scaler_ns_to_tsc();
 
-      _tbuf_max    = buffer() + max_entries();
+      // the boot CPU starts with the whole buffer, it is split further as
+      // more CPUs come online
+      _nr_rings     = 1;
+      _ring_entries = max_entries();
+
+      _cpu_ring = (Cpu_ring *)((Address)status() + Cpu_ring_offset);
+      for (unsigned i = 0; i < Max_rings; ++i)
+        _cpu_ring[i].cpu = ~0UL;
+
+      for (unsigned i = 0; i < Config::Max_num_cpus; ++i)
+        _cpu_log[i].slot = ~0UL;
+
+      add_cpu(current_cpu());
+
       _count_mask1 =  max_entries()    - 1;
       _count_mask2 = (max_entries())/2 - 1;
       _size        = size;
@@ -209,38 +209,37 @@ Jdb_thread_list::get_space_dbgid(Thread *t)
 // --------------------------------------------------------------------------
 IMPLEMENTATION [sched_wfq || sched_fp_wfq]:
 
-template<typename T> class Jdb_thread_list_policy;
-
-template<typename RQP>
-static inline NOEXPORT
+/**
+ * Find the next thread after the one of `t` in the kobject list, in
+ * direction `forw`, that is ready on `cpu`.
+ *
+ * The ready queue is a tree of heaps without an order to follow, so list
+ * the ready threads in kobject order instead.
+ */
+static NOEXPORT
 Sched_context *
-Jdb_thread_list::sc_wfq_iter_prev(Sched_context *t)
+Jdb_thread_list::sc_wfq_iter(Sched_context *t, bool forw)
 {
-  Sched_context::Ready_queue &rq = Sched_context::rq.cpu(cpu);
-  Sched_context **rl = RQP::link(t);
-  if (!rl || rl == RQP::idle(rq))
-    return RQP::cnt(rq) ? RQP::heap(rq)[RQP::cnt(rq) - 1] : *RQP::idle(rq);
+  Thread *th = static_cast<Thread *>(t->context());
+  Kobject_dbg::Iterator o = Kobject_dbg::Kobject_list::iter(th->dbg_info());
+  for (;;)
+    {
+      if (forw)
+        ++o;
+      else
+        --o;
 
-  if (rl == RQP::heap(rq))
-    return *RQP::idle(rq);
+      if (o == Kobject_dbg::end())
+        continue;
 
-  return *(rl - 1);
-}
+      th = cxx::dyn_cast<Thread*>(Kobject::from_dbg(*o));
+      if (!th)
+        continue;
 
-template<typename RQP>
-static inline NOEXPORT
-Sched_context *
-Jdb_thread_list::sc_wfq_iter_next(Sched_context *t)
-{
-  Sched_context::Ready_queue &rq = Sched_context::rq.cpu(cpu);
-  Sched_context **rl = RQP::link(t);
-  if (!rl || rl == RQP::idle(rq))
-    return RQP::cnt(rq) ? RQP::heap(rq)[0] : *RQP::idle(rq);
-
-  if ((unsigned)(rl - RQP::heap(rq)) >= RQP::cnt(rq))
-    return *RQP::idle(rq);
-
-  return *(rl + 1);
+      Sched_context *sc = th->sched();
+      if (sc == t || (th->home_cpu() == cpu && sc->in_ready_list()))
+        return sc;
+    }
 }
 
 
@@ -326,32 +325,15 @@ Jdb_thread_list::sc_iter_next(Sched_context *t)
 // --------------------------------------------------------------------------
 IMPLEMENTATION [sched_wfq]:
 
-template<>
-class Jdb_thread_list_policy<Ready_queue_wfq<Sched_context> >
-{
-public:
-  static Sched_context **link(Sched_context *t)
-  { return t->_ready_link; }
-
-  static Sched_context **heap(Sched_context::Ready_queue &rq)
-  { return rq._heap; }
-
-  static Sched_context **idle(Sched_context::Ready_queue &rq)
-  { return &rq.idle; }
-
-  static unsigned cnt(Sched_context::Ready_queue &rq)
-  { return rq._cnt; }
-};
-
 static inline NOEXPORT
 Sched_context *
 Jdb_thread_list::sc_iter_prev(Sched_context *t)
-{ return sc_wfq_iter_prev<Jdb_thread_list_policy<Ready_queue_wfq<Sched_context> > >(t); }
+{ return sc_wfq_iter(t, false); }
 
 static inline NOEXPORT
 Sched_context *
 Jdb_thread_list::sc_iter_next(Sched_context *t)
-{ return sc_wfq_iter_next<Jdb_thread_list_policy<Ready_queue_wfq<Sched_context> > >(t); }
+{ return sc_wfq_iter(t, true); }
 
 
 // --------------------------------------------------------------------------
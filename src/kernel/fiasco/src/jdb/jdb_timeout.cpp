@@ -42,7 +42,7 @@ private:
 
   int skip_empty(To_iter *c, int i)
   {
-    while (*c == _q->first(i).end() && i < (int)_q->queues())
+    while (*c == _q->first(i).end() && i + 1 < (int)_q->queues())
       {
         ++i;
         *c = _q->first(i).begin();
@@ -416,6 +416,26 @@ Jdb_list_timeouts::list()
     }
 }
 
+static
+void
+Jdb_list_timeouts::show_stats(Cpu_number cpu)
+{
+  Timeout_q const &q = Timeout_q::timeout_queue.cpu(cpu);
+
+  printf("CPU%02u:", cxx::int_value<Cpu_number>(cpu));
+  for (unsigned l = 0; l <= Timeout_q::levels(); ++l)
+    {
+      unsigned buckets, timeouts;
+      q.level_occupancy(l, &buckets, &timeouts);
+      if (l < Timeout_q::levels())
+        printf(" L%u:%u/%u", l, timeouts, buckets);
+      else
+        printf(" ovfl:%u", timeouts);
+    }
+  putchar('\n');
+  show_lag_stats(q);
+}
+
 PUBLIC
 Jdb_module::Action_code
 Jdb_list_timeouts::action(int cmd, void *&, char const *&, int &)
@@ -424,6 +444,11 @@ Jdb_list_timeouts::action(int cmd, void *&, char const *&, int &)
     list();
   else if (cmd == 1)
     complete_show();
+  else if (cmd == 2)
+    {
+      printf("timeouts/buckets per wheel level\n");
+      Jdb::foreach_cpu(&show_stats);
+    }
 
   return NOTHING;
 }
@@ -436,6 +461,8 @@ Jdb_list_timeouts::cmds() const
     {
         { 0, "lt", "timeouts", "", "lt\tshow enqueued timeouts", 0 },
         { 1, "", "timeoutsdump", "", 0, 0 },
+        { 2, "", "timeoutstats", "",
+          "timeoutstats\tshow timeout wheel occupancy and expiry lag", 0 },
     };
 
   return cs;
@@ -445,7 +472,28 @@ PUBLIC
 int
 Jdb_list_timeouts::num_cmds() const
 {
-  return 2;
+  return 3;
 }
 
 static Jdb_list_timeouts jdb_list_timeouts INIT_PRIORITY(JDB_MODULE_INIT_PRIO);
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [!debug]:
+
+static
+void
+Jdb_list_timeouts::show_lag_stats(Timeout_q const &)
+{}
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [debug]:
+
+static
+void
+Jdb_list_timeouts::show_lag_stats(Timeout_q const &q)
+{
+  printf("       expired:%lu cascaded:%lu lag avg:%lluus max:%lluus\n",
+         q._stat_expired, q._stat_cascaded,
+         q._stat_expired ? q._stat_lag_sum / q._stat_expired : 0ULL,
+         q._stat_lag_max);
+}
@@ -121,3 +121,29 @@ void Mem_unit::kernel_tlb_flush()
 {
   asm volatile("mcr p15, 4, r0, c8, c7, 0" : : : "memory"); // TLBIALLH
 }
+
+//---------------------------------------------------------------------------
+IMPLEMENTATION [arm && mp && (arm_v7 || arm_v8) && !cpu_virt]:
+
+/**
+ * Invalidate `va` of `asid` in the TLBs of all CPUs in the inner-shareable
+ * domain, complete with tlb_flush_is_sync().
+ */
+PUBLIC static inline
+void
+Mem_unit::tlb_flush_is(void *va, unsigned long asid)
+{
+  Mem::dsb();
+  asm volatile("mcr p15, 0, %0, c8, c3, 1" // TLBIMVAIS
+               : : "r" (((unsigned long)va & 0xfffff000) | asid) : "memory");
+}
+
+PUBLIC static inline
+void
+Mem_unit::tlb_flush_is_sync()
+{
+  asm volatile("mcr p15, 0, %0, c7, c1, 6" // BPIALLIS
+               : : "r" (0) : "memory");
+  Mem::dsb();
+  Mem::isb();
+}
@@ -111,3 +111,26 @@ void Mem_unit::tlb_flush(unsigned long asid)
       :
       "memory");
 }
+
+//---------------------------------------------------------------------------
+IMPLEMENTATION [arm && mp && !cpu_virt]:
+
+/**
+ * Invalidate `va` of `asid` in the TLBs of all CPUs in the inner-shareable
+ * domain, complete with tlb_flush_is_sync().
+ */
+PUBLIC static inline
+void
+Mem_unit::tlb_flush_is(void *va, unsigned long asid)
+{
+  asm volatile("dsb ishst; tlbi vae1is, %0"
+               : : "r" ((((unsigned long)va >> 12) & 0x00000ffffffffffful)
+                        | (asid << 48)) : "memory");
+}
+
+PUBLIC static inline
+void
+Mem_unit::tlb_flush_is_sync()
+{
+  asm volatile("dsb ish; isb" : : : "memory");
+}
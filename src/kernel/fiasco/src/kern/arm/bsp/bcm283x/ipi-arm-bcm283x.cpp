@@ -49,6 +49,25 @@ Ipi::bcast(Message m, Cpu_number from_cpu)
       send(m, from_cpu, n);
 }
 
+/**
+ * Send `m` to all CPUs in `to`, one IPI per target CPU.
+ *
+ * \return the number of IPIs sent.
+ */
+PUBLIC static
+unsigned
+Ipi::send_mcast(Message m, Cpu_number from_cpu, Cpu_mask const &to)
+{
+  unsigned sent = 0;
+  for (Cpu_number n = Cpu_number::first(); n < Config::max_num_cpus(); ++n)
+    if (to.get(n))
+      {
+        send(m, from_cpu, n);
+        ++sent;
+      }
+  return sent;
+}
+
 PUBLIC static inline
 void Ipi::eoi(Message, Cpu_number on_cpu)
 {
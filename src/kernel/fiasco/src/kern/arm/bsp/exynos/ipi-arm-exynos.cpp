@@ -24,3 +24,20 @@ Ipi::bcast(Message m, Cpu_number from_cpu)
   Pic::gic.cpu(from_cpu)->softint_bcast(m);
 }
 
+PUBLIC static inline NEEDS["pic.h"]
+unsigned
+Ipi::send_mcast(Message m, Cpu_number from_cpu, Cpu_mask const &to)
+{
+  unsigned long callmap = 0;
+  for (Cpu_number n = Cpu_number::first(); n < Config::max_num_cpus(); ++n)
+    if (to.get(n))
+      callmap |= 1UL << cxx::int_value<Cpu_phys_id>(_ipi.cpu(n)._phys_id);
+
+  if (!callmap)
+    return 0;
+
+  Pic::gic.cpu(from_cpu)->softint_cpu(callmap, m);
+  stat_sent(from_cpu);
+  return 1;
+}
+
@@ -8,6 +8,20 @@ IMPLEMENTATION[arm && pf_imx_6 && mptimer]:
 
 PRIVATE static Mword Timer::interval()
 {
+  return (Unsigned64)ticks_per_ms() * Config::Scheduler_granularity / 1000;
+}
+
+/**
+ * Calibrate the MPCore timer against the 32kHz GPT clock.
+ */
+IMPLEMENT_OVERRIDE
+Mword
+Timer::ticks_per_ms()
+{
+  static Mword ticks;
+  if (ticks)
+    return ticks;
+
   enum
   {
     GPT_CR  = 0x00,
@@ -24,8 +38,8 @@ PRIVATE static Mword Timer::interval()
     GPT_CR_RESET              = 1 << 15,
 
     Timer_freq = 32768,
-    Ticks = 50,
-    Gpt_ticks = (Timer_freq * Ticks) / Config::Scheduler_granularity,
+    Ms = 50,
+    Gpt_ticks = (Timer_freq * Ms) / 1000,
   };
 
   Mmio_register_block t(Kmem::mmio_remap(Mem_layout::Gpt_phys_base));
@@ -42,7 +56,7 @@ PRIVATE static Mword Timer::interval()
   Mword vc = start_as_counter();
   while (t.read<Mword>(GPT_CNT) < Gpt_ticks)
     ;
-  Mword interval = (vc - stop_counter()) / Ticks;
+  ticks = (vc - stop_counter()) / Ms;
   t.write<Mword>(0, GPT_CR);
-  return interval;
+  return ticks;
 }
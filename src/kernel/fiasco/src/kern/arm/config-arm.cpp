@@ -31,7 +31,7 @@ public:
 #ifdef CONFIG_ONE_SHOT
     Scheduler_one_shot		= 1,
     Scheduler_granularity	= 1UL,
-    Default_time_slice	        = 10000 * scheduler_granularity,
+    Default_time_slice	        = 10000 * Scheduler_granularity,
 #else
     Scheduler_one_shot		= 0,
     Scheduler_granularity	= 1000UL,
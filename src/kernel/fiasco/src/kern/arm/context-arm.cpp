@@ -32,6 +32,18 @@ protected:
   Mword _tpidruro;
 };
 
+// ------------------------------------------------------------------------
+INTERFACE [arm && perf_cnt && (arm_v7 || arm_v8)]:
+
+#include "perf_cnt.h"
+
+EXTENSION class Context
+{
+protected:
+  /// PMU counters of this thread, see Thread::sys_pmu().
+  Perf_cnt::Virt _pmu;
+};
+
 // ------------------------------------------------------------------------
 IMPLEMENTATION [arm]:
 
@@ -49,12 +61,13 @@ IMPLEMENTATION [arm]:
 
 IMPLEMENT inline NEEDS[Context::spill_user_state, Context::store_tpidrurw,
                        Context::load_tpidrurw, Context::load_tpidruro,
-                       Context::arm_switch_gp_regs]
+                       Context::arm_switch_gp_regs, Context::switch_pmu]
 void
 Context::switch_cpu(Context *t)
 {
   update_consumed_time();
 
+  switch_pmu(t);
   spill_user_state();
   store_tpidrurw();
   switch_vm_state(t);
@@ -185,3 +198,37 @@ Context::tpidruro() const
   return 0;
 }
 
+// ------------------------------------------------------------------------
+IMPLEMENTATION [arm && !(perf_cnt && (arm_v7 || arm_v8))]:
+
+PRIVATE inline
+void
+Context::switch_pmu(Context *)
+{}
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [arm && perf_cnt && (arm_v7 || arm_v8)]:
+
+PRIVATE inline NEEDS["perf_cnt.h"]
+void
+Context::switch_pmu(Context *t)
+{
+  if (EXPECT_FALSE(_pmu.on))
+    Perf_cnt::virt_save(&_pmu);
+
+  if (EXPECT_FALSE(t->_pmu.on))
+    Perf_cnt::virt_load(&t->_pmu);
+}
+
+/**
+ * Fold the PMU counts of the running thread into its totals, on each
+ * timer interrupt, because a thread that is not switched out for a few
+ * seconds would otherwise wrap its 32-bit counters.
+ */
+IMPLEMENT_OVERRIDE inline NEEDS["perf_cnt.h"]
+void
+Context::fold_pmu()
+{
+  if (EXPECT_FALSE(_pmu.on))
+    Perf_cnt::virt_fold(&_pmu);
+}
@@ -82,3 +82,26 @@ Ipi::bcast(Message m, Cpu_number from_cpu)
   (void)from_cpu;
   Pic::gic->softint_bcast(m);
 }
+
+/**
+ * Send `m` to all CPUs in `to` with a single SGI, addressed through the
+ * GIC target list.
+ *
+ * \return the number of SGIs written: 1, or 0 if `to` is empty.
+ */
+PUBLIC static inline NEEDS["pic.h"]
+unsigned
+Ipi::send_mcast(Message m, Cpu_number from_cpu, Cpu_mask const &to)
+{
+  unsigned callmap = 0;
+  for (Cpu_number n = Cpu_number::first(); n < Config::max_num_cpus(); ++n)
+    if (to.get(n))
+      callmap |= 1U << _ipi.cpu(n)._sgi_target;
+
+  if (!callmap)
+    return 0;
+
+  Pic::gic->softint_cpu(callmap, m);
+  stat_sent(from_cpu);
+  return 1;
+}
@@ -23,6 +23,22 @@ public:
     Op_mem_read_data     = 0x10,
     Op_mem_write_data    = 0x11,
   };
+
+  enum
+  {
+    /**
+     * Flag for the Op_cache operations: r[1] holds the number of ranges,
+     * the ranges themselves are passed as (start, end) pairs in the
+     * message registers of the caller's UTCB.
+     */
+    Op_cache_vectored    = 0x20,
+  };
+
+private:
+  struct Range
+  {
+    Address start, end;
+  };
 };
 
 // ------------------------------------------------------------------------
@@ -31,6 +47,7 @@ IMPLEMENTATION [arm]:
 #include "context.h"
 #include "entry_frame.h"
 #include "globals.h"
+#include "l4_types.h"
 #include "mem.h"
 #include "mem_space.h"
 #include "mem_unit.h"
@@ -150,7 +167,11 @@ Mem_op::__arm_mem_l1_cache_maint(int op, void const *start, void const *end)
 extern "C" void sys_arm_mem_op()
 {
   Entry_frame *e = current()->regs();
-  Mem_op::arm_mem_cache_maint(e->r[0], (void *)e->r[1], (void *)e->r[2]);
+  if (EXPECT_FALSE(e->r[0] & Mem_op::Op_cache_vectored))
+    Mem_op::arm_mem_cache_maint_vec(e->r[0] & ~Mem_op::Op_cache_vectored,
+                                    e->r[1]);
+  else
+    Mem_op::arm_mem_cache_maint(e->r[0], (void *)e->r[1], (void *)e->r[2]);
 }
 
 
@@ -192,6 +213,109 @@ Mem_op::arm_mem_cache_maint(int op, void const *start, void const *end)
 
 }
 
+/**
+ * Sort the ranges by start address and merge overlapping and adjacent
+ * ones, so that every cache line is touched at most once per request.
+ *
+ * \return the number of ranges left in `r`.
+ */
+PRIVATE static
+unsigned
+Mem_op::coalesce_ranges(Range *r, unsigned n)
+{
+  // n is bounded by the UTCB size, insertion sort is good enough
+  for (unsigned i = 1; i < n; ++i)
+    {
+      Range x = r[i];
+      unsigned j = i;
+      for (; j > 0 && r[j - 1].start > x.start; --j)
+        r[j] = r[j - 1];
+      r[j] = x;
+    }
+
+  unsigned o = 0;
+  for (unsigned i = 1; i < n; ++i)
+    {
+      if (r[i].start <= r[o].end)
+        {
+          if (r[i].end > r[o].end)
+            r[o].end = r[i].end;
+        }
+      else
+        r[++o] = r[i];
+    }
+
+  return n ? o + 1 : 0;
+}
+
+/**
+ * Vectored variant of arm_mem_cache_maint().
+ *
+ * \param op  The Op_cache operation applied to all ranges.
+ * \param n   Number of (start, end) pairs in the UTCB message registers.
+ *
+ * The ranges are coalesced first and the outer cache is maintained in
+ * batches, see outer_cache_op_vec().
+ */
+PUBLIC static void
+Mem_op::arm_mem_cache_maint_vec(int op, Mword n)
+{
+  enum { Max_ranges = Utcb::Max_words / 2 };
+
+  // the full flush does not look at the ranges, not even at their number
+  if (op == Op_cache_dma_coherent_full)
+    {
+      arm_mem_cache_maint(op, 0, 0);
+      return;
+    }
+
+  Context *c = current();
+  Utcb const *u = c->utcb().access(true);
+  Range r[Max_ranges];
+  unsigned cnt = 0;
+
+  if (n > Max_ranges)
+    n = Max_ranges;
+
+  for (unsigned i = 0; i < n; ++i)
+    {
+      Address s = u->values[2 * i];
+      Address e = u->values[2 * i + 1];
+      if (EXPECT_FALSE(s >= e))
+        continue;
+
+      r[cnt].start = s;
+      r[cnt].end = e;
+      ++cnt;
+    }
+
+  cnt = coalesce_ranges(r, cnt);
+  if (!cnt)
+    return;
+
+  c->set_ignore_mem_op_in_progress(true);
+  for (unsigned i = 0; i < cnt; ++i)
+    __arm_mem_l1_cache_maint(op, (void const *)r[i].start,
+                             (void const *)r[i].end);
+  c->set_ignore_mem_op_in_progress(false);
+
+  switch (op)
+    {
+    case Op_cache_l2_clean:
+    case Op_cache_l2_flush:
+    case Op_cache_l2_inv:
+      outer_cache_op_vec(op, r, cnt);
+      break;
+
+    case Op_cache_dma_coherent:
+      outer_cache_op_vec(Op_cache_l2_flush, r, cnt);
+      break;
+
+    default:
+      break;
+    };
+}
+
 // ------------------------------------------------------------------------
 IMPLEMENTATION [arm && !cpu_virt]:
 
@@ -265,6 +389,9 @@ extern "C" void sys_arm_mem_op()
   Entry_frame *e = current()->regs();
   if (EXPECT_FALSE(e->r[0] & 0x10))
     Mem_op::arm_mem_access(e->r);
+  else if (EXPECT_FALSE(e->r[0] & Mem_op::Op_cache_vectored))
+    Mem_op::arm_mem_cache_maint_vec(e->r[0] & ~Mem_op::Op_cache_vectored,
+                                    e->r[1]);
   else
     Mem_op::arm_mem_cache_maint(e->r[0], (void *)e->r[1], (void *)e->r[2]);
 }
@@ -277,6 +404,11 @@ void
 Mem_op::outer_cache_op(int, Address, Address)
 {}
 
+PRIVATE static inline
+void
+Mem_op::outer_cache_op_vec(int, Range const *, unsigned)
+{}
+
 // ------------------------------------------------------------------------
 IMPLEMENTATION [arm && outer_cache]:
 
@@ -325,3 +457,104 @@ Mem_op::outer_cache_op(int op, Address start, Address end)
     }
   Outer_cache::sync();
 }
+
+PRIVATE static inline
+void
+Mem_op::outer_cache_batch(int op, Outer_cache::Phys_range const *r, unsigned n)
+{
+  switch (op)
+    {
+    case Op_cache_l2_clean:
+      Outer_cache::clean(r, n);
+      break;
+    case Op_cache_l2_flush:
+      Outer_cache::flush(r, n);
+      break;
+    case Op_cache_l2_inv:
+      Outer_cache::invalidate(r, n);
+      break;
+    }
+}
+
+/**
+ * Outer cache maintenance for a list of coalesced virtual ranges.
+ *
+ * If the ranges add up to at least Outer_cache::by_way_threshold, clean
+ * and flush requests operate on the whole cache by way instead, which is
+ * cheaper than walking that many lines. Invalidation never does so as it
+ * would discard dirty lines of other users. Otherwise, the ranges are
+ * translated to physical chunks, physically contiguous chunks are merged
+ * and handed to the outer cache in batches, so that the L2 lock is taken
+ * once per batch instead of once per line.
+ */
+PRIVATE static
+void
+Mem_op::outer_cache_op_vec(int op, Range const *r, unsigned n)
+{
+  if (op != Op_cache_l2_inv)
+    {
+      Address total = 0;
+      for (unsigned i = 0; i < n; ++i)
+        total += r[i].end - r[i].start;
+
+      if (total >= Outer_cache::by_way_threshold)
+        {
+          if (op == Op_cache_l2_clean)
+            Outer_cache::clean();
+          else
+            Outer_cache::flush();
+          return;
+        }
+    }
+
+  enum { Batch_size = 16 };
+  Outer_cache::Phys_range batch[Batch_size];
+  unsigned b = 0;
+
+  Context *c = current();
+
+  for (unsigned i = 0; i < n; ++i)
+    {
+      Virt_addr v = Virt_addr(r[i].start);
+      Virt_addr e = Virt_addr(r[i].end);
+
+      while (v < e)
+        {
+          Mem_space::Page_order phys_size;
+          Mem_space::Phys_addr phys_addr;
+          Page::Attr attrs;
+          bool mapped = (   c->mem_space()->v_lookup(Mem_space::Vaddr(v), &phys_addr, &phys_size, &attrs)
+                         && (attrs.rights & Page::Rights::U()));
+
+          Virt_size sz = Virt_size(1) << phys_size;
+          Virt_size offs = cxx::get_lsb(v, phys_size);
+          sz -= offs;
+          if (e - v < sz)
+            sz = e - v;
+
+          if (mapped)
+            {
+              Address pstart = Virt_addr::val(Virt_addr(phys_addr) | offs);
+              Address pend = pstart + Virt_size::val(sz);
+
+              if (b && batch[b - 1].end == pstart)
+                batch[b - 1].end = pend;
+              else
+                {
+                  if (b == Batch_size)
+                    {
+                      outer_cache_batch(op, batch, b);
+                      b = 0;
+                    }
+                  batch[b].start = pstart;
+                  batch[b].end = pend;
+                  ++b;
+                }
+            }
+          v += sz;
+        }
+    }
+
+  if (b)
+    outer_cache_batch(op, batch, b);
+}
@@ -92,6 +92,30 @@ Mem_space::tlb_flush(bool force = false)
   // Mem_unit::tlb_flush();
 }
 
+IMPLEMENT_OVERRIDE inline NEEDS["mem_unit.h", Mem_space::flush_tlb_va,
+                               Mem_space::flush_tlb_va_sync]
+void
+Mem_space::tlb_flush_page(Vaddr virt, Page_order order)
+{
+  if (!Have_asids)
+    {
+      Mem_unit::tlb_flush();
+      return;
+    }
+
+  Mword asid = c_asid();
+  if (asid == Mem_unit::Asid_invalid)
+    return;
+
+  // a block mapping may be held as several TLB entries, so flush every page
+  Address va = Virt_addr::val(virt);
+  Address end = va + (Address(1) << cxx::int_value<Page_order>(order));
+  for (; va < end; va += Config::PAGE_SIZE)
+    flush_tlb_va((void *)va, asid);
+
+  flush_tlb_va_sync();
+}
+
 PUBLIC static inline NEEDS["mem_unit.h"]
 void
 Mem_space::tlb_flush_spaces(bool all, Mem_space *s1, Mem_space *s2)
@@ -826,6 +850,42 @@ Mem_space::Asid_bitmap Mem_space::_asid_bitmap;
 Cpu_mask               Mem_space::_tlb_flush_pending;
 Spin_lock<>            Mem_space::_asid_lock;
 
+//-----------------------------------------------------------------------------
+IMPLEMENTATION [arm && !(mp && (arm_v7 || arm_v8) && !cpu_virt)]:
+
+PRIVATE static inline NEEDS["mem_unit.h"]
+void
+Mem_space::flush_tlb_va(void *va, Mword asid)
+{ Mem_unit::tlb_flush(va, asid); }
+
+PRIVATE static inline
+void
+Mem_space::flush_tlb_va_sync()
+{}
+
+//-----------------------------------------------------------------------------
+IMPLEMENTATION [arm && mp && (arm_v7 || arm_v8) && !cpu_virt]:
+
+/*
+ * The inner-shareable invalidations reach the TLBs of all CPUs, so unmaps
+ * that invalidate single pages need no IPIs.
+ */
+
+PRIVATE static inline NEEDS["mem_unit.h"]
+void
+Mem_space::flush_tlb_va(void *va, Mword asid)
+{ Mem_unit::tlb_flush_is(va, asid); }
+
+PRIVATE static inline NEEDS["mem_unit.h"]
+void
+Mem_space::flush_tlb_va_sync()
+{ Mem_unit::tlb_flush_is_sync(); }
+
+IMPLEMENT_OVERRIDE inline
+bool
+Mem_space::tlb_page_flush_broadcast()
+{ return true; }
+
 //-----------------------------------------------------------------------------
 IMPLEMENTATION [arm && arm_lpae]:
 
@@ -70,6 +70,9 @@ private:
     }
   };
 
+  /// Lines operated on per hold of the IRQ-off L2 lock in range operations.
+  enum { Lines_per_lock = 64 };
+
   static Mword platform_init(Mword aux);
 
   static Static_object<L2cxx0> l2cxx0;
@@ -83,6 +86,13 @@ public:
     Cache_line_size = 1 << Cache_line_shift,
     Cache_line_mask = Cache_line_size - 1,
   };
+
+  /**
+   * Size from which on range clean and flush requests are better served
+   * by operating on the whole cache by way. Set from
+   * CONFIG_ARM_CACHE_L2CXX0_BY_WAY_KB, or to the cache size if that is 0.
+   */
+  static Mword by_way_threshold;
 };
 
 // ------------------------------------------------------------------------
@@ -96,6 +106,7 @@ Static_object<Outer_cache::L2cxx0> Outer_cache::l2cxx0;
 
 bool Outer_cache::need_sync;
 unsigned Outer_cache::waymask;
+Mword Outer_cache::by_way_threshold;
 
 IMPLEMENT inline
 void
@@ -162,6 +173,105 @@ Outer_cache::invalidate(Address phys_addr, bool do_sync = true)
     sync();
 }
 
+/**
+ * Apply the line operation `reg` to all lines of the given ranges.
+ *
+ * The L2 lock is taken once per Lines_per_lock lines and the cache is
+ * synced once per lock hold that issued any line operation, instead of
+ * once per line. This bounds the time interrupts stay disabled for large
+ * batches.
+ */
+PRIVATE static
+void
+Outer_cache::line_op_batch(Address reg, Phys_range const *r, unsigned n)
+{
+  unsigned i = 0;
+  Address a = n ? r[0].start & ~Cache_line_mask : 0;
+
+  while (i < n)
+    {
+      auto guard = lock_guard(l2cxx0->_lock);
+      unsigned lines = 0;
+      while (i < n && lines < Lines_per_lock)
+        {
+          if (a >= r[i].end)
+            {
+              if (++i < n)
+                a = r[i].start & ~Cache_line_mask;
+              continue;
+            }
+
+          l2cxx0->write_op(reg, a);
+          a += Cache_line_size;
+          ++lines;
+        }
+
+      if (lines)
+        sync();
+    }
+}
+
+IMPLEMENT inline NEEDS[Outer_cache::line_op_batch]
+void
+Outer_cache::clean(Phys_range const *r, unsigned n)
+{ line_op_batch(L2cxx0::CLEAN_LINE_BY_PA, r, n); }
+
+IMPLEMENT inline NEEDS[Outer_cache::line_op_batch]
+void
+Outer_cache::flush(Phys_range const *r, unsigned n)
+{ line_op_batch(L2cxx0::CLEAN_AND_INV_LINE_BY_PA, r, n); }
+
+IMPLEMENT inline NEEDS[Outer_cache::line_op_batch]
+void
+Outer_cache::invalidate(Phys_range const *r, unsigned n)
+{
+  for (unsigned i = 0; i < n; ++i)
+    {
+      Phys_range inner = r[i];
+
+        {
+          // partial lines at the edges may hold foreign data, flush them
+          auto guard = lock_guard(l2cxx0->_lock);
+          bool edges = false;
+          if (inner.start & Cache_line_mask)
+            {
+              l2cxx0->write_op(L2cxx0::CLEAN_AND_INV_LINE_BY_PA,
+                               inner.start & ~Cache_line_mask);
+              inner.start += Cache_line_size;
+              edges = true;
+            }
+          if (inner.end & Cache_line_mask)
+            {
+              l2cxx0->write_op(L2cxx0::CLEAN_AND_INV_LINE_BY_PA,
+                               inner.end & ~Cache_line_mask);
+              inner.end &= ~Cache_line_mask;
+              edges = true;
+            }
+          if (edges)
+            sync();
+        }
+
+      line_op_batch(L2cxx0::INVALIDATE_LINE_BY_PA, &inner, 1);
+    }
+}
+
+/**
+ * Way size in kB as encoded in bits 19:17 of the auxiliary control
+ * register. Encoding 0 is reserved and treated like the smallest way
+ * size (16kB), encodings above 6 are clamped to 512kB.
+ */
+PRIVATE static inline
+unsigned
+Outer_cache::way_size_kb(Mword aux)
+{
+  unsigned f = (aux >> 17) & 7;
+  if (f == 0)
+    f = 1;
+  else if (f > 6)
+    f = 6;
+  return 16 << (f - 1);
+}
+
 PUBLIC static
 void
 Outer_cache::initialize(bool v)
@@ -189,6 +299,10 @@ Outer_cache::initialize(bool v)
     }
 
   waymask = (1 << ways) - 1;
+  if (CONFIG_ARM_CACHE_L2CXX0_BY_WAY_KB)
+    by_way_threshold = Mword(CONFIG_ARM_CACHE_L2CXX0_BY_WAY_KB) * 1024;
+  else
+    by_way_threshold = ways * way_size_kb(aux) * 1024;
 
   l2cxx0->write<Mword>(0, L2cxx0::INTERRUPT_MASK);
   l2cxx0->write<Mword>(~0UL, L2cxx0::INTERRUPT_CLEAR);
@@ -255,7 +369,7 @@ Outer_cache::show_info(unsigned ways, Mword cache_id, Mword aux)
       break;
     }
 
-  unsigned waysize = 16 << (((aux >> 17) & 7) - 1);
+  unsigned waysize = way_size_kb(aux);
   printf("L2: Type L2C-%s Size = %dkB  Ways=%d Waysize=%d\n",
          type, ways * waysize, ways, waysize);
 }
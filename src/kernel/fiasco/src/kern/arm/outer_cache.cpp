@@ -5,19 +5,27 @@ INTERFACE:
 class Outer_cache
 {
 public:
+  struct Phys_range
+  {
+    Address start, end;
+  };
+
   static void platform_init_post();
 
   static void invalidate();
   static void invalidate(Address phys, bool sync = true);
   static void invalidate(Address start_phys, Address end_phys, bool do_sync = true);
+  static void invalidate(Phys_range const *r, unsigned n);
 
   static void clean();
   static void clean(Address phys, bool do_sync = true);
   static void clean(Address start_phys, Address end_phys, bool do_sync = true);
+  static void clean(Phys_range const *r, unsigned n);
 
   static void flush();
   static void flush(Address phys, bool do_sync = true);
   static void flush(Address start_phys, Address end_phys, bool do_sync = true);
+  static void flush(Phys_range const *r, unsigned n);
 
   static void sync();
 };
@@ -85,6 +93,21 @@ void
 Outer_cache::flush(Address, Address, bool)
 {}
 
+IMPLEMENT inline
+void
+Outer_cache::invalidate(Phys_range const *, unsigned)
+{}
+
+IMPLEMENT inline
+void
+Outer_cache::clean(Phys_range const *, unsigned)
+{}
+
+IMPLEMENT inline
+void
+Outer_cache::flush(Phys_range const *, unsigned)
+{}
+
 // ------------------------------------------------------------------------
 IMPLEMENTATION [outer_cache]:
 
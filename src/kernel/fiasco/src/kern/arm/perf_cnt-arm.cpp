@@ -10,6 +10,33 @@ public:
   static const char *perf_type_str;
 };
 
+// ------------------------------------------------------------------------
+INTERFACE [arm && perf_cnt && (arm_v7 || arm_v8)]:
+
+EXTENSION class Perf_cnt
+{
+public:
+  enum { Max_virt = 4 };
+
+  /**
+   * Counters virtualised for one thread.
+   *
+   * While the thread runs, the programmable counters 0 to n - 1 count
+   * event[0] to event[n - 1]. Their deltas, and the delta of the cycle
+   * counter (index Max_virt), are added to `total` whenever the thread is
+   * switched out, and on every timer interrupt while it runs, so that the
+   * 32-bit counters never wrap between two updates.
+   */
+  struct Virt
+  {
+    bool on = false;
+    Unsigned8 n = 0;
+    Unsigned32 event[Max_virt];
+    Mword start[Max_virt + 1];
+    Unsigned64 total[Max_virt + 1];
+  };
+};
+
 // ------------------------------------------------------------------------
 IMPLEMENTATION [arm && perf_cnt]:
 IMPLEMENT_DEFAULT inline
@@ -334,3 +361,130 @@ Perf_cnt::setup_pmc(Mword slot, Mword event, Mword, Mword, Mword)
 
   return 1;
 }
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [arm && perf_cnt && (arm_v7 || arm_v8)]:
+
+#include "minmax.h"
+
+PUBLIC static
+bool
+Perf_cnt::virt_available()
+{ return is_avail(); }
+
+/// Number of programmable counters available to Virt, the last counter is
+/// reserved for sampling.
+PUBLIC static
+unsigned
+Perf_cnt::nr_virt_counters()
+{
+  if (!is_avail() || _nr_counters < 2)
+    return 0;
+
+  return min<int>(_nr_counters - 1, Max_virt);
+}
+
+/// Program the events of `v` and take the start values, on switch-in.
+PUBLIC static
+void
+Perf_cnt::virt_load(Virt *v)
+{
+  for (unsigned i = 0; i < v->n; ++i)
+    {
+      pmnxsel(i);
+      evtsel(v->event[i]);
+      v->start[i] = pmcnt();
+    }
+
+  v->start[Max_virt] = ccnt();
+}
+
+/**
+ * Accumulate the counts since virt_load() or the last fold and restart
+ * from the current values, while the thread keeps running.
+ */
+PUBLIC static
+void
+Perf_cnt::virt_fold(Virt *v)
+{
+  for (unsigned i = 0; i < v->n; ++i)
+    {
+      pmnxsel(i);
+      Mword c = pmcnt();
+      v->total[i] += (Unsigned32)(c - v->start[i]);
+      v->start[i] = c;
+    }
+
+  Mword c = ccnt();
+  v->total[Max_virt] += (Mword)(c - v->start[Max_virt]);
+  v->start[Max_virt] = c;
+}
+
+/// Accumulate the counts since virt_load(), on switch-out.
+PUBLIC static inline NEEDS[Perf_cnt::virt_fold]
+void
+Perf_cnt::virt_save(Virt *v)
+{ virt_fold(v); }
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [arm && perf_cnt && (arm_v7 || arm_v8)]:
+
+PUBLIC static
+bool
+Perf_cnt::sample_available()
+{ return is_avail() && _nr_counters > 0; }
+
+PRIVATE static inline
+Mword
+Perf_cnt::sample_counter()
+{ return _nr_counters - 1; }
+
+/**
+ * Let the sampling counter count `event` and raise the overflow interrupt
+ * after `period` events, on the current CPU.
+ */
+PUBLIC static
+void
+Perf_cnt::sample_start(Unsigned32 event, Unsigned32 period)
+{
+  Mword const c = sample_counter();
+
+  cntenc(1UL << c);
+  pmnxsel(c);
+  evtsel(event);
+  pmcnt((Unsigned32)-period);
+  flag(1UL << c);
+  intens(1UL << c);
+  cntens(1UL << c);
+}
+
+PUBLIC static
+void
+Perf_cnt::sample_stop()
+{
+  Mword const c = sample_counter();
+
+  intenc(1UL << c);
+  cntenc(1UL << c);
+  flag(1UL << c);
+}
+
+/**
+ * Rearm the sampling counter after an overflow interrupt.
+ *
+ * \return false if the sampling counter did not overflow.
+ */
+PUBLIC static
+bool
+Perf_cnt::sample_overflow(Unsigned32 period)
+{
+  Mword const c = sample_counter();
+
+  if (!(flag() & (1UL << c)))
+    return false;
+
+  pmnxsel(c);
+  pmcnt((Unsigned32)-period);
+  flag(1UL << c);
+  return true;
+}
@@ -0,0 +1,202 @@
+IMPLEMENTATION [arm && pmu_sampler]:
+
+#include "irq_chip.h"
+#include "irq_mgr.h"
+#include "kmem.h"
+#include "lock_guard.h"
+#include "mem_layout.h"
+#include "per_cpu_data.h"
+#include "perf_cnt.h"
+#include "spin_lock.h"
+
+/**
+ * The overflow interrupt of the performance monitoring unit.
+ *
+ * If it is a private peripheral interrupt, every CPU gets the overflows of
+ * its own counters and, as for the virtual timer interrupt, the same
+ * object serves all CPUs. It is bound by the first session and stays
+ * bound, each CPU only unmasks and masks its own copy. Cores without a PPI for
+ * the PMU, such as the Cortex-A9 of the i.MX6, signal overflows through a
+ * shared peripheral interrupt instead. Each CPU then binds its own object
+ * and routes the interrupt to itself. An SPI that combines the overflows
+ * of several CPUs serves only one session at a time.
+ */
+class Pmu_sampler_irq : public Irq_base
+{
+public:
+  Pmu_sampler_irq() { set_hit(handler_wrapper<Pmu_sampler_irq>); }
+
+private:
+  void switch_mode(bool) {}
+};
+
+static Pmu_sampler_irq _pmu_sampler_ppi;
+static Spin_lock<> _pmu_sampler_ppi_lock;
+DEFINE_PER_CPU static Per_cpu<Pmu_sampler_irq> _pmu_sampler_spi;
+/// The interrupt of the session on each CPU
+DEFINE_PER_CPU static Per_cpu<Pmu_sampler_irq *> _pmu_sampler_irq;
+
+PUBLIC inline FIASCO_FLATTEN
+void
+Pmu_sampler_irq::handle(Upstream_irq const *ui)
+{
+  Pmu_sampler::overflow();
+  chip()->ack(pin());
+  Upstream_irq::ack(ui);
+}
+
+PRIVATE static inline NEEDS["perf_cnt.h"]
+bool
+Pmu_sampler::arch_available()
+{ return Perf_cnt::sample_available(); }
+
+/// Accept only the overflow interrupt of the platform's PMU.
+PRIVATE static inline NEEDS[Pmu_sampler::arch_pmu_irq]
+bool
+Pmu_sampler::arch_irq_valid(Mword irq)
+{ return irq == arch_pmu_irq(); }
+
+/// Allocate the overflow interrupt on the current CPU and unmask it.
+PRIVATE static
+bool
+Pmu_sampler::arch_alloc_irq(unsigned irq)
+{
+  Pmu_sampler_irq *i;
+  if (irq < 32)
+    {
+      i = &_pmu_sampler_ppi;
+      auto g = lock_guard(_pmu_sampler_ppi_lock);
+      if (i->chip() == &Irq_chip_soft::sw_chip && !Irq_mgr::mgr->alloc(i, irq))
+        return false;
+    }
+  else
+    {
+      i = &_pmu_sampler_spi.current();
+      if (!Irq_mgr::mgr->alloc(i, irq))
+        return false;
+
+      i->set_cpu(current_cpu());
+    }
+
+  _pmu_sampler_irq.current() = i;
+  i->chip()->unmask(i->pin());
+  return true;
+}
+
+PRIVATE static inline NEEDS["perf_cnt.h"]
+void
+Pmu_sampler::arch_start(Unsigned32 event, Unsigned32 period)
+{ Perf_cnt::sample_start(event, period); }
+
+PRIVATE static
+void
+Pmu_sampler::arch_stop()
+{
+  Perf_cnt::sample_stop();
+
+  Pmu_sampler_irq *i = _pmu_sampler_irq.current();
+  i->chip()->mask(i->pin());
+  if (i != &_pmu_sampler_ppi)
+    i->unbind();
+}
+
+PRIVATE static inline NEEDS["perf_cnt.h"]
+bool
+Pmu_sampler::arch_rearm(Unsigned32 period)
+{ return Perf_cnt::sample_overflow(period); }
+
+/**
+ * Read one word of user memory of `space` without risking a page fault.
+ *
+ * \return false if `va` is not mapped to RAM.
+ */
+PRIVATE static
+bool
+Pmu_sampler::peek_user(Space *space, Address va, Mword *val)
+{
+  if (va & (sizeof(Mword) - 1))
+    return false;
+
+  Address phys = Address(space->virt_to_phys_s0((void *)va));
+  if (phys == ~0UL)
+    return false;
+
+  Address k = Mem_layout::phys_to_pmem(phys);
+  if (k == ~0UL || !Kmem::kdir->walk(Virt_addr(k)).is_valid())
+    return false;
+
+  *val = *reinterpret_cast<Mword const *>(k);
+  return true;
+}
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [arm && pmu_sampler && !pf_imx_6]:
+
+/// PPI 7, the PMU interrupt recommended by the Arm base system architecture.
+PRIVATE static inline
+unsigned
+Pmu_sampler::arch_pmu_irq()
+{ return 23; }
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [arm && pmu_sampler && pf_imx_6]:
+
+/// The Cortex-A9 has no PMU PPI, all cores share SPI 94.
+PRIVATE static inline
+unsigned
+Pmu_sampler::arch_pmu_irq()
+{ return 32 + 94; }
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [arm && pmu_sampler && 32bit]:
+
+/**
+ * The exception entry saves only the caller-saved registers, so the frame
+ * pointer of the interrupted code is unknown. Report the user link
+ * register instead, which is the return address of the interrupted
+ * function as long as it did not call another function yet.
+ */
+PRIVATE static inline
+unsigned
+Pmu_sampler::user_chain(Space *, Entry_frame const *regs, Mword *chain,
+                        unsigned max)
+{
+  if (!max)
+    return 0;
+
+  chain[0] = regs->ulr;
+  return 1;
+}
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [arm && pmu_sampler && 64bit]:
+
+/**
+ * Follow the AArch64 frame records of the interrupted code, each holding
+ * the frame pointer of the caller followed by the return address.
+ */
+PRIVATE static
+unsigned
+Pmu_sampler::user_chain(Space *space, Entry_frame const *regs, Mword *chain,
+                        unsigned max)
+{
+  Mword fp = regs->r[29];
+  unsigned n = 0;
+
+  while (n < max && fp)
+    {
+      Mword next;
+      if (!peek_user(space, fp, &next) || !peek_user(space, fp + 8, &chain[n]))
+        break;
+
+      ++n;
+
+      // the stack grows down, callers have their records above ours
+      if (next <= fp)
+        break;
+
+      fp = next;
+    }
+
+  return n;
+}
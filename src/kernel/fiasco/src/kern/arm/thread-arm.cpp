@@ -374,7 +374,7 @@ Thread::sys_control_arch(Utcb *)
   return 0;
 }
 
-PROTECTED inline NEEDS[Thread::set_tpidruro]
+PROTECTED inline NEEDS[Thread::set_tpidruro, Thread::sys_pmu]
 L4_msg_tag
 Thread::invoke_arch(L4_msg_tag tag, Utcb *utcb)
 {
@@ -382,6 +382,8 @@ Thread::invoke_arch(L4_msg_tag tag, Utcb *utcb)
     {
     case Op_set_tpidruro_arm:
       return set_tpidruro(tag, utcb);
+    case Op_pmu_arm:
+      return sys_pmu(tag, utcb);
     default:
       return commit_result(-L4_err::ENosys);
     }
@@ -768,3 +770,147 @@ Thread::arm_esr_entry(Return_frame *rf)
     }
 }
 
+// ------------------------------------------------------------------------
+IMPLEMENTATION [arm && !(perf_cnt && (arm_v7 || arm_v8))]:
+
+PRIVATE inline
+L4_msg_tag
+Thread::sys_pmu(L4_msg_tag, Utcb *)
+{ return commit_result(-L4_err::ENosys); }
+
+// ------------------------------------------------------------------------
+INTERFACE [arm && perf_cnt && (arm_v7 || arm_v8)]:
+
+EXTENSION class Thread
+{
+private:
+  enum
+  {
+    Pmu_configure = 0,
+    Pmu_read      = 1,
+  };
+
+  struct Pmu_op
+  {
+    Mword op;
+    unsigned n;
+    Unsigned32 event[Perf_cnt::Max_virt];
+    Unsigned64 val[Perf_cnt::Max_virt + 1];
+  };
+};
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [arm && perf_cnt && (arm_v7 || arm_v8)]:
+
+#include "cpu_lock.h"
+#include "lock_guard.h"
+#include "perf_cnt.h"
+
+/**
+ * Configure or read the virtualised PMU counters, on the home CPU.
+ *
+ * If the thread is running right now, its live counts are folded in
+ * first, and the counters are restarted afterwards.
+ */
+PRIVATE
+void
+Thread::pmu_op(Pmu_op *op)
+{
+  bool running = this == current();
+  if (running && _pmu.on)
+    Perf_cnt::virt_save(&_pmu);
+
+  if (op->op == Pmu_configure)
+    {
+      _pmu.on = op->n != ~0U;
+      _pmu.n = _pmu.on ? op->n : 0;
+      for (unsigned i = 0; i < _pmu.n; ++i)
+        _pmu.event[i] = op->event[i];
+      for (unsigned i = 0; i <= Perf_cnt::Max_virt; ++i)
+        _pmu.total[i] = 0;
+    }
+  else
+    {
+      op->n = _pmu.n;
+      op->val[0] = _pmu.total[Perf_cnt::Max_virt];
+      for (unsigned i = 0; i < _pmu.n; ++i)
+        op->val[i + 1] = _pmu.total[i];
+    }
+
+  if (running && _pmu.on)
+    Perf_cnt::virt_load(&_pmu);
+}
+
+PRIVATE static
+Context::Drq::Result
+Thread::handle_pmu_op(Drq *, Context *self, void *data)
+{
+  nonull_static_cast<Thread*>(self)->pmu_op(reinterpret_cast<Pmu_op *>(data));
+  return Drq::done();
+}
+
+/**
+ * Per-thread PMU counters.
+ *
+ * values[1] selects the operation:
+ * - Pmu_configure: values[2] is the number of events n, at most
+ *   Perf_cnt::nr_virt_counters(), followed by n event numbers. The thread
+ *   then counts these events and its cycles while it runs, starting from
+ *   zero. n == ~0 turns the counters off.
+ * - Pmu_read: returns the cycle count followed by the n event counts,
+ *   each as a 64-bit value in one word, or two words (low word first) on
+ *   32-bit.
+ */
+PRIVATE
+L4_msg_tag
+Thread::sys_pmu(L4_msg_tag tag, Utcb *utcb)
+{
+  enum { Val_words = sizeof(Unsigned64) / sizeof(Mword) };
+
+  if (EXPECT_FALSE(tag.words() < 2))
+    return commit_result(-L4_err::EMsgtooshort);
+
+  Pmu_op op;
+  op.op = utcb->values[1];
+  op.n = 0;
+
+  if (op.op == Pmu_configure)
+    {
+      if (EXPECT_FALSE(tag.words() < 3))
+        return commit_result(-L4_err::EMsgtooshort);
+
+      op.n = utcb->values[2];
+      if (op.n != ~0U)
+        {
+          if (EXPECT_FALSE(!Perf_cnt::virt_available()))
+            return commit_result(-L4_err::ENosys);
+
+          if (EXPECT_FALSE(op.n > Perf_cnt::nr_virt_counters()
+                           || tag.words() < 3 + op.n))
+            return commit_result(-L4_err::EInval);
+
+          for (unsigned i = 0; i < op.n; ++i)
+            op.event[i] = utcb->values[3 + i];
+        }
+    }
+  else if (op.op != Pmu_read)
+    return commit_result(-L4_err::ENosys);
+
+  if (home_cpu() != current_cpu())
+    drq(handle_pmu_op, &op, Drq::Any_ctxt);
+  else
+    {
+      auto guard = lock_guard(cpu_lock);
+      pmu_op(&op);
+    }
+
+  if (op.op == Pmu_configure)
+    return commit_result(0);
+
+  Mword *w = utcb->values;
+  for (unsigned i = 0; i <= op.n; ++i)
+    for (unsigned j = 0; j < Val_words; ++j)
+      *w++ = op.val[i] >> (j * sizeof(Mword) * 8);
+
+  return commit_result(0, (op.n + 1) * Val_words);
+}
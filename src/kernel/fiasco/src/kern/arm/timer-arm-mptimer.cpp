@@ -17,6 +17,10 @@ private:
     Timer_control_reg  = 0x600 + 0x8,
     Timer_int_stat_reg = 0x600 + 0xc,
 
+    Global_counter_lo_reg = 0x200 + 0x0,
+    Global_counter_hi_reg = 0x200 + 0x4,
+    Global_control_reg    = 0x200 + 0x8,
+
     Prescaler = 0,
 
     Timer_control_enable    = 1 << 0,
@@ -25,7 +29,19 @@ private:
     Timer_control_prescaler = (Prescaler & 0xff) << 8,
 
     Timer_int_stat_event   = 1,
+
+    Global_control_enable  = 1 << 0,
   };
+
+  /// Timer ticks per millisecond, the default is derived from interval().
+  static Mword ticks_per_ms();
+
+  /// Timer ticks per microsecond as 32.32 fixed-point number, used to
+  /// program the one-shot timer.
+  static Unsigned64 _ticks_per_us;
+
+  /// Microseconds per timer tick, as 32.32 fixed-point number.
+  static Unsigned64 _us_per_tick;
 };
 
 // --------------------------------------------------------------
@@ -34,9 +50,18 @@ IMPLEMENTATION [arm && mptimer]:
 #include <cstdio>
 #include "config.h"
 #include "kip.h"
+#include "std_macros.h"
 
 #include "globals.h"
 
+Unsigned64 Timer::_ticks_per_us;
+Unsigned64 Timer::_us_per_tick;
+
+IMPLEMENT_DEFAULT
+Mword
+Timer::ticks_per_ms()
+{ return interval() * 1000 / Config::Scheduler_granularity; }
+
 PRIVATE static
 Mword
 Timer::start_as_counter()
@@ -61,10 +86,62 @@ Timer::stop_counter()
   return v;
 }
 
+/**
+ * Start the global timer of the MPCore, which is shared by all CPUs and
+ * serves as free-running clock source in one-shot mode.
+ */
+PRIVATE static
+void
+Timer::init_global_counter()
+{
+  Mword t = ticks_per_ms();
+
+  _ticks_per_us = (Unsigned64(t) << 32) / 1000;
+  _us_per_tick = (Unsigned64(1000) << 32) / t;
+
+  Cpu::scu->write<Mword>(0, Global_control_reg);
+  Cpu::scu->write<Mword>(0, Global_counter_lo_reg);
+  Cpu::scu->write<Mword>(0, Global_counter_hi_reg);
+  Cpu::scu->write<Mword>(Timer_control_prescaler | Global_control_enable,
+                         Global_control_reg);
+}
+
+/**
+ * Read the 64bit global timer, retrying if the upper half changed
+ * while reading the lower half.
+ */
+PRIVATE static inline
+Unsigned64
+Timer::global_counter()
+{
+  Mword hi, lo;
+  do
+    {
+      hi = Cpu::scu->read<Mword>(Global_counter_hi_reg);
+      lo = Cpu::scu->read<Mword>(Global_counter_lo_reg);
+    }
+  while (hi != Cpu::scu->read<Mword>(Global_counter_hi_reg));
+
+  return (Unsigned64(hi) << 32) | lo;
+}
+
 IMPLEMENT
 void
-Timer::init(Cpu_number)
+Timer::init(Cpu_number cpu)
 {
+  if (Config::Scheduler_one_shot)
+    {
+      if (cpu == Cpu_number::boot_cpu())
+        init_global_counter();
+
+      // count down once, update_one_shot() reloads the counter
+      Cpu::scu->write<Mword>(0, Timer_load_reg);
+      Cpu::scu->write<Mword>(~0UL, Timer_counter_reg);
+      Cpu::scu->write<Mword>(Timer_control_prescaler | Timer_control_enable
+                             | Timer_control_itenable,
+                             Timer_control_reg);
+      return;
+    }
 
   Mword i = interval();
 
@@ -82,18 +159,62 @@ Timer::acknowledge()
   Cpu::scu->write<Mword>(Timer_int_stat_event, Timer_int_stat_reg);
 }
 
-IMPLEMENT inline
+IMPLEMENT inline NEEDS["config.h", "globals.h", "kip.h",
+                      Timer::global_counter]
+Unsigned64
+Timer::system_clock()
+{
+  if (!Config::Scheduler_one_shot)
+    return Kip::k()->clock;
+
+  Unsigned64 c = global_counter();
+  return (c >> 32) * _us_per_tick
+         + (((c & 0xffffffff) * _us_per_tick) >> 32);
+}
+
+/**
+ * Move the KIP clock forward to the global timer.
+ *
+ * Every CPU does this on its timer interrupt, the APs run their timeouts
+ * without a tick of the boot CPU. The 64-bit compare-and-swap neither
+ * tears the clock on 32-bit CPUs nor lets a CPU with an older reading move
+ * it back.
+ */
+PRIVATE static inline NEEDS["kip.h", Timer::system_clock]
 void
-Timer::update_one_shot(Unsigned64 wakeup)
+Timer::update_one_shot_clock(Cpu_number)
 {
-  (void)wakeup;
+  Unsigned64 us = system_clock();
+  Unsigned64 old = __atomic_load_n(&Kip::k()->clock, __ATOMIC_RELAXED);
+  while (old < us
+         && !__atomic_compare_exchange_n(&Kip::k()->clock, &old, us, true,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
 }
 
-IMPLEMENT inline NEEDS["config.h", "kip.h"]
-Unsigned64
-Timer::system_clock()
+/**
+ * Program the private timer of the current CPU to fire at `wakeup`.
+ */
+IMPLEMENT inline NEEDS["config.h", Timer::system_clock]
+void
+Timer::update_one_shot(Unsigned64 wakeup)
 {
-  if (Config::Scheduler_one_shot)
-    return 0;
-  return Kip::k()->clock;
+  Mword ticks;
+  Unsigned64 now = system_clock();
+
+  if (EXPECT_FALSE(wakeup <= now))
+    // already expired
+    ticks = 1;
+  else
+    {
+      Unsigned64 delta = wakeup - now;
+      if (delta < Config::One_shot_min_interval_us)
+        delta = Config::One_shot_min_interval_us;
+      else if (delta > Config::One_shot_max_interval_us)
+        delta = Config::One_shot_max_interval_us;
+
+      ticks = (delta * _ticks_per_us) >> 32;
+    }
+
+  Cpu::scu->write<Mword>(ticks, Timer_counter_reg);
 }
@@ -32,6 +32,19 @@ void
 Timer::kipclock_cache()
 {}
 
+// ------------------------------------------------------------------------
+IMPLEMENTATION [arm && !mptimer]:
+
+#include "kip.h"
+
+PRIVATE static inline NEEDS["kip.h"]
+void
+Timer::update_one_shot_clock(Cpu_number cpu)
+{
+  if (cpu == Cpu_number::boot_cpu())
+    Kip::k()->clock = system_clock();
+}
+
 // ------------------------------------------------------------------------
 IMPLEMENTATION [arm]:
 
@@ -47,14 +60,25 @@ Timer::init_system_clock()
   Kip::k()->clock = 0;
 }
 
-IMPLEMENT inline NEEDS["config.h", "globals.h", "kip.h", "watchdog.h", Timer::kipclock_cache]
+IMPLEMENT inline NEEDS["config.h", "globals.h", "kip.h", "watchdog.h",
+                      Timer::kipclock_cache, Timer::update_one_shot_clock]
 void
 Timer::update_system_clock(Cpu_number cpu)
 {
-  if (cpu == Cpu_number::boot_cpu())
+  // in one-shot mode the clock is read from the timer's clock source
+  if (Config::Scheduler_one_shot)
     {
-      Kip::k()->clock += Config::Scheduler_granularity;
+      update_one_shot_clock(cpu);
       kipclock_cache();
+    }
+
+  if (cpu == Cpu_number::boot_cpu())
+    {
+      if (!Config::Scheduler_one_shot)
+        {
+          Kip::k()->clock += Config::Scheduler_granularity;
+          kipclock_cache();
+        }
       Watchdog::touch();
     }
 }
@@ -42,3 +42,9 @@ Clock::delta()
   _last_value = t;
   return Time(r);
 }
+
+/// Current counter value, in the unit of delta().
+PUBLIC inline NEEDS[Clock::read_counter]
+Clock::Time
+Clock::read() const
+{ return read_counter(); }
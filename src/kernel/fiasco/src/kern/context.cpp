@@ -292,6 +292,9 @@ protected:
    */
   void update_consumed_time();
 
+  /// Account per-thread performance counters on a timer interrupt.
+  void fold_pmu();
+
   Mword *_kernel_sp;
   void *_utcb_handler;
   Ku_mem_ptr<Utcb> _utcb;
@@ -434,6 +437,7 @@ IMPLEMENTATION:
 #include "entry_frame.h"
 #include "fpu.h"
 #include "globals.h"		// current()
+#include "kern_stat.h"
 #include "lock_guard.h"
 #include "logdefs.h"
 #include "mem.h"
@@ -1121,6 +1125,7 @@ Context::switch_exec_locked(Context *t, enum Helping_mode mode)
 
   LOG_CONTEXT_SWITCH;
   CNT_CONTEXT_SWITCH;
+  Kern_stat::inc(Kern_stat::Cnt_context_switch);
 
   // Can only switch to ready threads!
   // do not consider CPU locality here t can be temporarily migrated
@@ -1519,26 +1524,17 @@ Context::xcpu_state_change(Mword mask, Mword add, bool lazy_q = false)
 
 
 /**
- * \brief Initiate a DRQ for the context.
- * \pre \a src must be the currently running context.
- * \param src the source of the DRQ (the context who initiates the DRQ).
- * \param func the DRQ handler.
- * \param arg the argument for the DRQ handler.
- *
- * DRQs are requests that any context can queue to any other context. DRQs are
- * the basic mechanism to initiate actions on remote CPUs in an MP system,
- * however, are also allowed locally.
- * DRQ handlers of pending DRQs are executed by Context::handle_drq() in the
- * context of the target context. Context::handle_drq() is basically called
- * after switching to a context in Context::switch_exec_locked().
+ * Initiate a DRQ for the context like drq() below, but stop waiting for
+ * the reply once `give_up()` returns true.
  *
- * This function enqueues a DRQ and blocks the current context for a reply DRQ.
+ * `give_up()` is called each time the current context runs without a
+ * reply. It has to make sure the reply does not arrive later, and its
+ * result is not reported through the DRQ then.
  */
-PUBLIC inline NEEDS[Context::enqueue_drq, "logdefs.h"]
+PUBLIC template<typename GIVE_UP> inline NEEDS[Context::enqueue_drq, "logdefs.h"]
 void
 Context::drq(Drq *drq, Drq::Request_func *func, void *arg,
-             Drq::Exec_mode exec = Drq::Target_ctxt,
-             Drq::Wait_mode wait = Drq::Wait)
+             Drq::Exec_mode exec, Drq::Wait_mode wait, GIVE_UP &&give_up)
 {
   if (0)
     printf("CPU[%2u:%p]: > Context::drq(this=%p, func=%p, arg=%p)\n", cxx::int_value<Cpu_number>(current_cpu()), current(), this, func,arg);
@@ -1567,6 +1563,12 @@ Context::drq(Drq *drq, Drq::Request_func *func, void *arg,
   //LOG_MSG_3VAL(src, "<drq", src->state(), Mword(this), 0);
   while (wait == Drq::Wait && cur->state() & Thread_drq_wait)
     {
+      if (EXPECT_FALSE(give_up()))
+        {
+          cur->state_del_dirty(Thread_drq_wait);
+          break;
+        }
+
       cur->state_del(Thread_ready_mask);
       cur->schedule();
     }
@@ -1582,6 +1584,29 @@ Context::drq(Drq *drq, Drq::Request_func *func, void *arg,
   //LOG_MSG_3VAL(src, "drq>", src->state(), Mword(this), 0);
 }
 
+/**
+ * \brief Initiate a DRQ for the context.
+ * \pre \a src must be the currently running context.
+ * \param src the source of the DRQ (the context who initiates the DRQ).
+ * \param func the DRQ handler.
+ * \param arg the argument for the DRQ handler.
+ *
+ * DRQs are requests that any context can queue to any other context. DRQs are
+ * the basic mechanism to initiate actions on remote CPUs in an MP system,
+ * however, are also allowed locally.
+ * DRQ handlers of pending DRQs are executed by Context::handle_drq() in the
+ * context of the target context. Context::handle_drq() is basically called
+ * after switching to a context in Context::switch_exec_locked().
+ *
+ * This function enqueues a DRQ and blocks the current context for a reply DRQ.
+ */
+PUBLIC inline
+void
+Context::drq(Drq *drq, Drq::Request_func *func, void *arg,
+             Drq::Exec_mode exec = Drq::Target_ctxt,
+             Drq::Wait_mode wait = Drq::Wait)
+{ this->drq(drq, func, arg, exec, wait, []() { return false; }); }
+
 PUBLIC
 bool
 Context::kernel_context_drq(Drq::Request_func *func, void *arg)
@@ -1609,6 +1634,12 @@ Context::drq(Drq::Request_func *func, void *arg,
              Drq::Wait_mode wait = Drq::Wait)
 { return drq(&current()->_drq, func, arg, exec, wait); }
 
+/** The DRQ used for the synchronous requests of this context. */
+PROTECTED inline
+Context::Drq *
+Context::own_drq()
+{ return &_drq; }
+
 PRIVATE static
 bool
 Context::rcu_unblock(Rcu_item *i)
@@ -1650,6 +1681,11 @@ void
 Context::arch_update_vcpu_state(Vcpu_state *)
 {}
 
+IMPLEMENT_DEFAULT inline
+void
+Context::fold_pmu()
+{}
+
 IMPLEMENT_DEFAULT inline
 void
 Context::copy_and_sanitize_trap_state(Trap_state *dst,
@@ -1744,7 +1780,7 @@ Context::shutdown_drqs()
 
 PUBLIC inline
 void
-Context::rcu_wait()
+Context::rcu_wait(bool = false)
 {
   // The UP case does not need to block for the next grace period, because
   // the CPU is always in a quiescent state when the interrupts where enabled
@@ -2250,14 +2286,20 @@ Context::shutdown_drqs()
 
 /**
  * Block and wait for the next grace period.
+ *
+ * \param expedite  Collect the quiescent states of the other CPUs with
+ *                  IPIs, see Rcu::expedite(), for waiters that hold back
+ *                  memory of destroyed objects.
  */
 PUBLIC inline NEEDS["cpu_lock.h", "lock_guard.h"]
 void
-Context::rcu_wait()
+Context::rcu_wait(bool expedite = false)
 {
   auto guard = lock_guard(cpu_lock);
   state_change_dirty(~Thread_ready, Thread_waiting);
   Rcu::call(this, &rcu_unblock);
+  if (expedite)
+    Rcu::expedite();
   while (state() & Thread_waiting)
     {
       state_del_dirty(Thread_ready);
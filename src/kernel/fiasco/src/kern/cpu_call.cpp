@@ -58,6 +58,14 @@ public:
   }
 
   bool remote_call(Cpu_number cpu, bool async);
+
+  /// Statistics for cpu_call_mcast(), kept per calling CPU.
+  struct Mcast_stats
+  {
+    Mword calls;    ///< Multicast calls issued
+    Mword ipis;     ///< IPIs sent for these calls
+    Mword targets;  ///< Remote CPUs reached, i.e. IPIs needed by unicast
+  };
 };
 
 template<unsigned MAX>
@@ -110,6 +118,34 @@ public:
 };
 
 
+// ----------------------------------------------------------------------
+INTERFACE [mp]:
+
+#include "spin_lock.h"
+
+EXTENSION class Cpu_call
+{
+  /**
+   * A call to a set of CPUs, see cpu_call_mcast().
+   *
+   * A target CPU claims the call by atomically clearing its bit in
+   * `targets` and drops `pending` after running the function. The
+   * request lives on the caller's stack and stays in `_mcast_list` until
+   * `pending` reaches zero.
+   */
+  struct Mcast
+  {
+    cxx::functor<bool (Cpu_number)> func;
+    Cpu_mask targets;
+    Mword pending;
+    Mcast *next;
+  };
+
+  static Spin_lock<> _mcast_lock;
+  static Mcast *_mcast_list;
+};
+
+
 IMPLEMENTATION:
 
 #include "assert.h"
@@ -179,6 +215,19 @@ Cpu_call::cpu_call_many(Cpu_mask const &m,
   return true;
 }
 
+PUBLIC static inline
+bool
+Cpu_call::cpu_call_mcast(Cpu_mask const &m,
+                         cxx::functor<bool (Cpu_number)> &&func,
+                         Mcast_stats *stats = 0)
+{
+  if (stats)
+    ++stats->calls;
+  if (m.get(current_cpu()))
+    func(current_cpu());
+  return true;
+}
+
 PUBLIC static bool Cpu_call::handle_global_requests() { return false; }
 
 // -----------------------------------------------------------------------
@@ -187,6 +236,7 @@ IMPLEMENTATION [mp]:
 #include "cpu.h"
 #include "ipi.h"
 #include "processor.h"
+#include "atomic.h"
 
 EXTENSION class Cpu_call
 {
@@ -194,6 +244,8 @@ EXTENSION class Cpu_call
 };
 
 DEFINE_PER_CPU Per_cpu<Cpu_call_queue> Cpu_call::_glbl_q;
+Spin_lock<> Cpu_call::_mcast_lock;
+Cpu_call::Mcast *Cpu_call::_mcast_list;
 
 IMPLEMENT inline NEEDS["cpu.h", "ipi.h"]
 bool
@@ -276,11 +328,151 @@ Cpu_call::cpu_call_many(Cpu_mask const &cpus,
   return true;
 }
 
+/**
+ * Call `func` on all CPUs in `cpus` and wait until all calls are done.
+ *
+ * Unlike cpu_call_many(), which queues one request per target CPU, all
+ * targets share a single request and a completion counter. The remote
+ * targets are signalled with Ipi::send_mcast(), a single SGI on the GIC and
+ * a single all-but-self IPI on x86 when all other online CPUs are targeted. The calling CPU claims its own part like any other
+ * target, running `func` with the CPU lock held only for that call.
+ */
+PUBLIC static
+bool
+Cpu_call::cpu_call_mcast(Cpu_mask const &cpus,
+                         cxx::functor<bool (Cpu_number)> &&func,
+                         Mcast_stats *stats = 0)
+{
+  assert (!cpu_lock.test());
+
+  Mcast m;
+  m.func = func;
+  m.targets = cpus;
+  m.pending = 0;
+
+  Cpu_number self;
+
+    {
+      auto guard = lock_guard(cpu_lock);
+      self = current_cpu();
+
+      for (Cpu_number n = Cpu_number::first(); n < Config::max_num_cpus(); ++n)
+        {
+          if (!m.targets.get(n))
+            continue;
+
+          if (n != self && !Cpu::online(n))
+            {
+              m.targets.clear(n);
+              continue;
+            }
+
+          ++m.pending;
+        }
+
+      if (!m.pending)
+        return true;
+
+        {
+          auto g = lock_guard(_mcast_lock);
+          m.next = _mcast_list;
+          _mcast_list = &m;
+        }
+
+      Mem::mp_mb();
+      Cpu_mask remote = m.targets;
+      remote.clear(self);
+      Mword ipis = Ipi::send_mcast(Ipi::Global_request, self, remote);
+
+      if (stats)
+        {
+          Mword n_remote = 0;
+          for (Cpu_number n = Cpu_number::first(); n < Config::max_num_cpus(); ++n)
+            n_remote += remote.get(n);
+
+          ++stats->calls;
+          stats->ipis += ipis;
+          stats->targets += n_remote;
+        }
+    }
+
+  while (access_once(&m.pending))
+    {
+        {
+          auto guard = lock_guard(cpu_lock);
+          Cpu_number const cpu = current_cpu();
+
+          // we were migrated before running our own part, let the CPU we
+          // came from pick it up
+          if (EXPECT_FALSE(cpu != self) && m.targets.get(self))
+            Ipi::send(Ipi::Global_request, cpu, self);
+          self = cpu;
+
+          if (m.targets.get(cpu) && m.targets.atomic_get_and_clear(cpu))
+            {
+              m.func(cpu);
+              Mem::mp_mb();
+              atomic_mp_add(&m.pending, (Mword)-1);
+            }
+        }
+
+      // a target that went offline will never pick up its part
+      for (Cpu_number n = Cpu_number::first(); n < Config::max_num_cpus(); ++n)
+        if (m.targets.get(n) && !Cpu::online(n)
+            && m.targets.atomic_get_and_clear(n))
+          atomic_mp_add(&m.pending, (Mword)-1);
+
+      Proc::pause();
+    }
+
+  auto g = lock_guard(_mcast_lock);
+  for (Mcast **p = &_mcast_list; *p; p = &(*p)->next)
+    if (*p == &m)
+      {
+        *p = m.next;
+        break;
+      }
+
+  return true;
+}
+
+PRIVATE static
+bool
+Cpu_call::handle_mcast_requests()
+{
+  if (!access_once(&_mcast_list))
+    return false;
+
+  Cpu_number const cpu = current_cpu();
+  bool need_resched = false;
+
+  for (;;)
+    {
+      Mcast *m;
+        {
+          auto guard = lock_guard(_mcast_lock);
+          for (m = _mcast_list; m; m = m->next)
+            if (m->targets.get(cpu) && m->targets.atomic_get_and_clear(cpu))
+              break;
+        }
+
+      if (!m)
+        return need_resched;
+
+      need_resched |= m->func(cpu);
+      Mem::mp_mb();
+      // last access to *m, the caller may return right after this
+      atomic_mp_add(&m->pending, (Mword)-1);
+    }
+}
+
 PUBLIC
 static bool
 Cpu_call::handle_global_requests()
 {
-  return _glbl_q.current().handle_requests();
+  bool need_resched = _glbl_q.current().handle_requests();
+  need_resched |= handle_mcast_requests();
+  return need_resched;
 }
 
 
@@ -1,13 +1,13 @@
 INTERFACE:
 
 #include "fiasco_defs.h"
+#include "kmem_slab.h"
 #include "ram_quota.h"
-#include "slab_cache.h"
 #include "kobject_helper.h"
 
 class Factory : public Ram_quota, public Kobject_h<Factory>
 {
-  typedef Slab_cache Self_alloc;
+  typedef Kmem_slab Self_alloc;
 };
 
 //---------------------------------------------------------------------------
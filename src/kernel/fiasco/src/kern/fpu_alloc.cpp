@@ -1,7 +1,7 @@
 INTERFACE:
 
 #include "fpu.h"
-#include "slab_cache.h"
+#include "kmem_slab.h"
 
 class Ram_quota;
 
@@ -12,14 +12,13 @@ class Fpu_alloc : public Fpu
 IMPLEMENTATION:
 
 #include "fpu_state.h"
-#include "kmem_slab.h"
 #include "ram_quota.h"
 
 static Kmem_slab _fpu_state_allocator(Fpu::state_size() + sizeof(Ram_quota *),
                                       Fpu::state_align(), "Fpu state");
 
 PRIVATE static
-Slab_cache *
+Kmem_slab *
 Fpu_alloc::slab_alloc()
 {
   return &_fpu_state_allocator;
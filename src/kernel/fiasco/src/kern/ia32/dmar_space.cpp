@@ -3,6 +3,7 @@ INTERFACE [iommu]:
 #include "task.h"
 #include "ptab_base.h"
 #include "bitmap.h"
+#include "spin_lock.h"
 
 class Dmar_space :
   public cxx::Dyn_castable<Dmar_space, Task>
@@ -136,9 +137,27 @@ public:
   void tlb_flush(bool) override;
 
 private:
+  enum
+  {
+    /// Unmapped regions remembered for page-selective IOTLB invalidation.
+    Max_pending_inv = 16,
+    /// Above this many pages a domain-wide invalidation is used.
+    Max_psi_pages = 512,
+  };
+
   Dmar_pt *_dmarpt;
   unsigned long _did;
 
+  /// Protects the pending invalidations and `_inv_busy`.
+  Spin_lock<> _inv_lock;
+  unsigned _n_pending_inv;
+  unsigned _pending_inv_pages;
+  bool _pending_inv_all;
+  /// A flush_pending_inv() is in flight, serializes tlb_flush().
+  bool _inv_busy;
+  /// Page-aligned address | address mask (log2 of the number of pages)
+  Unsigned64 _pending_inv[Max_pending_inv];
+
   static bool _initialized;
 
   typedef Bitmap<Max_nr_did> Did_map;
@@ -153,6 +172,8 @@ IMPLEMENTATION [iommu]:
 #include "boot_alloc.h"
 #include "intel_iommu.h"
 #include "kmem_slab.h"
+#include "lock_guard.h"
+#include "processor.h"
 #include "warn.h"
 
 JDB_DEFINE_TYPENAME(Dmar_space, "DMA");
@@ -348,15 +369,160 @@ Dmar_space::Dmar_ptr::page_addr() const
   return cxx::mask_lsb(e->v, o);
 }
 
+/**
+ * Remember the region at `virt` for the next tlb_flush(), falls back to a
+ * domain-wide invalidation once too many or too large regions accumulate.
+ */
+PRIVATE
+void
+Dmar_space::add_pending_inv(Mem_space::Vaddr virt, Mem_space::Page_order order)
+{
+  unsigned am = Mem_space::Page_order::val(order) - Config::PAGE_SHIFT;
+
+  auto g = lock_guard(_inv_lock);
+  if (_pending_inv_all)
+    return;
+
+  _pending_inv_pages += 1U << am;
+  if (_n_pending_inv >= Max_pending_inv || _pending_inv_pages > Max_psi_pages)
+    {
+      _pending_inv_all = true;
+      return;
+    }
+
+  _pending_inv[_n_pending_inv++]
+    = Virt_addr::val(virt) | am;
+}
+
+/**
+ * Invalidate the IOTLB entries of all regions unmapped since the last
+ * call.
+ *
+ * Each IOMMU gets all page-selective invalidations in a single batch
+ * followed by one wait descriptor. IOMMUs without page-selective
+ * invalidation, or regions exceeding an IOMMU's address-mask limit, get a
+ * domain-wide invalidation instead. Concurrent callers are serialized
+ * through `_inv_busy`, so that nobody returns while an invalidation
+ * covering their regions is still in flight. `_inv_lock` is only held to
+ * take over the pending regions, not while the IOMMUs work on them, so
+ * waiting callers spin with the lock released and interrupts enabled.
+ *
+ * \return nullptr on success, otherwise an IOMMU whose invalidation queue
+ *         was full. Then all regions stay pending as a domain-wide
+ *         invalidation, for this or any other caller to retry.
+ */
+PRIVATE
+Intel::Io_mmu *
+Dmar_space::flush_pending_inv()
+{
+  unsigned n;
+  bool all;
+  Unsigned64 pending[Max_pending_inv];
+
+  for (;;)
+    {
+        {
+          auto g = lock_guard(_inv_lock);
+          if (!_inv_busy)
+            {
+              n = _n_pending_inv;
+              all = _pending_inv_all;
+              if (!n && !all)
+                return nullptr;
+
+              for (unsigned i = 0; i < n; ++i)
+                pending[i] = _pending_inv[i];
+
+              _n_pending_inv = 0;
+              _pending_inv_pages = 0;
+              _pending_inv_all = false;
+              _inv_busy = true;
+              break;
+            }
+        }
+
+      Proc::pause();
+    }
+
+  Intel::Io_mmu *full = nullptr;
+  if (unsigned long did = access_once(&_did))
+    full = invalidate_iotlb(did, pending, n, all);
+
+  auto g = lock_guard(_inv_lock);
+  if (full)
+    _pending_inv_all = true;
+  _inv_busy = false;
+
+  return full;
+}
+
+/**
+ * Invalidate the `n` regions in `pending`, or the whole domain `did` if
+ * `all` is set, on every IOMMU and wait for completion.
+ *
+ * \return nullptr on success, otherwise an IOMMU whose invalidation queue
+ *         was full.
+ */
+PRIVATE static
+Intel::Io_mmu *
+Dmar_space::invalidate_iotlb(unsigned long did, Unsigned64 const *pending,
+                             unsigned n, bool all)
+{
+  Intel::Io_mmu::Inv_desc d[Max_pending_inv];
+  static_assert(Max_pending_inv <= Intel::Io_mmu::Max_inv_batch,
+                "IOTLB invalidation batch too small");
+
+  Intel::Io_mmu *full = nullptr;
+  for (auto &mmu: Intel::Io_mmu::iommus)
+    {
+      bool domain = all || !mmu.has_psi();
+      for (unsigned i = 0; i < n && !domain; ++i)
+        {
+          unsigned am = pending[i] & 0x3f;
+          if (am > mmu.max_am())
+            domain = true;
+          else
+            d[i] = Intel::Io_mmu::Inv_desc::iotlb_page(did,
+                     cxx::mask_lsb(pending[i], Config::PAGE_SHIFT), am);
+        }
+
+      if (domain)
+        {
+          d[0] = Intel::Io_mmu::Inv_desc::iotlb_did(did);
+          if (mmu.invalidate_and_wait(d, 1))
+            continue;
+        }
+      else if (mmu.invalidate_and_wait(d, n))
+        continue;
+
+      full = &mmu;
+    }
+
+  return full;
+}
+
+/**
+ * Flush all pending IOTLB invalidations, see flush_pending_inv().
+ *
+ * With queued invalidation enabled the register-based invalidation
+ * interface must not be used, so if an invalidation queue is full we wait
+ * for it to drain, without holding `_inv_lock`, and retry.
+ */
 IMPLEMENT
 void
 Dmar_space::tlb_flush(bool)
 {
-  if (_did)
-    for (auto &mmu: Intel::Io_mmu::iommus)
-      mmu.flush_iotlb(_did);
+  while (Intel::Io_mmu *full = flush_pending_inv())
+    while (!full->has_inv_room(Intel::Io_mmu::Max_inv_batch + 1))
+      Proc::pause();
 }
 
+/// v_delete() already recorded the region, just flush all pending ones.
+PUBLIC
+void
+Dmar_space::tlb_flush_page(Mem_space::Vaddr, Mem_space::Page_order) override
+{ tlb_flush(true); }
+
 PUBLIC
 bool
 Dmar_space::v_lookup(Mem_space::Vaddr virt, Mem_space::Phys_addr *phys,
@@ -440,6 +606,7 @@ Dmar_space::v_delete(Mem_space::Vaddr virt, Mem_space::Page_order order,
   else
     i.clear();
 
+  add_pending_inv(virt, order);
   return ret;
 }
 
@@ -484,7 +651,8 @@ Dmar_space::operator delete (void *ptr)
 PUBLIC inline
 Dmar_space::Dmar_space(Ram_quota *q)
 : Dyn_castable_class(q, Caps::mem()),
-  _dmarpt(0), _did(0)
+  _dmarpt(0), _did(0), _inv_lock(Spin_lock<>::Unlocked), _n_pending_inv(0),
+  _pending_inv_pages(0), _pending_inv_all(false), _inv_busy(false)
 {}
 
 PRIVATE
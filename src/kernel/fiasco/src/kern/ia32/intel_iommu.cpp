@@ -231,6 +231,17 @@ public:
                       | io_did_bfm_t::val(did));
     }
 
+    /**
+     * Page-selective-within-domain IOTLB invalidation of the 2^am pages
+     * at `addr`, `addr` must be aligned accordingly.
+     */
+    static Inv_desc iotlb_page(unsigned did, Unsigned64 addr, unsigned am)
+    {
+      return Inv_desc(0x32 | io_dw_bfm_t::val(1) | io_dr_bfm_t::val(1)
+                      | io_did_bfm_t::val(did),
+                      io_aadr_bfm_t::val_dirty(addr) | io_am_bfm_t::val(am));
+    }
+
     /// Global context-cache invalidation
     static Inv_desc cc_full()
     { return Inv_desc(0x11); }
@@ -293,6 +304,9 @@ public:
 
   Spin_lock<> _lock;
 
+  /// Maximum number of descriptors for invalidate_and_wait()
+  enum { Max_inv_batch = 16 };
+
   Spin_lock<> _inv_q_lock;
   unsigned inv_q_tail = 0;
   unsigned inv_q_size = 0;
@@ -360,16 +374,29 @@ public:
    * \return true for success, false if the queue is full
    */
   bool invalidate(Inv_desc const &id)
+  { return invalidate(&id, 1); }
+
+  /**
+   * Queue `n` descriptors with a single update of the tail pointer.
+   *
+   * \return true for success, false if the queue has not enough room for
+   *         all of them, then nothing was queued.
+   */
+  bool invalidate(Inv_desc const *ids, unsigned n)
   {
-    unsigned hw_head = regs[Reg_64::Inv_q_head];
+    unsigned hw_head = regs[Reg_64::Inv_q_head] / sizeof(Inv_desc);
 
     auto g = lock_guard(_inv_q_lock);
-    unsigned new_tail = (inv_q_tail + 1) & inv_q_size;
-    if (new_tail * sizeof(Inv_desc) == hw_head)
+    if (((hw_head - inv_q_tail - 1) & inv_q_size) < n)
       return false; // overrun
 
-    Inv_desc *d = inv_desc(inv_q_tail);
-    write_now(d, id);
+    unsigned new_tail = inv_q_tail;
+    for (unsigned i = 0; i < n; ++i)
+      {
+        write_now(inv_desc(new_tail), ids[i]);
+        new_tail = (new_tail + 1) & inv_q_size;
+      }
+
     inv_q_tail = new_tail;
 
     // write the new hw tail pointer under spin-lock too might be we
@@ -515,6 +542,46 @@ public:
       Proc::pause();
   }
 
+  /// Has the invalidation queue room for `n` more descriptors?
+  bool has_inv_room(unsigned n)
+  {
+    unsigned hw_head = regs[Reg_64::Inv_q_head] / sizeof(Inv_desc);
+    return ((hw_head - access_once(&inv_q_tail) - 1) & inv_q_size) >= n;
+  }
+
+  /// Does this IOMMU support page-selective IOTLB invalidation?
+  bool has_psi() const { return caps.psi(); }
+
+  /// Largest address mask for page-selective IOTLB invalidation.
+  unsigned max_am() const { return caps.mamv(); }
+
+  /**
+   * Queue `n` (<= Max_inv_batch) descriptors followed by a single wait
+   * descriptor and wait for their completion.
+   *
+   * \return false if the queue has not enough room, nothing was queued.
+   */
+  bool invalidate_and_wait(Inv_desc const *ids, unsigned n)
+  {
+    Inv_desc b[Max_inv_batch + 1];
+    Unsigned32 volatile flag = 1;
+
+    if (EXPECT_FALSE(n > Max_inv_batch))
+      return false;
+
+    for (unsigned i = 0; i < n; ++i)
+      b[i] = ids[i];
+    b[n] = Inv_desc::wait(&flag);
+
+    if (!invalidate(b, n + 1))
+      return false;
+
+    while (flag)
+      Proc::pause();
+
+    return true;
+  }
+
   unsigned num_domains() const
   { return 1U << ((caps.nd() * 2) + 4); }
 
@@ -23,6 +23,7 @@ IMPLEMENTATION[mp]:
 
 #include <cstdio>
 #include "apic.h"
+#include "cpu.h"
 #include "kmem.h"
 
 PUBLIC inline
@@ -73,6 +74,46 @@ Ipi::bcast(Message m, Cpu_number from_cpu)
   Apic::mp_send_ipi(Apic::APIC_IPI_OTHERS, (Unsigned8)m);
 }
 
+/**
+ * Send `m` to all CPUs in `to`.
+ *
+ * If `to` holds exactly the online CPUs other than `from_cpu`, this is a
+ * single IPI with the all-excluding-self shorthand. Otherwise, the APIC
+ * has no destination list and every target gets its own IPI.
+ *
+ * \return the number of IPIs written to the APIC.
+ */
+PUBLIC static NEEDS["apic.h", "cpu.h"]
+unsigned
+Ipi::send_mcast(Message m, Cpu_number from_cpu, Cpu_mask const &to)
+{
+  unsigned targets = 0;
+  bool others = true;
+  for (Cpu_number n = Cpu_number::first(); n < Config::max_num_cpus(); ++n)
+    {
+      bool t = to.get(n);
+      targets += t;
+      if (n != from_cpu && t != Cpu::online(n))
+        others = false;
+    }
+
+  if (!targets)
+    return 0;
+
+  if (others && !to.get(from_cpu))
+    {
+      Apic::mp_send_ipi(Apic::APIC_IPI_OTHERS, (Unsigned8)m);
+      stat_sent(from_cpu);
+      return 1;
+    }
+
+  for (Cpu_number n = Cpu_number::first(); n < Config::max_num_cpus(); ++n)
+    if (to.get(n))
+      send(m, from_cpu, n);
+
+  return targets;
+}
+
 #if defined(CONFIG_IRQ_SPINNER)
 
 // debug
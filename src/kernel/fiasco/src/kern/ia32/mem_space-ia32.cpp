@@ -123,6 +123,18 @@ Mem_space::tlb_flush(bool = false)
     Mem_unit::tlb_flush();
 }
 
+/**
+ * INVLPG also drops all TLB entries of a large page, and without PCIDs
+ * only the current space can have TLB entries at all.
+ */
+IMPLEMENT_OVERRIDE inline NEEDS["mem_unit.h"]
+void
+Mem_space::tlb_flush_page(Vaddr virt, Page_order)
+{
+  if (_current.current() == this)
+    Mem_unit::tlb_flush(Virt_addr::val(virt));
+}
+
 
 IMPLEMENT inline
 Mem_space *
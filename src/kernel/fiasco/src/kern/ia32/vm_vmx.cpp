@@ -47,11 +47,24 @@ IMPLEMENTATION [vmx]:
 #include "virt.h"
 #include "idt.h"
 #include "cpu.h"
+#include "kern_stat.h"
 
 PUBLIC inline
 Vm_vmx_b::Vm_vmx_b(Ram_quota *q) : Vm(q)
 {}
 
+/**
+ * A new VM may be allocated at the same address, so make sure no CPU
+ * considers its kernel VMCS loaded with our guest state anymore.
+ */
+PUBLIC
+Vm_vmx_b::~Vm_vmx_b()
+{
+  for (Cpu_number n = Cpu_number::first(); n < Config::max_num_cpus(); ++n)
+    if (Cpu::online(n))
+      Vmx::cpus.cpu(n).drop_guest_state_owner(this);
+}
+
 PUBLIC inline template<typename X>
 Vm_vmx_t<X>::Vm_vmx_t(Ram_quota *q) : Vm_vmx_b(q)
 {}
@@ -103,6 +116,49 @@ Vm_vmx_b::load(unsigned field_first, unsigned field_last, void *vmcs)
     load(field_first, vmcs);
 }
 
+/**
+ * Load `field` unless `d` says the kernel VMCS already holds its value,
+ * a null `d` loads everything.
+ */
+PROTECTED inline
+void
+Vm_vmx_b::load(unsigned field, void *vmcs, Vmx_user_info::Dirty const *d)
+{
+  if (!d || d->test_load(field))
+    load(field, vmcs);
+}
+
+PROTECTED inline
+void
+Vm_vmx_b::load(unsigned field_first, unsigned field_last, void *vmcs,
+               Vmx_user_info::Dirty const *d)
+{
+  for (; field_first <= field_last; field_first += 2)
+    load(field_first, vmcs, d);
+}
+
+PROTECTED inline
+template<typename T>
+Vmx_info::Flags<T>
+Vm_vmx_b::load(unsigned field, void *vmcs, Vmx_info::Bit_defs<T> const &m,
+               Vmx_user_info::Dirty const *d)
+{
+  if (!d || d->test_load(field))
+    return load<T>(field, vmcs, m);
+
+  return Vmx_info::Flags<T>(m.apply(read<T>(vmcs, field)));
+}
+
+PROTECTED inline
+void
+Vm_vmx_b::store(unsigned field_first, unsigned field_last, void *vmcs,
+                Vmx_user_info::Dirty const *d)
+{
+  for (; field_first <= field_last; field_first += 2)
+    if (!d || d->test_store(field_first))
+      store(field_first, vmcs);
+}
+
 PRIVATE inline static
 template< typename T >
 T
@@ -205,91 +261,109 @@ void
 Vm_vmx::store_vm_memory(void *)
 {}
 
+/**
+ * Write the guest state in `src` to the kernel VMCS.
+ *
+ * \param d  Dirty-tracking block of `src` if the kernel VMCS still holds
+ *           the state of `src` from the previous VM entry on this CPU,
+ *           then only fields marked there are written. Null to write all
+ *           fields.
+ */
 PRIVATE template<typename X>
 void
-Vm_vmx_t<X>::load_guest_state(Cpu_number cpu, void *src)
+Vm_vmx_t<X>::load_guest_state(Cpu_number cpu, void *src,
+                              Vmx_user_info::Dirty const *d)
 {
   Vmx &vmx = Vmx::cpus.cpu(cpu);
 
+  // the set of fields to load depends on the controls, so load everything
+  // once they change
+  if (d && (d->test_load(Vmx::F_entry_ctls)
+            || d->test_load(Vmx::F_exit_ctls)
+            || d->test_load(Vmx::F_pin_based_ctls)
+            || d->test_load(Vmx::F_proc_based_ctls)
+            || d->test_load(Vmx::F_proc_based_ctls_2)))
+    d = 0;
+
   // read VM-entry controls, apply filter and keep for later
   Vmx_info::Flags<Unsigned32> entry_ctls
-    = load<Unsigned32>(Vmx::F_entry_ctls, src, vmx.info.entry_ctls);
+    = load<Unsigned32>(Vmx::F_entry_ctls, src, vmx.info.entry_ctls, d);
 
   Vmx_info::Flags<Unsigned32> pinbased_ctls
-    = load<Unsigned32>(Vmx::F_pin_based_ctls, src, vmx.info.pinbased_ctls);
+    = load<Unsigned32>(Vmx::F_pin_based_ctls, src, vmx.info.pinbased_ctls, d);
 
   Vmx_info::Flags<Unsigned32> procbased_ctls
-    = load<Unsigned32>(Vmx::F_proc_based_ctls, src, vmx.info.procbased_ctls);
+    = load<Unsigned32>(Vmx::F_proc_based_ctls, src, vmx.info.procbased_ctls, d);
 
   Vmx_info::Flags<Unsigned32> procbased_ctls_2;
   if (procbased_ctls.test(Vmx_info::PRB1_enable_proc_based_ctls_2))
-    procbased_ctls_2 = load<Unsigned32>(Vmx::F_proc_based_ctls_2, src, vmx.info.procbased_ctls2);
+    procbased_ctls_2 = load<Unsigned32>(Vmx::F_proc_based_ctls_2, src, vmx.info.procbased_ctls2, d);
   else
     procbased_ctls_2 = Vmx_info::Flags<Unsigned32>(0);
 
-  load<Unsigned32>(Vmx::F_exit_ctls, src, vmx.info.exit_ctls);
+  load<Unsigned32>(Vmx::F_exit_ctls, src, vmx.info.exit_ctls, d);
 
   // write 16-bit fields
-  load(0x800, 0x80e, src);
+  load(0x800, 0x80e, src, d);
 
   // write 64-bit fields
-  load(0x2802, src);
+  load(0x2802, src, d);
 
   // check if the following bits are allowed to be set in entry_ctls
   if (entry_ctls.test(14)) // PAT load requested
-    load(Vmx::F_guest_pat, src);
+    load(Vmx::F_guest_pat, src, d);
 
   if (entry_ctls.test(15)) // EFER load requested
-    load(Vmx::F_guest_efer, src);
+    load(Vmx::F_guest_efer, src, d);
 
   if (entry_ctls.test(13)) // IA32_PERF_GLOBAL_CTRL load requested
-    load(Vmx::F_guest_perf_global_ctl, src);
+    load(Vmx::F_guest_perf_global_ctl, src, d);
 
   // this is Fiasco.OC internal state
 #if 0
   if (vmx.has_ept())
-    load(0x280a, 0x2810, src);
+    load(0x280a, 0x2810, src, d);
 #endif
 
   // write 32-bit fields
-  load(0x4800, 0x4826, src);
-  load(0x482a, src);
+  load(0x4800, 0x4826, src, d);
+  load(0x482a, src, d);
 
   if (pinbased_ctls.test(6)) // activate vmx-preemption timer
-    load(Vmx::F_preempt_timer, src);
+    load(Vmx::F_preempt_timer, src, d);
 
   // write natural-width fields
-  load<Mword>(0x6800, src, vmx.info.cr0_defs);
+  load<Mword>(0x6800, src, vmx.info.cr0_defs, d);
 
   static_cast<X*>(this)->load_vm_memory(src);
 
-  load<Mword>(0x6804, src, vmx.info.cr4_defs);
-  load(0x6806, 0x6826, src);
+  load<Mword>(0x6804, src, vmx.info.cr4_defs, d);
+  load(0x6806, 0x6826, src, d);
 
   // VPID must be virtualized in Fiasco
 #if 0
   if (procbased_ctls_2 & Vmx::PB2_enable_vpid)
-    load(Vmx::F_vpid, src);
+    load(Vmx::F_vpid, src, d);
 #endif
 
   // currently io-bitmaps are unsupported
   // currently msr-bitmaps are unsupported
 
   // load(0x200C, src); for SMM virtualization
-  load(Vmx::F_tsc_offset, src);
+  load(Vmx::F_tsc_offset, src, d);
 
   // no virtual APIC yet, and has to be managed in kernel somehow
 #if 0
   if (procbased_ctls.test(Vmx::PRB1_tpr_shadow))
-    load(0x2012, src);
+    load(0x2012, src, d);
 #endif
 
   if (procbased_ctls_2.test(Vmx_info::PRB2_virtualize_apic))
-    load(Vmx::F_apic_access_addr, src);
+    load(Vmx::F_apic_access_addr, src, d);
 
   // exception bit map and pf error-code stuff
-  load<Unsigned32>(Vmx::F_exception_bitmap, src, vmx.info.exception_bitmap);
-  load(0x4006, 0x4008, src);
+  load<Unsigned32>(Vmx::F_exception_bitmap, src, vmx.info.exception_bitmap, d);
+  load(0x4006, 0x4008, src, d);
 
   // vm entry control stuff
   Unsigned32 irq_info = read<Unsigned32>(src, Vmx::F_entry_int_info);
@@ -309,7 +383,7 @@ Vm_vmx_t<X>::load_guest_state(Cpu_number cpu, void *src)
     }
 
   // hm, we have to check for sanitizing the cr0 and cr4 shadow stuff
-  load(0x6000, 0x6006, src);
+  load(0x6000, 0x6006, src, d);
 
   // no cr3 target values supported
 }
@@ -355,9 +429,17 @@ Vm_vmx_t<X>::store_guest_state(Cpu_number cpu, void *dest)
   store(0x6804, 0x6822, dest);
 }
 
+/**
+ * Read the exit information to `dest`.
+ *
+ * \param d  Dirty-tracking block of `dest` if the VMM requested only
+ *           selected exit information fields, null to read all of them.
+ *           The exit reason is always read.
+ */
 PROTECTED
 void
-Vm_vmx_b::store_exit_info(Cpu_number cpu, void *dest)
+Vm_vmx_b::store_exit_info(Cpu_number cpu, void *dest,
+                          Vmx_user_info::Dirty const *d)
 {
   (void)cpu;
   // read 64-bit fields, that is a EPT pf thing
@@ -374,10 +456,12 @@ Vm_vmx_b::store_exit_info(Cpu_number cpu, void *dest)
     }
 
   // read 32-bit fields
-  store(0x4400, 0x440e, dest);
+  if (d)
+    store(Vmx::F_exit_reason, dest);
+  store(0x4400, 0x440e, dest, d);
 
   // read natural-width fields
-  store(0x6400, 0x640a, dest);
+  store(0x6400, 0x640a, dest, d);
 }
 
 PROTECTED
@@ -452,8 +536,17 @@ Vm_vmx_t<X>::do_resume_vcpu(Context *ctxt, Vcpu_state *vcpu, void *vmcs_s)
 
   safe_host_segments(ctxt, vcpu);
 
+  Vmx_user_info::Dirty *dirty = Vmx_user_info::dirty(vmcs_s);
+  Unsigned32 dirty_flags = access_once(&dirty->flags);
+  bool load_dirty = (dirty_flags & Vmx_user_info::Dirty::F_load_dirty)
+                    && v.owns_guest_state(this, vmcs_s, dirty);
+
+  Kern_stat::Time t = Kern_stat::now();
+
   // host cr0 und cr4
-  load_guest_state(cpu, vmcs_s);
+  load_guest_state(cpu, vmcs_s, load_dirty ? dirty : 0);
+
+  Kern_stat::Time xfer = Kern_stat::now() - t;
 
   Unsigned16 ldt = Cpu::get_ldt();
 
@@ -463,7 +556,10 @@ Vm_vmx_t<X>::do_resume_vcpu(Context *ctxt, Vcpu_state *vcpu, void *vmcs_s)
   bool guest_long_mode = read<Unsigned64>(vmcs_s, Vmx::F_entry_ctls) & (1 << 9);
 
   if (!is_64bit() && guest_long_mode)
-    return -L4_err::EInval;
+    {
+      v.reset_guest_state_owner();
+      return -L4_err::EInval;
+    }
 
   if (guest_long_mode)
     load_guest_msrs(vmcs_s);
@@ -480,7 +576,14 @@ Vm_vmx_t<X>::do_resume_vcpu(Context *ctxt, Vcpu_state *vcpu, void *vmcs_s)
   unsigned long ret = resume_vm_vmx(&vcpu->_regs);
   // vmread error?
   if (EXPECT_FALSE(ret))
-    return -L4_err::EInval;
+    {
+      v.reset_guest_state_owner();
+      return -L4_err::EInval;
+    }
+
+  v.set_guest_state_owner(this, vmcs_s, dirty);
+  if (dirty_flags & Vmx_user_info::Dirty::F_load_dirty)
+    dirty->clear_load();
 
   if (guest_long_mode)
     {
@@ -509,8 +612,15 @@ Vm_vmx_t<X>::do_resume_vcpu(Context *ctxt, Vcpu_state *vcpu, void *vmcs_s)
     Cpu::set_tr(Gdt::gdt_tss);
   }
 
+  t = Kern_stat::now();
   store_guest_state(cpu, vmcs_s);
-  store_exit_info(cpu, vmcs_s);
+  store_exit_info(cpu, vmcs_s,
+                  (dirty_flags & Vmx_user_info::Dirty::F_store_requested)
+                  ? dirty : 0);
+  xfer += Kern_stat::now() - t;
+
+  Kern_stat::inc(Kern_stat::Cnt_vm_exit);
+  Kern_stat::account(Kern_stat::Hist_vm_state, xfer);
 
   Unsigned32 reason = read<Unsigned32>(vmcs_s, Vmx::F_exit_reason) & 0xffff;
   switch (reason)
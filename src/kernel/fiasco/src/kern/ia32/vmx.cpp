@@ -217,6 +217,56 @@ struct Vmx_user_info
     }
   };
 
+  /**
+   * Dirty-tracking block of the software VMCS, located 64 * offsets[0x1e]
+   * bytes after the start of the VMCS.
+   *
+   * Fields are addressed by the index field >> 10, the same index as for
+   * the offset table (width and type), and the bit (field & 0x3ff) >> 1.
+   * With F_load_dirty set, the VMM marks every field it modified in
+   * `load` and the kernel writes only those fields to the hardware VMCS,
+   * as long as the hardware VMCS still holds the state of this vCPU;
+   * otherwise all fields are written. The kernel clears `load` after each
+   * VM entry. With F_store_requested set, only the exit information
+   * fields marked in `store` (indexed by width) are read on VM
+   * exit, guest state is always read completely. `gen` belongs to the
+   * kernel.
+   */
+  struct Dirty
+  {
+    enum
+    {
+      F_load_dirty      = 1,
+      F_store_requested = 2,
+    };
+
+    Unsigned32 flags;
+    Unsigned32 gen;
+    Unsigned64 load[32];
+    Unsigned64 store[4];
+
+    static Unsigned64 bit(unsigned field)
+    { return 1ULL << ((field & 0x3ff) >> 1); }
+
+    bool test_load(unsigned field) const
+    { return load[field >> 10] & bit(field); }
+
+    bool test_store(unsigned field) const
+    { return store[field >> 13] & bit(field); }
+
+    void clear_load()
+    {
+      for (unsigned i = 0; i < sizeof(load) / sizeof(load[0]); ++i)
+        load[i] = 0;
+    }
+  };
+
+  static Dirty *dirty(void *vmcs)
+  {
+    return reinterpret_cast<Dirty *>((Address)vmcs
+                                     + Fo_table::master_offsets[0x1e] * 64);
+  }
+
   Unsigned64 basic;
   Vmx_info::Bit_defs_32<Vmx_info::Pin_based_ctls> pinbased;
   Vmx_info::Bit_defs_32<Vmx_info::Primary_proc_based_ctls> procbased;
@@ -446,6 +496,11 @@ private:
   Unsigned64 _vmxon_base_pa;
   void *_kernel_vmcs;
   Unsigned64 _kernel_vmcs_pa;
+
+  /// Software VMCS whose guest state the kernel VMCS currently holds.
+  void const *_owner_vm;
+  void const *_owner_vmcs;
+  Unsigned32 _owner_gen;
 };
 
 class Vmx_info_msr
@@ -800,6 +855,7 @@ Vmx::pm_on_resume(Cpu_number)
   if (eflags & 0x41)
     panic("VMX: vmptrld: VMFailInvalid, vmcs pointer not valid\n");
 
+  reset_guest_state_owner();
 }
 
 PUBLIC
@@ -816,7 +872,8 @@ Vmx::pm_on_suspend(Cpu_number)
 
 PUBLIC
 Vmx::Vmx(Cpu_number cpu)
-  : _vmx_enabled(false), _has_vpid(false)
+  : _vmx_enabled(false), _has_vpid(false), _owner_vm(0), _owner_vmcs(0),
+    _owner_gen(cxx::int_value<Cpu_number>(cpu))
 {
   Cpu &c = Cpu::cpus.cpu(cpu);
   if (cpu == Cpu::invalid() || !c.vmx())
@@ -997,10 +1054,15 @@ enum
   Offset_4800 = Offset_2800 + Block_size<0x2800 | Max_field_index>::value,
   Offset_6800 = Offset_4800 + Block_size<0x4800 | Max_field_index>::value,
 
-  Total_size  = Offset_6800 + Block_size<0x6800 | Max_field_index>::value
+  Total_size  = Offset_6800 + Block_size<0x6800 | Max_field_index>::value,
+
+  Offset_dirty = Total_size,
+  Dirty_size   = (sizeof(Vmx_user_info::Dirty) + 63) / 64,
 };
 
-static_assert(Total_size * 64 + 1024 < 4096, "VMCS fields exceed extended vCPU state");
+static_assert((Total_size + Dirty_size) * 64 + 1024 < 4096,
+              "VMCS fields exceed extended vCPU state");
+static_assert(Max_field_index >> 1 < 64, "VMCS dirty bitmap too small");
 }
 
 /*
@@ -1018,7 +1080,8 @@ static_assert(Total_size * 64 + 1024 < 4096, "VMCS fields exceed extended vCPU s
  *       1Bh: Reserved
  *       1Ch: Offset of first VMCS field
  *       1Dh: Full size of VMCS fields
- * 1Eh - 1Fh: Reserved
+ *       1Eh: Offset of the dirty-tracking block, see Vmx_user_info::Dirty
+ *       1Fh: Reserved
  *
  */
 unsigned char const Vmx_user_info::Fo_table::master_offsets[32] =
@@ -1027,7 +1090,7 @@ unsigned char const Vmx_user_info::Fo_table::master_offsets[32] =
    Vmcs_field::Offset_2000, Vmcs_field::Offset_2400, Vmcs_field::Offset_2800, 0,   0, 0, 0, 0,
    Vmcs_field::Offset_4000, Vmcs_field::Offset_4400, Vmcs_field::Offset_4800, 0,   0, 0, 0, 0,
    Vmcs_field::Offset_6000, Vmcs_field::Offset_6400, Vmcs_field::Offset_6800, 0,
-   Vmcs_field::Offset_0000, Vmcs_field::Total_size, 0, 0,
+   Vmcs_field::Offset_0000, Vmcs_field::Total_size, Vmcs_field::Offset_dirty, 0,
 };
 
 PUBLIC inline
@@ -1082,3 +1145,47 @@ PUBLIC
 bool
 Vmx::has_vpid() const
 { return _has_vpid; }
+
+/**
+ * Does the kernel VMCS still hold the guest state of `vmcs`, as loaded by
+ * the last VM entry of `vm` on this CPU?
+ */
+PUBLIC inline
+bool
+Vmx::owns_guest_state(void const *vm, void const *vmcs,
+                      Vmx_user_info::Dirty const *d) const
+{
+  return _owner_vm == vm && _owner_vmcs == vmcs
+         && access_once(&d->gen) == _owner_gen;
+}
+
+/**
+ * Record that the kernel VMCS now holds the guest state of `vmcs`.
+ *
+ * Generations advance in steps of the maximum number of CPUs, starting at
+ * the CPU number, so that no two CPUs ever hand out the same value.
+ */
+PUBLIC inline NEEDS["config.h"]
+void
+Vmx::set_guest_state_owner(void const *vm, void const *vmcs,
+                           Vmx_user_info::Dirty *d)
+{
+  _owner_vm = vm;
+  _owner_vmcs = vmcs;
+  _owner_gen += Config::Max_num_cpus;
+  d->gen = _owner_gen;
+}
+
+PUBLIC inline
+void
+Vmx::reset_guest_state_owner()
+{ _owner_vm = _owner_vmcs = 0; }
+
+/// Forget `vm` as owner, may be called from any CPU.
+PUBLIC inline NEEDS["atomic.h", "lock_guard.h"]
+void
+Vmx::drop_guest_state_owner(void const *vm)
+{
+  auto guard = lock_guard(cpu_lock);
+  mp_cas(&_owner_vm, vm, (void const *)0);
+}
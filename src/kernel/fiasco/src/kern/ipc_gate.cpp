@@ -2,7 +2,7 @@ INTERFACE:
 
 #include "kobject.h"
 #include "kobject_helper.h"
-#include "slab_cache.h"
+#include "kmem_slab.h"
 #include "thread_object.h"
 
 class Ram_quota;
@@ -35,7 +35,7 @@ class Ipc_gate_obj :
   public cxx::Dyn_castable<Ipc_gate_obj, Ipc_gate, Ipc_gate_ctl>
 {
   friend class Ipc_gate;
-  typedef Slab_cache Self_alloc;
+  typedef Kmem_slab Self_alloc;
 
 public:
   bool put() { return Ipc_gate::put(); }
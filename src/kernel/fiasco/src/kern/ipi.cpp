@@ -1,5 +1,6 @@
 INTERFACE:
 
+#include "cpu_mask.h"
 #include "types.h"
 
 class Ipi
@@ -50,6 +51,11 @@ void
 Ipi::bcast(Message, Cpu_number from_cpu)
 { (void)from_cpu; }
 
+PUBLIC static inline
+unsigned
+Ipi::send_mcast(Message, Cpu_number from_cpu, Cpu_mask const &)
+{ (void)from_cpu; return 0; }
+
 
 // ------------------------------------------------------------------------
 IMPLEMENTATION[mp]:
@@ -2,11 +2,14 @@ INTERFACE:
 
 #include "ipc_sender.h"
 #include "irq_chip.h"
+#include "kmem_slab.h"
 #include "kobject_helper.h"
 #include "member_offs.h"
 #include "sender.h"
 #include "context.h"
+#include "timeout.h"
 
+class Irq_sender;
 class Ram_quota;
 class Thread;
 
@@ -18,7 +21,7 @@ class Thread;
 class Irq : public Irq_base, public cxx::Dyn_castable<Irq, Kobject>
 {
   MEMBER_OFFSET();
-  typedef Slab_cache Allocator;
+  typedef Kmem_slab Allocator;
 
 public:
   enum Op
@@ -37,8 +40,20 @@ protected:
 };
 
 
+/// Timeout delivering the deferred notification of a moderated Irq_sender.
+class Irq_moderation_timeout : public Timeout
+{
+public:
+  Irq_sender *irq;
+};
+
 /**
  * IRQ Kobject to send IPC messages to a receiving thread.
+ *
+ * Without moderation every hit results in one message. A moderated IRQ
+ * instead counts its hits and sends one message for many of them, see
+ * sys_moderate(). The message then carries the number of hits since the
+ * previous message in its first word.
  */
 class Irq_sender
 : public Kobject_h<Irq_sender, Irq>,
@@ -46,11 +61,20 @@ class Irq_sender
 {
 public:
   enum Op {
-    Op_attach = 0,
-    Op_detach = 1,
+    Op_attach           = 0,
+    Op_detach           = 1,
+    Op_moderate         = 2,
+    Op_poll             = 3,
+    Op_moderation_stats = 4,
     Op_bind     = 0x10,
   };
 
+  enum Moderation_flags
+  {
+    /// After a message, stay quiet until the receiver rearms with Op_poll.
+    Mod_poll = 1,
+  };
+
 protected:
   static Thread *detach_in_progress()
   { return reinterpret_cast<Thread *>(1); }
@@ -58,11 +82,32 @@ protected:
   static bool is_valid_thread(Thread const *t)
   { return t > detach_in_progress(); }
 
+  /**
+   * Pending hits, or with moderation, the state of the notification:
+   * Mod_armed, Mod_outstanding or Mod_disarmed.
+   */
   Smword _queued;
   Thread *_irq_thread;
 
 private:
+  enum
+  {
+    Mod_armed       = 0, ///< the next hit may send a message
+    Mod_outstanding = 1, ///< a message is queued or deferred
+    Mod_disarmed    = 2, ///< Mod_poll: waiting for the receiver to rearm
+  };
+
   Mword _irq_id;
+
+  Mword _mod_threshold;  ///< hits per message, 0 without moderation
+  Mword _mod_window;     ///< minimum time between messages in microseconds
+  Mword _mod_flags;      ///< Moderation_flags
+  Mword _mod_pending;    ///< hits not reported yet
+  Unsigned64 _mod_next;  ///< earliest time of the next message
+  Cpu_number _mod_cpu;   ///< CPU of _mod_timeout
+  Mword _mod_notified;   ///< messages sent with moderation
+  Mword _mod_reported;   ///< hits reported in these messages
+  Irq_moderation_timeout _mod_timeout;
 };
 
 
@@ -101,16 +146,31 @@ private:
   Spin_lock<> _mux_lock;
 };
 
+//-----------------------------------------------------------------------------
+INTERFACE [kern_stats]:
+
+#include "kern_stat.h"
+
+EXTENSION class Irq_sender
+{
+private:
+  /// Time and CPU of the first hit that is not yet delivered.
+  Kern_stat::Stamp _hit;
+};
+
 //-----------------------------------------------------------------------------
 IMPLEMENTATION:
 
 #include "assert_opt.h"
 #include "atomic.h"
 #include "config.h"
+#include "cpu_call.h"
+#include "cpu_mask.h"
 #include "cpu_lock.h"
 #include "entry_frame.h"
 #include "globals.h"
 #include "ipc_sender.h"
+#include "kern_stat.h"
 #include "kmem_slab.h"
 #include "kobject_rpc.h"
 #include "lock_guard.h"
@@ -118,6 +178,7 @@ IMPLEMENTATION:
 #include "std_macros.h"
 #include "thread_object.h"
 #include "thread_state.h"
+#include "timer.h"
 #include "l4_buf_iter.h"
 #include "vkey.h"
 
@@ -411,7 +472,10 @@ Irq_sender::alloc(Thread *t, Kobject ***rl)
     _chip->set_cpu(pin(), t->home_cpu());
 
   if (old == nullptr)
-    _queued = 0;
+    {
+      _queued = 0;
+      _mod_pending = 0;
+    }
   else if (reinject)
     send();
 
@@ -463,15 +527,20 @@ Irq_sender::free(Kobject ***rl)
   // release cpu-lock early, actually before delete
   guard.reset();
 
+  cancel_deferred();
   t->put_n_reap(rl);
   return 0;
 }
 
 PUBLIC explicit
 Irq_sender::Irq_sender(Ram_quota *q = 0)
-: Kobject_h<Irq_sender, Irq>(q), _queued(0), _irq_thread(0), _irq_id(~0UL)
+: Kobject_h<Irq_sender, Irq>(q), _queued(0), _irq_thread(0), _irq_id(~0UL),
+  _mod_threshold(0), _mod_window(0), _mod_flags(0), _mod_pending(0),
+  _mod_next(0), _mod_cpu(Cpu_number::boot_cpu()), _mod_notified(0),
+  _mod_reported(0)
 {
   hit_func = &hit_level_irq;
+  _mod_timeout.irq = this;
 }
 
 PUBLIC
@@ -498,6 +567,9 @@ PRIVATE inline NEEDS ["atomic.h"]
 Smword
 Irq_sender::consume()
 {
+  if (EXPECT_FALSE(_mod_threshold))
+    return consume_moderated();
+
   Smword old;
 
   do
@@ -539,14 +611,30 @@ bool
 Irq_sender::dequeue_sender()
 { return consume() < 1; }
 
-PUBLIC inline
+PUBLIC inline NEEDS[Irq_sender::stat_delivered, Irq_sender::take_pending,
+                    "timer.h"]
 Syscall_frame *
 Irq_sender::transfer_msg(Receiver *recv)
 {
   Syscall_frame* dst_regs = recv->rcv_regs();
 
-  // set ipc return value: OK
-  dst_regs->tag(L4_msg_tag(0));
+  stat_delivered();
+
+  if (EXPECT_FALSE(_mod_threshold))
+    {
+      // report the hits since the previous message
+      Mword n = take_pending();
+      ++_mod_notified;
+      _mod_reported += n;
+      if (_mod_window)
+        _mod_next = Timer::system_clock() + _mod_window;
+
+      recv->utcb().access()->values[0] = n;
+      dst_regs->tag(L4_msg_tag(1, 0, 0, 0));
+    }
+  else
+    // set ipc return value: OK
+    dst_regs->tag(L4_msg_tag(0));
 
   // set ipc source thread id
   dst_regs->from(_irq_id);
@@ -582,7 +670,7 @@ Irq_sender::handle_remote_hit(Context::Drq *, Context *target, void *arg)
   auto t = access_once(&irq->_irq_thread);
   if (EXPECT_TRUE(t == target))
     {
-      if (EXPECT_TRUE(irq->send_msg(t, false)))
+      if (EXPECT_TRUE(irq->deliver(t, false)))
         return Context::Drq::no_answer_resched();
     }
   else
@@ -604,7 +692,26 @@ Irq_sender::queue()
 }
 
 
-PRIVATE inline
+/**
+ * Send the message to `t` on its home CPU, or defer it to the end of the
+ * moderation window.
+ *
+ * \return true if a reschedule is necessary.
+ */
+PRIVATE inline NEEDS["timer.h"]
+bool
+Irq_sender::deliver(Thread *t, bool is_not_xcpu)
+{
+  if (EXPECT_FALSE(_mod_window) && Timer::system_clock() < _mod_next)
+    {
+      defer();
+      return false;
+    }
+
+  return send_msg(t, is_not_xcpu);
+}
+
+PRIVATE inline NEEDS[Irq_sender::deliver]
 void
 Irq_sender::send()
 {
@@ -616,11 +723,12 @@ Irq_sender::send()
     t->drq(&_drq, handle_remote_hit, this,
            Context::Drq::Target_ctxt, Context::Drq::No_wait);
   else
-    send_msg(t, true);
+    deliver(t, true);
 }
 
 
-PUBLIC inline NEEDS[Irq_sender::send, Irq_sender::queue]
+PUBLIC inline NEEDS[Irq_sender::send, Irq_sender::queue, Irq_sender::stat_hit,
+                    Irq_sender::moderated_hit]
 void
 Irq_sender::_hit_level_irq(Upstream_irq const *ui)
 {
@@ -636,8 +744,16 @@ Irq_sender::_hit_level_irq(Upstream_irq const *ui)
   assert (cpu_lock.test());
   mask_and_ack();
   Upstream_irq::ack(ui);
-  if (queue() == 0)
-    send();
+
+  // the IRQ stays masked until the receiver's EOI, so there is at most one
+  // hit per message without a window
+  if (EXPECT_FALSE(_mod_threshold))
+    moderated_hit(1);
+  else if (queue() == 0)
+    {
+      stat_hit();
+      send();
+    }
 }
 
 PRIVATE static
@@ -645,7 +761,8 @@ void
 Irq_sender::hit_level_irq(Irq_base *i, Upstream_irq const *ui)
 { nonull_static_cast<Irq_sender*>(i)->_hit_level_irq(ui); }
 
-PUBLIC inline NEEDS[Irq_sender::send, Irq_sender::queue]
+PUBLIC inline NEEDS[Irq_sender::send, Irq_sender::queue, Irq_sender::stat_hit,
+                    Irq_sender::moderated_hit]
 void
 Irq_sender::_hit_edge_irq(Upstream_irq const *ui)
 {
@@ -659,6 +776,15 @@ Irq_sender::_hit_edge_irq(Upstream_irq const *ui)
   // LOG_MSG_3VAL(current(), "IRQ", dbg_id(), 0, _queued);
 
   assert (cpu_lock.test());
+  if (EXPECT_FALSE(_mod_threshold))
+    {
+      // moderated IRQs are counted, not masked
+      ack();
+      Upstream_irq::ack(ui);
+      moderated_hit(_mod_threshold);
+      return;
+    }
+
   Smword q = queue();
 
   // if we get a second edge triggered IRQ before the first is
@@ -671,7 +797,10 @@ Irq_sender::_hit_edge_irq(Upstream_irq const *ui)
 
   Upstream_irq::ack(ui);
   if (q == 0)
-    send();
+    {
+      stat_hit();
+      send();
+    }
 }
 
 PRIVATE static
@@ -679,6 +808,138 @@ void
 Irq_sender::hit_edge_irq(Irq_base *i, Upstream_irq const *ui)
 { nonull_static_cast<Irq_sender*>(i)->_hit_edge_irq(ui); }
 
+/**
+ * Count a hit of a moderated IRQ and send a message if `threshold` hits
+ * are pending and no message is outstanding.
+ */
+PRIVATE
+void
+Irq_sender::moderated_hit(Mword threshold)
+{
+  Mword p;
+  do
+    p = access_once(&_mod_pending);
+  while (!mp_cas(&_mod_pending, p, p + 1));
+
+  if (p + 1 >= threshold && mp_cas(&_queued, (Smword)Mod_armed,
+                                   (Smword)Mod_outstanding))
+    {
+      stat_hit();
+      send();
+    }
+}
+
+/// Take all hits that are not reported yet.
+PRIVATE inline NEEDS["atomic.h"]
+Mword
+Irq_sender::take_pending()
+{
+  Mword p;
+  do
+    p = access_once(&_mod_pending);
+  while (!mp_cas(&_mod_pending, p, 0UL));
+
+  return p;
+}
+
+/**
+ * Finish the outstanding message of a moderated IRQ.
+ *
+ * Hits that arrived while the message was outstanding start the next
+ * message right away, or at the end of the window.
+ *
+ * \return 1 if the sender shall stay queued for the next message.
+ */
+PRIVATE
+Smword
+Irq_sender::consume_moderated()
+{
+  if (_mod_flags & Mod_poll)
+    {
+      write_now(&_queued, (Smword)Mod_disarmed);
+      return 0;
+    }
+
+  write_now(&_queued, (Smword)Mod_armed);
+  Mem::mp_mb();
+
+  Mword p = access_once(&_mod_pending);
+  if (!p || (!_mod_window && p < _mod_threshold)
+      || !mp_cas(&_queued, (Smword)Mod_armed, (Smword)Mod_outstanding))
+    return 0;
+
+  if (!_mod_window)
+    return 1;
+
+  defer();
+  return 0;
+}
+
+/// Send the outstanding message when the window ends.
+PRIVATE
+void
+Irq_sender::defer()
+{
+  _mod_cpu = current_cpu();
+  _mod_timeout.set(_mod_next, _mod_cpu);
+}
+
+PRIVATE
+bool
+Irq_moderation_timeout::expired()
+{ return irq->deferred_expired(); }
+
+PUBLIC
+bool
+Irq_sender::deferred_expired()
+{
+  auto t = access_once(&_irq_thread);
+  if (EXPECT_FALSE(!is_valid_thread(t)))
+    return false;
+
+  // the window is over, do not switch threads within the timeout handler
+  t->drq(&_drq, handle_remote_hit, this,
+         Context::Drq::Target_ctxt, Context::Drq::No_wait);
+  return true;
+}
+
+/**
+ * Cancel the deferred message, on the CPU it was deferred on.
+ *
+ * The caller may or may not hold the CPU lock, the timeout queue of the
+ * current CPU is only touched with it held.
+ */
+PRIVATE
+void
+Irq_sender::cancel_deferred()
+{
+  if (!_mod_window)
+    return;
+
+  Cpu_number cpu;
+    {
+      auto guard = lock_guard(cpu_lock);
+      cpu = access_once(&_mod_cpu);
+      if (cpu == current_cpu())
+        {
+          if (_mod_timeout.is_set())
+            _mod_timeout.reset();
+          return;
+        }
+    }
+
+  Cpu_mask cpus;
+  cpus.set(cpu);
+
+  auto guard = lock_guard<Lock_guard_inverse_policy>(cpu_lock);
+  Cpu_call::cpu_call_many(cpus, [this](Cpu_number)
+    {
+      if (_mod_timeout.is_set())
+        _mod_timeout.reset();
+      return false;
+    });
+}
+
 
 PRIVATE
 L4_msg_tag
@@ -731,10 +992,92 @@ Irq_sender::sys_detach()
 }
 
 
+/**
+ * Configure moderation.
+ *
+ * values[1] is the number of hits per message, values[2] the minimum time
+ * between two messages in microseconds and values[3] the
+ * Moderation_flags. Without a window, fewer hits than the threshold are
+ * only reported by Op_poll, with a window they are reported at its end.
+ * Moderation is off if both the threshold and the window are 0. The IRQ
+ * must not be bound to a thread.
+ */
+PRIVATE
+L4_msg_tag
+Irq_sender::sys_moderate(L4_msg_tag tag, Utcb const *utcb)
+{
+  if (EXPECT_FALSE(tag.words() < 4))
+    return commit_result(-L4_err::EMsgtooshort);
+
+  if (access_once(&_irq_thread))
+    return commit_result(-L4_err::EBusy);
+
+  Mword hits = access_once(&utcb->values[1]);
+  Mword window = access_once(&utcb->values[2]);
+
+  _mod_threshold = (hits || window) ? max<Mword>(hits, 1) : 0;
+  _mod_window = window;
+  _mod_flags = access_once(&utcb->values[3]) & Mod_poll;
+  _mod_pending = 0;
+  _mod_next = 0;
+  _mod_notified = 0;
+  _mod_reported = 0;
+  _queued = 0;
+
+  return commit_result(0);
+}
+
+/**
+ * Take the hits of a moderated IRQ that were not reported yet.
+ *
+ * If values[1] is not 0 and there are no such hits, a Mod_poll IRQ is
+ * rearmed. The number of hits is returned in values[0], the receiver
+ * handles them and polls again until there are none.
+ */
+PRIVATE
+L4_msg_tag
+Irq_sender::sys_poll(L4_msg_tag tag, Utcb const *utcb, Utcb *out)
+{
+  if (EXPECT_FALSE(tag.words() < 2))
+    return commit_result(-L4_err::EMsgtooshort);
+
+  if (EXPECT_FALSE(!_mod_threshold))
+    return commit_result(-L4_err::EInval);
+
+  Mword n = take_pending();
+  if (!n && access_once(&utcb->values[1])
+      && mp_cas(&_queued, (Smword)Mod_disarmed, (Smword)Mod_armed))
+    {
+      // catch the hits since take_pending()
+      Mem::mp_mb();
+      if (access_once(&_mod_pending) >= _mod_threshold
+          && mp_cas(&_queued, (Smword)Mod_armed, (Smword)Mod_outstanding))
+        send();
+    }
+
+  out->values[0] = n;
+  return commit_result(0, 1);
+}
+
+/**
+ * Read the moderation statistics: the number of messages, the number of
+ * hits coalesced into them and the number of pending hits.
+ */
+PRIVATE
+L4_msg_tag
+Irq_sender::sys_moderation_stats(Utcb *out)
+{
+  Mword notified = access_once(&_mod_notified);
+  out->values[0] = notified;
+  out->values[1] = access_once(&_mod_reported) - notified;
+  out->values[2] = access_once(&_mod_pending);
+  return commit_result(0, 3);
+}
+
 PUBLIC
 L4_msg_tag
 Irq_sender::kinvoke(L4_obj_ref, L4_fpage::Rights /*rights*/, Syscall_frame *f,
-                    Utcb const *utcb, Utcb *)
+                    Utcb const *utcb, Utcb *out)
 {
   L4_msg_tag tag = f->tag();
   int op = get_irq_opcode(tag, utcb);
@@ -754,7 +1097,8 @@ Irq_sender::kinvoke(L4_obj_ref, L4_fpage::Rights /*rights*/, Syscall_frame *f,
         }
 
     case L4_msg_tag::Label_irq:
-      return dispatch_irq_proto(op, _queued < 1);
+      // a moderated IRQ is unmasked on every EOI, its hits are counted
+      return dispatch_irq_proto(op, _mod_threshold || _queued < 1);
 
     case L4_msg_tag::Label_irq_sender:
       switch (op)
@@ -766,6 +1110,15 @@ Irq_sender::kinvoke(L4_obj_ref, L4_fpage::Rights /*rights*/, Syscall_frame *f,
         case Op_detach:
           return sys_detach();
 
+        case Op_moderate:
+          return sys_moderate(tag, utcb);
+
+        case Op_poll:
+          return sys_poll(tag, utcb, out);
+
+        case Op_moderation_stats:
+          return sys_moderation_stats(out);
+
         default:
           return commit_result(-L4_err::ENosys);
         }
@@ -831,6 +1184,38 @@ Irq::destroy(Kobject ***rl)
   Kobject::destroy(rl);
 }
 
+//-----------------------------------------------------------------------------
+IMPLEMENTATION [!kern_stats]:
+
+PRIVATE inline
+void
+Irq_sender::stat_hit()
+{}
+
+PRIVATE inline
+void
+Irq_sender::stat_delivered()
+{}
+
+//-----------------------------------------------------------------------------
+IMPLEMENTATION [kern_stats]:
+
+PRIVATE inline
+void
+Irq_sender::stat_hit()
+{ _hit = Kern_stat::stamp(); }
+
+PRIVATE inline
+void
+Irq_sender::stat_delivered()
+{
+  Kern_stat::inc(Kern_stat::Cnt_irq_delivered);
+  Kern_stat::record(Kern_stat::Hist_irq_delivery, _hit);
+}
+
+//-----------------------------------------------------------------------------
+IMPLEMENTATION:
+
 namespace {
 static Kobject_iface * FIASCO_FLATTEN
 irq_sender_factory(Ram_quota *q, Space *,
@@ -107,6 +107,9 @@ Jdb_object::sys_tbuf(L4_msg_tag tag, unsigned op,
 
         auto str = reinterpret_cast<char const *>(&r_msg->values[2]);
         Tb_entry_ke *tb = Jdb_tbuf::new_entry<Tb_entry_ke>();
+        if (!tb)
+          return commit_result(0);
+
         tb->set(curr, curr->user_ip());
 
         for (unsigned i = 0; i < length; ++i)
@@ -131,6 +134,9 @@ Jdb_object::sys_tbuf(L4_msg_tag tag, unsigned op,
 
         auto str = reinterpret_cast<char const *>(&r_msg->values[2]);
         Tb_entry_ke_bin *tb = Jdb_tbuf::new_entry<Tb_entry_ke_bin>();
+        if (!tb)
+          return commit_result(0);
+
         tb->set(curr, curr->user_ip());
 
         for (unsigned i = 0; i < length; ++i)
@@ -152,6 +158,9 @@ Jdb_object::sys_tbuf(L4_msg_tag tag, unsigned op,
         //              but we must not read above utcb
         // values[5] == string
         Tb_entry_ke_reg *tb = Jdb_tbuf::new_entry<Tb_entry_ke_reg>();
+        if (!tb)
+          return commit_result(0);
+
         tb->set(curr, curr->user_ip());
         tb->v[0] = access_once(&r_msg->values[1]);
         tb->v[1] = access_once(&r_msg->values[2]);
@@ -0,0 +1,319 @@
+INTERFACE:
+
+#include "types.h"
+
+/**
+ * Per-CPU kernel event counters and latency histograms.
+ *
+ * Unlike Kern_cnt, which keeps a few global counters in the trace-buffer
+ * status page, every CPU gets its own counters and histograms, so that
+ * updates never cross CPUs. Without CONFIG_KERN_STATS all updates compile
+ * to nothing. User space reads the statistics through the scheduler
+ * object, see Scheduler::sys_stats().
+ */
+class Kern_stat
+{
+public:
+  enum Counter
+  {
+    Cnt_context_switch,
+    Cnt_ipc_call,
+    Cnt_page_fault,
+    Cnt_irq_delivered,
+    Cnt_vm_exit,
+    Cnt_max
+  };
+
+  enum Histogram
+  {
+    Hist_ipc_call,     ///< IPC call, from send to reply
+    Hist_page_fault,   ///< user page fault, including the pager IPC
+    Hist_irq_delivery, ///< IRQ hit until delivery to the attached thread
+    Hist_vm_state,     ///< VMCS state transfer around one VM entry/exit
+    Hist_max
+  };
+
+  enum
+  {
+    /// Bucket i counts durations in [2^i, 2^(i+1)) clock ticks, bucket 0
+    /// also counts zero; the last bucket counts everything above.
+    Hist_buckets = 24,
+  };
+
+  typedef Unsigned64 Time;
+
+  /// Start of a sample: the clock value and the CPU it was read on.
+  struct Stamp
+  {
+    Time time = 0;
+    Cpu_number cpu = Cpu_number::nil();
+  };
+};
+
+// ------------------------------------------------------------------------
+INTERFACE [!kern_stats]:
+
+EXTENSION class Kern_stat
+{
+public:
+  /// Accounts its own lifetime in a histogram, if `on`.
+  struct Span
+  {
+    explicit Span(Histogram, bool = true) {}
+  };
+};
+
+// ------------------------------------------------------------------------
+INTERFACE [kern_stats]:
+
+#include "per_cpu_data.h"
+
+EXTENSION class Kern_stat
+{
+public:
+  /// Accounts its own lifetime in a histogram, if `on`.
+  struct Span
+  {
+    explicit Span(Histogram h, bool on = true)
+    : _h(h), _on(on)
+    {
+      if (on)
+        _start = stamp();
+    }
+
+    ~Span()
+    {
+      if (_on)
+        record(_h, _start);
+    }
+
+    Span(Span const &) = delete;
+    Span &operator = (Span const &) = delete;
+
+  private:
+    Histogram _h;
+    bool _on;
+    Stamp _start;
+  };
+
+private:
+  struct Cpu_stats
+  {
+    Mword cnt[Cnt_max] = {};
+    Mword hist_sum[Hist_max] = {};
+    Mword hist[Hist_max][Hist_buckets] = {};
+  };
+
+  static Per_cpu<Cpu_stats> _stats;
+};
+
+// ------------------------------------------------------------------------
+INTERFACE [kern_stats && !arm]:
+
+#include "clock.h"
+
+EXTENSION class Kern_stat
+{
+private:
+  static Per_cpu<Clock> _clock;
+};
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [!kern_stats]:
+
+#include "l4_types.h"
+
+PUBLIC static inline
+void
+Kern_stat::inc(Counter)
+{}
+
+PUBLIC static inline
+Kern_stat::Time
+Kern_stat::now()
+{ return 0; }
+
+PUBLIC static inline
+Kern_stat::Stamp
+Kern_stat::stamp()
+{ return Stamp(); }
+
+PUBLIC static inline
+void
+Kern_stat::record(Histogram, Stamp const &)
+{}
+
+PUBLIC static inline
+void
+Kern_stat::account(Histogram, Time)
+{}
+
+PUBLIC static inline
+int
+Kern_stat::read(Cpu_number, Mword, Mword *)
+{ return -L4_err::ENosys; }
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [kern_stats]:
+
+#include "l4_types.h"
+
+DEFINE_PER_CPU Per_cpu<Kern_stat::Cpu_stats> Kern_stat::_stats(Per_cpu_data::Cpu_num);
+
+PUBLIC static inline
+void
+Kern_stat::inc(Counter c)
+{ ++_stats.current().cnt[c]; }
+
+PUBLIC static inline NEEDS[Kern_stat::now, "context_base.h"]
+Kern_stat::Stamp
+Kern_stat::stamp()
+{
+  Stamp s;
+  s.time = now();
+  s.cpu = current_cpu();
+  return s;
+}
+
+/**
+ * Account the time since `start` in histogram `h` of the current CPU.
+ *
+ * Clocks of different CPUs are not comparable, so the sample is dropped
+ * if `start` was taken on another CPU, e.g. when the measured operation
+ * migrated or an IRQ was delivered on another CPU than it hit.
+ *
+ * \pre `start` was taken with stamp(), interrupts are off or the caller
+ *      does not care about losing a sample to preemption.
+ */
+PUBLIC static inline NEEDS[Kern_stat::account, Kern_stat::elapsed,
+                           "context_base.h"]
+void
+Kern_stat::record(Histogram h, Stamp const &start)
+{
+  if (start.cpu != current_cpu())
+    return;
+
+  account(h, elapsed(start.time));
+}
+
+/**
+ * Account a duration of `d` clock ticks in histogram `h` of the current
+ * CPU, for durations that are not a single contiguous interval.
+ */
+PUBLIC static inline
+void
+Kern_stat::account(Histogram h, Time d)
+{
+  Cpu_stats &s = _stats.current();
+  unsigned b = 0;
+  while (b < Hist_buckets - 1 && (d >> (b + 1)))
+    ++b;
+
+  ++s.hist[h][b];
+  s.hist_sum[h] += d;
+}
+
+/**
+ * Copy statistics of `cpu` to `buf`.
+ *
+ * \param sel  0 for the counters, followed by the clock ticks per
+ *             millisecond or 0 if the clock rate is unknown; 1 + h for histogram h, starting with the sum
+ *             of all samples in ticks, followed by the buckets.
+ *
+ * \return the number of words written, or a negative error code.
+ */
+PUBLIC static
+int
+Kern_stat::read(Cpu_number cpu, Mword sel, Mword *buf)
+{
+  Cpu_stats const &s = _stats.cpu(cpu);
+
+  if (sel == 0)
+    {
+      for (unsigned i = 0; i < Cnt_max; ++i)
+        buf[i] = access_once(&s.cnt[i]);
+      buf[Cnt_max] = ticks_per_ms(cpu);
+      return Cnt_max + 1;
+    }
+
+  if (sel > Hist_max)
+    return -L4_err::EInval;
+
+  unsigned h = sel - 1;
+  buf[0] = access_once(&s.hist_sum[h]);
+  for (unsigned i = 0; i < Hist_buckets; ++i)
+    buf[i + 1] = access_once(&s.hist[h][i]);
+  return Hist_buckets + 1;
+}
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [kern_stats && !arm]:
+
+DEFINE_PER_CPU Per_cpu<Clock> Kern_stat::_clock(Per_cpu_data::Cpu_num);
+
+PUBLIC static inline
+Kern_stat::Time
+Kern_stat::now()
+{ return _clock.current().read(); }
+
+PRIVATE static inline NEEDS[Kern_stat::now]
+Kern_stat::Time
+Kern_stat::elapsed(Time start)
+{ return now() - start; }
+
+PRIVATE static
+Mword
+Kern_stat::ticks_per_ms(Cpu_number cpu)
+{ return 1000000000 / (_clock.cpu(cpu).us(1000000) ?: 1); }
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [kern_stats && arm && arm_generic_timer]:
+
+// The KIP clock only advances with the tick of the boot CPU, use the
+// generic timer counter, which is synchronized across all CPUs.
+
+#include "generic_timer.h"
+
+PUBLIC static inline NEEDS["generic_timer.h"]
+Kern_stat::Time
+Kern_stat::now()
+{ return Generic_timer::Gtimer::counter(); }
+
+PRIVATE static inline NEEDS[Kern_stat::now]
+Kern_stat::Time
+Kern_stat::elapsed(Time start)
+{ return now() - start; }
+
+PRIVATE static inline NEEDS["generic_timer.h"]
+Mword
+Kern_stat::ticks_per_ms(Cpu_number)
+{ return Generic_timer::Gtimer::frequency() / 1000; }
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [kern_stats && arm && !arm_generic_timer]:
+
+// Without a generic timer use the cycle counter of the performance
+// monitor (Perf_cnt::init() installs it), it counts at the CPU clock
+// whose rate the kernel does not know. Without perf_cnt all samples are
+// zero.
+
+#include "tb_entry.h"
+
+PUBLIC static inline NEEDS["tb_entry.h"]
+Kern_stat::Time
+Kern_stat::now()
+{ return Tb_entry::read_cycle_counter(); }
+
+/**
+ * The ARMv7 cycle counter has only 32 bits, take the difference modulo
+ * 2^32.
+ */
+PRIVATE static inline NEEDS[Kern_stat::now]
+Kern_stat::Time
+Kern_stat::elapsed(Time start)
+{ return Unsigned32(now() - start); }
+
+PRIVATE static inline
+Mword
+Kern_stat::ticks_per_ms(Cpu_number)
+{ return 0; }
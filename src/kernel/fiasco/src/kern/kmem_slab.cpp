@@ -21,6 +21,66 @@ class Kmem_slab : public Slab_cache, public cxx::S_list_item
 };
 
 
+//----------------------------------------------------------------------------
+INTERFACE [mp]:
+
+/*
+ * Per-CPU magazine layer on top of the shared slab.
+ *
+ * Each CPU owns a loaded and a previous magazine, small stacks of free
+ * objects that are only touched with the CPU lock held. Full and empty
+ * magazines are exchanged as a whole with a per-cache depot, so the shared
+ * slab and the depot lock are only hit once per Mag_rounds operations.
+ * The shared slab and the depot have locks of their own, so they are used
+ * with or without the CPU lock held, as the caller of alloc() or free()
+ * holds it. A CPU gets its magazines when it first uses the cache.
+ *
+ * The reaper hands the magazines of its own CPU to the depot and frees
+ * the depot. Other CPUs hand their magazines to the depot on their next
+ * use of the cache, for the next reap.
+ */
+EXTENSION class Kmem_slab
+{
+private:
+  enum { Mag_rounds = 15 };
+
+  struct Magazine : cxx::S_list_item
+  {
+    unsigned rounds;
+    void *objs[Mag_rounds];
+  };
+
+  typedef cxx::S_list<Magazine> Mag_list;
+
+  struct Cpu_cache
+  {
+    Magazine *loaded;
+    Magazine *prev;
+    Mword flush_gen; ///< _flush_gen when the magazines were last flushed
+    Mword hits;
+    Mword misses;
+  } __attribute__((aligned(64)));
+
+  Cpu_cache *_cpu_cache[Config::Max_num_cpus];
+
+  Spin_lock<> _depot_lock;
+  Mag_list _depot_full;
+  Mag_list _depot_empty;
+  unsigned _mag_rounds;
+  unsigned _obj_size;
+  Mword _depot_full_cnt;
+  Mword _depot_empty_cnt;
+  Mword _depot_gets;   ///< full magazines handed out by the depot
+  Mword _depot_puts;   ///< full magazines taken by the depot
+  Mword _flush_gen;    ///< incremented by the reaper to flush all CPUs
+
+  static Kmem_slab _mag_slab;
+  static Kmem_slab _cpu_cache_slab;
+};
+
+//----------------------------------------------------------------------------
+INTERFACE:
+
 /**
  * Slab allocator for the given size and alignment.
  * \tparam SIZE   Size of an object in bytes.
@@ -42,7 +102,7 @@ public:
   template<typename Q> static
   void q_free(Q *q, void *e) { _s.template q_free<Q>(q, e); }
 
-  static Slab_cache *slab() { return &_s; }
+  static Kmem_slab *slab() { return &_s; }
 
 protected:
   static Kmem_slab _s;
@@ -181,6 +241,7 @@ Kmem_slab::Kmem_slab(unsigned long slab_size,
 				   char const *name)
   : Slab_cache(slab_size, elem_size, alignment, name)
 {
+  init_magazines(elem_size);
   reap_list.add(this, mp_cas<cxx::S_list_item*>);
 }
 
@@ -194,12 +255,14 @@ Kmem_slab::Kmem_slab(unsigned elem_size,
                      unsigned long max_size = Buddy_alloc::Max_size)
   : Slab_cache(elem_size, alignment, name, min_size, max_size)
 {
+  init_magazines(elem_size);
   reap_list.add(this, mp_cas<cxx::S_list_item*>);
 }
 
 PUBLIC
 Kmem_slab::~Kmem_slab()
 {
+  flush_magazines();
   destroy();
 }
 
@@ -232,10 +295,12 @@ Kmem_slab::reap_all (bool desperate)
 {
   size_t freed = 0;
 
-  for (Reap_list::Const_iterator alloc = reap_list.begin();
+  for (Reap_list::Iterator alloc = reap_list.begin();
        alloc != reap_list.end(); ++alloc)
     {
       size_t got;
+      alloc->flush_cpu_caches();
+      alloc->drain_depot();
       do
 	{
 	  got = alloc->reap();
@@ -248,3 +313,441 @@ Kmem_slab::reap_all (bool desperate)
 }
 
 static Kmem_alloc_reaper kmem_slab_reaper(Kmem_slab::reap_all);
+
+//----------------------------------------------------------------------------
+IMPLEMENTATION [!mp]:
+
+PRIVATE inline
+void
+Kmem_slab::init_magazines(unsigned)
+{}
+
+PRIVATE inline
+void
+Kmem_slab::flush_magazines()
+{}
+
+PRIVATE inline
+void
+Kmem_slab::drain_depot()
+{}
+
+PRIVATE inline
+void
+Kmem_slab::flush_cpu_caches()
+{}
+
+//----------------------------------------------------------------------------
+IMPLEMENTATION [mp]:
+
+#include <new>
+#include "context_base.h"
+#include "cpu_lock.h"
+
+// Magazines and per-CPU caches are allocated from their own slabs, which
+// of course do not cache objects in magazines themselves.
+Kmem_slab Kmem_slab::_mag_slab(sizeof(Kmem_slab::Magazine), sizeof(Mword),
+                               "Kmem_slab magazine");
+Kmem_slab Kmem_slab::_cpu_cache_slab(sizeof(Kmem_slab::Cpu_cache),
+                                     __alignof(Kmem_slab::Cpu_cache),
+                                     "Kmem_slab CPU cache");
+
+PRIVATE
+void
+Kmem_slab::init_magazines(unsigned elem_size)
+{
+  _depot_lock.init();
+  _obj_size = elem_size;
+  _mag_rounds = (this == &_mag_slab || this == &_cpu_cache_slab)
+                ? 0 : (unsigned)Mag_rounds;
+  for (auto &c: _cpu_cache)
+    c = 0;
+  _depot_full_cnt = _depot_empty_cnt = 0;
+  _depot_gets = _depot_puts = 0;
+  _flush_gen = 0;
+}
+
+PRIVATE inline
+Kmem_slab::Cpu_cache *
+Kmem_slab::cpu_cache()
+{
+  assert (cpu_lock.test());
+  return _cpu_cache[cxx::int_value<Cpu_number>(current_cpu())];
+}
+
+/**
+ * Allocate the magazines of the current CPU, which uses this cache for the
+ * first time.
+ */
+PRIVATE
+void
+Kmem_slab::alloc_cpu_cache()
+{
+  void *b = _cpu_cache_slab.Slab_cache::alloc();
+  if (EXPECT_FALSE(!b))
+    return;
+
+  Cpu_cache *n = new (b) Cpu_cache();
+  n->flush_gen = access_once(&_flush_gen);
+    {
+      auto g = lock_guard(cpu_lock);
+      Cpu_cache *&c = _cpu_cache[cxx::int_value<Cpu_number>(current_cpu())];
+      if (!c)
+        {
+          c = n;
+          return;
+        }
+    }
+
+  // migrated to a CPU that got its magazines meanwhile
+  _cpu_cache_slab.Slab_cache::free(n);
+}
+
+/**
+ * Get a full magazine from the depot in exchange for an empty one.
+ * \return the full magazine, or 0 if the depot has none.
+ */
+PRIVATE
+Kmem_slab::Magazine *
+Kmem_slab::depot_get_full(Magazine *empty)
+{
+  auto g = lock_guard(_depot_lock);
+  Magazine *m = _depot_full.pop_front();
+  if (!m)
+    return 0;
+
+  --_depot_full_cnt;
+  ++_depot_gets;
+  if (empty)
+    {
+      _depot_empty.push_front(empty);
+      ++_depot_empty_cnt;
+    }
+  return m;
+}
+
+/**
+ * Get an empty magazine from the depot in exchange for a full one.
+ * \return the empty magazine, or 0 if the depot has none.
+ */
+PRIVATE
+Kmem_slab::Magazine *
+Kmem_slab::depot_get_empty(Magazine *full)
+{
+  auto g = lock_guard(_depot_lock);
+  Magazine *m = _depot_empty.pop_front();
+  if (!m)
+    return 0;
+
+  --_depot_empty_cnt;
+  if (full)
+    {
+      _depot_full.push_front(full);
+      ++_depot_full_cnt;
+      ++_depot_puts;
+    }
+  return m;
+}
+
+/// Allocate a new empty magazine into the depot.
+PRIVATE
+void
+Kmem_slab::depot_add_empty()
+{
+  void *b = _mag_slab.Slab_cache::alloc();
+  if (EXPECT_FALSE(!b))
+    return;
+
+  auto g = lock_guard(_depot_lock);
+  _depot_empty.push_front(new (b) Magazine());
+  ++_depot_empty_cnt;
+}
+
+PRIVATE inline
+void
+Kmem_slab::free_magazine(Magazine *m)
+{
+  for (unsigned i = 0; i < m->rounds; ++i)
+    Slab_cache::free(m->objs[i]);
+  _mag_slab.Slab_cache::free(m);
+}
+
+/**
+ * Hand both magazines of a CPU to the depot, after the reaper asked for
+ * it.
+ * \pre cpu_lock must be held.
+ */
+PRIVATE
+void
+Kmem_slab::cpu_cache_to_depot(Cpu_cache *c)
+{
+  Magazine *mags[2] = { c->loaded, c->prev };
+  c->loaded = c->prev = 0;
+  c->flush_gen = access_once(&_flush_gen);
+
+  auto g = lock_guard(_depot_lock);
+  for (Magazine *m: mags)
+    {
+      if (!m)
+        continue;
+
+      if (m->rounds)
+        {
+          _depot_full.push_front(m);
+          ++_depot_full_cnt;
+        }
+      else
+        {
+          _depot_empty.push_front(m);
+          ++_depot_empty_cnt;
+        }
+    }
+}
+
+/**
+ * Get the magazines of the current CPU, flushed to the depot first if the
+ * reaper asked for it.
+ * \pre cpu_lock must be held.
+ */
+PRIVATE inline
+Kmem_slab::Cpu_cache *
+Kmem_slab::cpu_cache_checked()
+{
+  Cpu_cache *c = cpu_cache();
+  if (EXPECT_TRUE(c != 0)
+      && EXPECT_FALSE(c->flush_gen != access_once(&_flush_gen)))
+    cpu_cache_to_depot(c);
+  return c;
+}
+
+/**
+ * Ask all CPUs to flush their magazines to the depot, the current CPU
+ * does so right away.
+ */
+PRIVATE
+void
+Kmem_slab::flush_cpu_caches()
+{
+  if (!_mag_rounds)
+    return;
+
+  atomic_mp_add(&_flush_gen, 1);
+
+  auto g = lock_guard(cpu_lock);
+  (void)cpu_cache_checked();
+}
+
+PRIVATE static inline
+void
+Kmem_slab::swap_magazines(Cpu_cache *c)
+{
+  Magazine *m = c->loaded;
+  c->loaded = c->prev;
+  c->prev = m;
+}
+
+/**
+ * Take an object from the magazines of a CPU.
+ * \return the object, or 0 if neither the CPU nor the depot has one.
+ * \pre cpu_lock must be held.
+ */
+PRIVATE
+void *
+Kmem_slab::mag_alloc(Cpu_cache *c)
+{
+  for (;;)
+    {
+      if (c->loaded && c->loaded->rounds)
+        {
+          ++c->hits;
+          return c->loaded->objs[--c->loaded->rounds];
+        }
+
+      if (c->prev && c->prev->rounds)
+        {
+          swap_magazines(c);
+          continue;
+        }
+
+      Magazine *full = depot_get_full(c->prev);
+      if (!full)
+        break;
+
+      c->prev = c->loaded;
+      c->loaded = full;
+    }
+
+  ++c->misses;
+  return 0;
+}
+
+/**
+ * Put an object into the magazines of a CPU.
+ * \return false if the CPU has no room and the depot no empty magazine.
+ * \pre cpu_lock must be held.
+ */
+PRIVATE
+bool
+Kmem_slab::mag_free(Cpu_cache *c, void *e)
+{
+  for (;;)
+    {
+      if (c->loaded && c->loaded->rounds < _mag_rounds)
+        {
+          c->loaded->objs[c->loaded->rounds++] = e;
+          return true;
+        }
+
+      if (c->prev && c->prev->rounds < _mag_rounds)
+        {
+          swap_magazines(c);
+          continue;
+        }
+
+      Magazine *empty = depot_get_empty(c->prev);
+      if (!empty)
+        return false;
+
+      c->prev = c->loaded;
+      c->loaded = empty;
+    }
+}
+
+/**
+ * Allocate an object from the current CPU's magazines.
+ *
+ * Exchanges an empty magazine for a full one from the depot if both local
+ * magazines are empty and falls back to the shared slab if the depot has
+ * no full magazine either.
+ */
+PUBLIC
+void *
+Kmem_slab::alloc()
+{
+  if (EXPECT_FALSE(!_mag_rounds))
+    return Slab_cache::alloc();
+
+  Cpu_cache *c;
+    {
+      auto g = lock_guard(cpu_lock);
+      c = cpu_cache_checked();
+      if (EXPECT_TRUE(c != 0))
+        if (void *e = mag_alloc(c))
+          return e;
+    }
+
+  if (EXPECT_FALSE(!c))
+    alloc_cpu_cache();
+
+  return Slab_cache::alloc();
+}
+
+/**
+ * Free an object into the current CPU's magazines.
+ *
+ * If both local magazines are full, the previous one goes to the depot in
+ * exchange for an empty magazine, which is allocated if the depot has none.
+ * Only if no empty magazine can be had the object goes back to the shared
+ * slab.
+ */
+PUBLIC
+void
+Kmem_slab::free(void *e)
+{
+  if (EXPECT_FALSE(!_mag_rounds))
+    {
+      Slab_cache::free(e);
+      return;
+    }
+
+  for (unsigned tries = 0; tries < 2; ++tries)
+    {
+      Cpu_cache *c;
+        {
+          auto g = lock_guard(cpu_lock);
+          c = cpu_cache_checked();
+          if (EXPECT_TRUE(c != 0) && mag_free(c, e))
+            return;
+        }
+
+      // get what was missing with the CPU lock released and retry
+      if (!c)
+        alloc_cpu_cache();
+      else
+        depot_add_empty();
+    }
+
+  Slab_cache::free(e);
+}
+
+PUBLIC template<typename Q> inline
+void *
+Kmem_slab::q_alloc(Q *quota)
+{
+  Auto_quota<Q> q(quota, _obj_size);
+  if (EXPECT_FALSE(!q))
+    return 0;
+
+  void *r;
+  if (EXPECT_FALSE(!(r = alloc())))
+    return 0;
+
+  q.release();
+  return r;
+}
+
+PUBLIC template<typename Q> inline
+void
+Kmem_slab::q_free(Q *quota, void *e)
+{
+  free(e);
+  quota->free(_obj_size);
+}
+
+/**
+ * Give all magazines in the depot back to the shared slab, so that the
+ * reaper can free their objects' slabs.
+ */
+PRIVATE
+void
+Kmem_slab::drain_depot()
+{
+  for (;;)
+    {
+      Magazine *m;
+        {
+          auto g = lock_guard(_depot_lock);
+          m = _depot_full.pop_front();
+          if (m)
+            --_depot_full_cnt;
+          else if ((m = _depot_empty.pop_front()))
+            --_depot_empty_cnt;
+          else
+            return;
+        }
+      free_magazine(m);
+    }
+}
+
+/**
+ * Free all cached objects, including the per-CPU magazines.
+ * \pre No concurrent users of this slab.
+ */
+PRIVATE
+void
+Kmem_slab::flush_magazines()
+{
+  for (auto &c: _cpu_cache)
+    {
+      if (!c)
+        continue;
+
+      if (c->loaded)
+        free_magazine(c->loaded);
+      if (c->prev)
+        free_magazine(c->prev);
+      _cpu_cache_slab.Slab_cache::free(c);
+      c = 0;
+    }
+  drain_depot();
+}
@@ -81,8 +81,14 @@ public:
       if (EXPECT_TRUE(empty()))
         return;
 
+      long objs = 0;
+      for (Kobject *o = _h; o; o = o->_next_to_reap)
+        ++objs;
+
       del_1();
-      current()->rcu_wait();
+      Rcu::account_pending(objs);
+      current()->rcu_wait(true);
+      Rcu::account_pending(-objs);
       del_2();
     }
   };
@@ -0,0 +1,339 @@
+INTERFACE:
+
+#include "l4_types.h"
+#include "types.h"
+
+class Thread;
+
+/**
+ * Opt-in balancer that moves busy threads from overloaded CPUs to idle
+ * ones.
+ *
+ * Once enabled, every CPU samples its load once per period: the average
+ * number of ready threads in its ready queue and the idle time of its
+ * kernel thread, the same time the scheduler object reports for
+ * Idle_time. A CPU that did not idle during the last period and has
+ * threads waiting for it pushes the thread it interrupts to the CPU that
+ * idled most, if that CPU idled for at least a quarter of the period.
+ *
+ * Only threads placed with Scheduler::sys_run() on more than one CPU are
+ * moved, only within those CPUs, and never while they are pinned. Every
+ * CPU moves at most one thread per period and every CPU accepts at most
+ * one thread per period, so the balancer never moves threads back and
+ * forth faster than the load samples follow.
+ */
+class Load_balancer
+{
+public:
+  enum Op
+  {
+    Op_enable  = 0,
+    Op_disable = 1,
+    Op_stats   = 2,
+    Op_pin     = 3,
+  };
+
+  enum
+  {
+    Min_period = 1000, ///< minimum balancing period in microseconds
+    Load_unit  = 256,  ///< fixed-point one of the ready-queue load
+  };
+};
+
+// ------------------------------------------------------------------------
+INTERFACE [mp]:
+
+#include "context.h"
+#include "cpu_mask.h"
+#include "per_cpu_data.h"
+#include "timeout.h"
+
+class Load_balancer_timeout : public Timeout
+{
+};
+
+EXTENSION class Load_balancer
+{
+private:
+  struct Cpu_state
+  {
+    Cpu_state() { mig.in_progress = true; }
+
+    Load_balancer_timeout timeout;
+    Context::Migration mig;  ///< not in progress while a push is pending
+    Thread *push = 0;        ///< thread tick() decided to push away
+    Cpu_time idle_stamp = 0; ///< idle time of the kernel thread at the tick
+    Mword idle = 0;          ///< idle time during the last period
+    Mword load = 0;          ///< average number of ready threads
+    Mword claim = 0;         ///< a thread is pushed to this CPU
+    Mword pushed = 0;        ///< threads moved away from this CPU
+    Mword pulled = 0;        ///< threads moved to this CPU
+  };
+
+  static Mword _period;
+  static Per_cpu<Cpu_state> _cpu;
+};
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [!mp]:
+
+PUBLIC static inline
+int
+Load_balancer::enable(Mword)
+{ return -L4_err::ENosys; }
+
+PUBLIC static inline
+int
+Load_balancer::disable()
+{ return -L4_err::ENosys; }
+
+PUBLIC static inline
+int
+Load_balancer::read(Cpu_number, Mword *)
+{ return -L4_err::ENosys; }
+
+PUBLIC static inline
+int
+Load_balancer::pin(Thread *, bool)
+{ return -L4_err::ENosys; }
+
+PUBLIC static inline
+void
+Load_balancer::place(Thread *, L4_cpu_set const &)
+{}
+
+PUBLIC static inline
+bool
+Load_balancer::push()
+{ return false; }
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [mp]:
+
+#include "atomic.h"
+#include "cpu.h"
+#include "cpu_call.h"
+#include "cpu_lock.h"
+#include "globals.h"
+#include "lock_guard.h"
+#include "mem.h"
+#include "minmax.h"
+#include "sched_context.h"
+#include "thread.h"
+#include "timer.h"
+
+Mword Load_balancer::_period;
+DEFINE_PER_CPU Per_cpu<Load_balancer::Cpu_state> Load_balancer::_cpu;
+
+PRIVATE
+bool
+Load_balancer_timeout::expired()
+{ return Load_balancer::tick(); }
+
+/**
+ * Start balancing every `period` microseconds on all online CPUs.
+ *
+ * CPUs that come online later are not balanced until the balancer is
+ * enabled again.
+ */
+PUBLIC static
+int
+Load_balancer::enable(Mword period)
+{
+  if (period < Min_period)
+    return -L4_err::EInval;
+
+  write_now(&_period, period);
+  Mem::mp_wmb();
+
+  auto guard = lock_guard<Lock_guard_inverse_policy>(cpu_lock);
+  Cpu_call::cpu_call_many(Cpu::online_mask(), [period](Cpu_number cpu)
+    {
+      Cpu_state &s = _cpu.current();
+      if (!s.timeout.is_set())
+        {
+          s.idle_stamp = Context::kernel_context(cpu)->consumed_time();
+          s.timeout.set(Timer::system_clock() + period, cpu);
+        }
+      return false;
+    });
+
+  return 0;
+}
+
+/// Stop balancing, the timeouts are not set again when they expire.
+PUBLIC static
+int
+Load_balancer::disable()
+{
+  write_now(&_period, 0UL);
+  return 0;
+}
+
+/**
+ * Copy the statistics of `cpu` to `buf`: the threads pushed away from and
+ * pulled to `cpu`, the average number of ready threads in Load_unit and
+ * the idle time in the last period in microseconds.
+ *
+ * \return the number of words written.
+ */
+PUBLIC static
+int
+Load_balancer::read(Cpu_number cpu, Mword *buf)
+{
+  Cpu_state const &s = _cpu.cpu(cpu);
+  buf[0] = access_once(&s.pushed);
+  buf[1] = access_once(&s.pulled);
+  buf[2] = access_once(&s.load);
+  buf[3] = access_once(&s.idle);
+  return 4;
+}
+
+/// Exclude `t` from balancing, or include it again.
+PUBLIC static
+int
+Load_balancer::pin(Thread *t, bool pinned)
+{
+  t->set_balance_pinned(pinned);
+  return 0;
+}
+
+/// Let the balancer move `t` within `cpus`.
+PUBLIC static inline NEEDS["thread.h"]
+void
+Load_balancer::place(Thread *t, L4_cpu_set const &cpus)
+{ t->set_balance_cpus(cpus); }
+
+/**
+ * Sample the load of the current CPU and choose the current thread for
+ * push() if the CPU is overloaded.
+ *
+ * This runs as timeout, where the current thread must not be migrated, so
+ * it only records the decision.
+ *
+ * \pre Interrupts are disabled.
+ * \return false, a tick never needs a reschedule.
+ */
+PUBLIC static
+bool
+Load_balancer::tick()
+{
+  Mword const period = access_once(&_period);
+  if (!period)
+    return false;
+
+  Cpu_number const cpu = current_cpu();
+  Cpu_state &s = _cpu.current();
+  s.timeout.set(Timer::system_clock() + period, cpu);
+
+  Cpu_time idle = Context::kernel_context(cpu)->consumed_time();
+  Mword idle_d = min<Cpu_time>(idle - s.idle_stamp, period);
+  s.idle_stamp = idle;
+
+  Mword nr = Sched_context::rq.current().nr_ready();
+  write_now(&s.idle, idle_d);
+  write_now(&s.load, (s.load * 3 + nr * Load_unit) / 4);
+  write_now(&s.claim, 0UL);
+
+  if (idle_d > period / 16 || s.load < 2 * Load_unit || nr < 2)
+    return false;
+
+  // the previous push is still under way
+  if (s.push || !access_once(&s.mig.in_progress))
+    return false;
+
+  Thread *t = current_thread();
+  if (t->balance_pinned() || t->balance_cpus().empty())
+    return false;
+
+  Cpu_number target = find_target(t->balance_cpus(), cpu, period);
+  if (target == Cpu::invalid())
+    return false;
+
+  s.mig.cpu = target;
+  s.mig.sp = 0;
+  s.push = t;
+  return false;
+}
+
+/**
+ * Push the thread chosen by tick() to the CPU it claimed.
+ *
+ * Called by the timer interrupt after all timeouts are handled, like the
+ * request IPI migrates the current thread only after its request queue.
+ *
+ * \pre Interrupts are disabled.
+ * \return true if a reschedule is necessary.
+ */
+PUBLIC static
+bool
+Load_balancer::push()
+{
+  Cpu_state &s = _cpu.current();
+  Thread *t = s.push;
+  if (EXPECT_TRUE(!t))
+    return false;
+
+  s.push = 0;
+  Cpu_number const target = s.mig.cpu;
+
+  // tick() chose the thread it interrupted, which is still current
+  if (EXPECT_TRUE(t == current()))
+    {
+      s.mig.in_progress = false;
+      Mem::mp_wmb();
+
+      bool resched = false;
+      if (t->balance_to(&s.mig, &resched))
+        {
+          ++s.pushed;
+          atomic_mp_add(&_cpu.cpu(target).pulled, 1);
+          return resched;
+        }
+
+      s.mig.in_progress = true;
+    }
+
+  write_now(&_cpu.cpu(target).claim, 0UL);
+  return false;
+}
+
+/**
+ * Find the CPU in `cpus` that idled most in the last period and claim it.
+ *
+ * \return the claimed CPU, or Cpu::invalid() if no CPU idled at least a
+ *         quarter of `period`.
+ */
+PRIVATE static
+Cpu_number
+Load_balancer::find_target(Cpu_mask const &cpus, Cpu_number self,
+                           Mword period)
+{
+  for (;;)
+    {
+      Cpu_number best = Cpu::invalid();
+      Mword best_idle = period / 4;
+
+      for (Cpu_number i = Cpu_number::first(); i < Config::max_num_cpus(); ++i)
+        {
+          if (i == self || !cpus.get(i) || !Cpu::online(i))
+            continue;
+
+          Cpu_state const &o = _cpu.cpu(i);
+          Mword idle = access_once(&o.idle);
+          if (access_once(&o.claim) || idle < best_idle
+              || access_once(&o.load) >= Load_unit)
+            continue;
+
+          best = i;
+          best_idle = idle;
+        }
+
+      if (best == Cpu::invalid())
+        return best;
+
+      // another CPU may have claimed it meanwhile, look again
+      if (mp_cas(&_cpu.cpu(best).claim, 0UL, 1UL))
+        return best;
+    }
+}
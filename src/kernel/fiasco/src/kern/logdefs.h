@@ -44,10 +44,12 @@
   BEGIN_LOG_EVENT(name, sc, fmt)                                        \
     if (cond)                                                           \
       {                                                                 \
-        fmt *l = Jdb_tbuf::new_entry<fmt>();                            \
-        l->set_global(__do_log__, ctx, Proc::program_counter());        \
-        {code;}                                                         \
-        Jdb_tbuf::commit_entry();                                       \
+        if (fmt *l = Jdb_tbuf::new_entry<fmt>())                        \
+          {                                                             \
+            l->set_global(__do_log__, ctx, Proc::program_counter());    \
+            {code;}                                                     \
+            Jdb_tbuf::commit_entry();                                   \
+          }                                                             \
       }                                                                 \
   END_LOG_EVENT
 
@@ -69,8 +71,7 @@
 #define LOG_TRAP                                                        \
   LOG_TRACE_COND("Exceptions", "exc", current(), Tb_entry_trap,         \
                  (!ts->exclude_logging()),                              \
-    l->set(ts->ip(), ts);                                               \
-    Jdb_tbuf::commit_entry() )
+    l->set(ts->ip(), ts) )
 
 #define LOG_TRAP_CN(curr, n)                                            \
   LOG_TRACE("Exceptions", "exc", curr, Tb_entry_trap,                   \
@@ -106,6 +107,8 @@
     /* The cpu_lock is needed since virq::hit() depends on it */        \
     auto guard = lock_guard(cpu_lock);                                  \
     Tb_entry_ke *tb = static_cast<Tb_entry_ke*>(Jdb_tbuf::new_entry()); \
+    if (!tb)                                                            \
+      break;                                                            \
     tb->set(context, Proc::program_counter());                          \
     tb->msg.set_const(text);                                            \
     Jdb_tbuf::commit_entry();                                           \
@@ -119,6 +122,8 @@
     /* The cpu_lock is needed since virq::hit() depends on it */        \
     auto guard = lock_guard(cpu_lock);                                  \
     Tb_entry_ke_reg *tb = Jdb_tbuf::new_entry<Tb_entry_ke_reg>();       \
+    if (!tb)                                                            \
+      break;                                                            \
     tb->set(context, Proc::program_counter());                          \
     tb->v[0] = v1; tb->v[1] = v2; tb->v[2] = v3;                        \
     tb->msg.set_const(text);                                            \
@@ -5,6 +5,7 @@ INTERFACE:
 #include "space.h"
 #include <cxx/function>
 #include "cpu_call.h"
+#include "per_cpu_data.h"
 
 class Mapdb;
 
@@ -16,27 +17,64 @@ struct Auto_tlb_flush
   void add_page(SPACE *, typename SPACE::V_pfn, typename SPACE::Page_order) {}
 };
 
+/**
+ * Collects the pages unmapped by one operation and invalidates their TLB
+ * entries when it goes out of scope.
+ *
+ * Up to N_pages regions, together no more than Max_page_flushes pages, are
+ * invalidated page by page; beyond that the ASIDs of up to N_spaces spaces
+ * are flushed, and beyond that the complete TLB. If the architecture
+ * broadcasts page invalidations in hardware, the page-by-page case needs
+ * no IPIs.
+ */
 template<>
 struct Auto_tlb_flush<Mem_space>
 {
-  enum { N_spaces = 4 };
+  enum
+  {
+    N_spaces = 4,
+    N_pages = 8,
+    Max_page_flushes = 32,
+  };
+
+  struct Page
+  {
+    Mem_space *space;
+    Mem_space::Vaddr virt;
+    Mem_space::Page_order order;
+  };
+
+  /// Flushes issued per granularity, per unmapping CPU.
+  struct Flush_stats
+  {
+    Mword pages;       ///< page-by-page, via IPIs
+    Mword pages_bcast; ///< page-by-page, broadcast by the hardware
+    Mword spaces;      ///< whole ASIDs
+    Mword all;         ///< complete TLB
+  };
+
   bool all;
   bool empty;
+  bool by_space;
+  unsigned n_pages;
+  unsigned n_page_flushes;
 
   Mem_space *spaces[N_spaces];
-  Auto_tlb_flush() : all(false), empty(true)
+  Page pages[N_pages];
+
+  /// Shootdowns and the IPIs they needed, per unmapping CPU.
+  static Per_cpu<Cpu_call::Mcast_stats> stats;
+  static Per_cpu<Flush_stats> flush_stats;
+
+  Auto_tlb_flush()
+  : all(false), empty(true), by_space(false), n_pages(0), n_page_flushes(0)
   {
     for (unsigned i = 0; i < N_spaces; ++i)
       spaces[i] = 0;
   }
 
-  void add_page(Mem_space *space, Mem_space::V_pfn, Mem_space::Page_order)
+  void add_space(Mem_space *space)
   {
-    if (all)
-      return;
-
-    empty = false;
-
     for (unsigned i = 0; i < N_spaces; ++i)
       {
         if (spaces[i] == 0)
@@ -53,6 +91,40 @@ struct Auto_tlb_flush<Mem_space>
     all = true;
   }
 
+  void add_page(Mem_space *space, Mem_space::V_pfn virt,
+                Mem_space::Page_order order)
+  {
+    if (all)
+      return;
+
+    empty = false;
+    add_space(space);
+
+    if (by_space)
+      return;
+
+    unsigned shift = cxx::int_value<Mem_space::Page_order>(order)
+                     - Config::PAGE_SHIFT;
+    if (n_pages == N_pages || shift >= 16
+        || n_page_flushes + (1U << shift) > Max_page_flushes)
+      {
+        by_space = true;
+        return;
+      }
+
+    n_page_flushes += 1U << shift;
+    pages[n_pages].space = space;
+    pages[n_pages].virt = virt;
+    pages[n_pages].order = order;
+    ++n_pages;
+  }
+
+  void flush_pages()
+  {
+    for (unsigned i = 0; i < n_pages; ++i)
+      pages[i].space->tlb_flush_page(pages[i].virt, pages[i].order);
+  }
+
   void do_flush()
   {
     if (all)
@@ -62,6 +134,12 @@ struct Auto_tlb_flush<Mem_space>
         return;
       }
 
+    if (!by_space)
+      {
+        flush_pages();
+        return;
+      }
+
     for (unsigned i = 0; i < N_spaces && spaces[i]; ++i)
       spaces[i]->tlb_flush(true);
   }
@@ -71,10 +149,26 @@ struct Auto_tlb_flush<Mem_space>
     if (empty)
       return;
 
-    Cpu_call::cpu_call_many(Mem_space::active_tlb(), [this](Cpu_number) {
+    Flush_stats &fs = flush_stats.current();
+    if (all)
+      ++fs.all;
+    else if (by_space)
+      ++fs.spaces;
+    else if (Mem_space::tlb_page_flush_broadcast())
+      {
+        // the invalidations reach all CPUs without IPIs
+        ++fs.pages_bcast;
+        flush_pages();
+        return;
+      }
+    else
+      ++fs.pages;
+
+    // all spaces touched by this unmap are flushed by a single multicast
+    Cpu_call::cpu_call_mcast(Mem_space::active_tlb(), [this](Cpu_number) {
       this->do_flush();
       return false;
-    });
+    }, &stats.current());
   }
 
   ~Auto_tlb_flush() { global_flush(); }
@@ -179,6 +273,10 @@ IMPLEMENTATION:
 #include "paging.h"
 #include "warn.h"
 
+DEFINE_PER_CPU Per_cpu<Cpu_call::Mcast_stats> Mu::Auto_tlb_flush<Mem_space>::stats;
+DEFINE_PER_CPU Per_cpu<Mu::Auto_tlb_flush<Mem_space>::Flush_stats>
+  Mu::Auto_tlb_flush<Mem_space>::flush_stats;
+
 
 IMPLEMENT template<typename SPACE>
 inline
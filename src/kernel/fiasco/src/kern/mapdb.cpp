@@ -8,6 +8,7 @@ INTERFACE:
 #include "auto_quota.h"
 
 struct Mapping_tree;		// forward decls
+class Kmem_slab;
 class Physframe;
 class Treemap;
 class Space;
@@ -488,7 +489,7 @@ Treemap::~Treemap()
 static Kmem_slab_t<Treemap> _treemap_allocator("Treemap");
 
 static
-Slab_cache *
+Kmem_slab *
 Treemap::allocator()
 { return _treemap_allocator.slab(); }
 
@@ -615,7 +616,15 @@ Treemap::lookup(Pcnt key, Space *search_space, Pfn search_va,
   assert (t->mappings()[0].space() == _owner_id);
   assert (vaddr(t->mappings()) == cxx::mask_lsb(key, psz) + _page_offset);
 
-  Mapping *m;
+  Mapping *m = t->index_lookup(search_space, trunc_to_page(search_va));
+  if (m)
+    {
+      *out_mapping = m;
+      *out_treemap = this;
+      *out_frame = f;
+      return true;		// found! -- return locked
+    }
+
   bool ret = false;
 
   for (m = t->mappings(); m; m = t->next (m))
@@ -632,6 +641,7 @@ Treemap::lookup(Pcnt key, Space *search_space, Pfn search_va,
       else if (m->space() == search_space
 	       && vaddr(m) == cxx::mask_lsb(search_va, psz))
 	{
+	  t->index_add(m);
 	  *out_mapping = m;
 	  *out_treemap = this;
 	  *out_frame = f;
@@ -677,6 +687,7 @@ Treemap::insert(Physframe* frame, Mapping* parent, Space *space,
 	{
 	  free->set_space(space);
 	  set_vaddr(free, va);
+	  t->index_add(free);
 
 	  t->check_integrity(_owner_id);
 	  return free;
@@ -102,6 +102,14 @@ class Simple_tree_submap_ops
  * internal tree representation).  (XXX: Implementing one of these
  * ideas is probably worthwile doing!)
 
+ * Large trees (Index_min_size_id and up) carry a hint index behind the
+ * mapping array: a table of array offsets hashed by (Space, page) that
+ * lets lookup() find a mapping without scanning the tree.  Each hint is
+ * validated against the mapping it points to, so stale hints (left behind
+ * by moving, granting, or freeing mappings) only cost a fallback to the
+ * linear scan, which refreshes the hint.  The index is rebuilt whenever
+ * the tree is copied or compacted.
+
  * Instead of copying whole trees around when they grow or shrink a
  * lot, or copying parts of trees when inserting an element, we could
  * give up the array representation and add a "next" pointer to the
@@ -122,6 +130,7 @@ struct Mapping_tree
   typedef Mapping::Page Page;
   typedef Mapping::Pfn Pfn;
   typedef Mapping::Pcnt Pcnt;
+  typedef Unsigned16 Index_slot; ///< array offset + 1, 0 means empty
 
   enum Size_id
   {
@@ -151,6 +160,7 @@ struct Mapping_tree
   typedef Mapping::Page Page;
   typedef Mapping::Pfn Pfn;
   typedef Mapping::Pcnt Pcnt;
+  typedef Unsigned16 Index_slot; ///< array offset + 1, 0 means empty
 
   enum Size_id
   {
@@ -239,7 +249,8 @@ Simple_tree_submap_ops::flush(Treemap *, Page_number, Page_number) const
 enum Mapping_tree_size
 {
   Size_factor = 4,
-  Size_id_max = 9		// can be up to 15 (4 bits)
+  Size_id_max = 9,		// can be up to 15 (4 bits)
+  Index_min_size_id = 4		// trees of 64 entries and up get an index
 };
 
 PUBLIC inline
@@ -267,6 +278,9 @@ struct Mapping_tree_allocator
     Elem_size = (Size_factor << SIZE_ID) * sizeof (Mapping)
                 + ((sizeof(Mapping_tree) + Mapping::Alignment - 1)
                    & ~((unsigned long)Mapping::Alignment - 1))
+                + (SIZE_ID >= Index_min_size_id
+                   ? (Size_factor << SIZE_ID) * sizeof(Mapping_tree::Index_slot)
+                   : 0)
   };
 
   Mapping_tree_allocator(Kmem_slab **array)
@@ -355,6 +369,9 @@ Mapping_tree::Mapping_tree(Size_id size_id, Page page,
   // We also always set the end tag on last entry so that we can
   // check whether it has been overwritten.
   last()->set_depth(Mapping::Depth_end);
+
+  index_clear();
+  index_add(_mappings);
 }
 
 PUBLIC
@@ -413,6 +430,115 @@ Mapping_tree::last()
   return end() - 1;
 }
 
+//
+// Hint index for large trees
+//
+
+PUBLIC inline NEEDS[Mapping_tree_size]
+bool
+Mapping_tree::has_index() const
+{ return _size_id >= Index_min_size_id; }
+
+/// The index slots follow the mapping array, one slot per array entry.
+PRIVATE inline NEEDS[Mapping_tree::end]
+Mapping_tree::Index_slot *
+Mapping_tree::index_slots()
+{ return reinterpret_cast<Index_slot *>(end()); }
+
+PRIVATE inline NEEDS[Mapping_tree::number_of_entries]
+unsigned
+Mapping_tree::index_hash(Space *space, Page page) const
+{
+  Mword h = (reinterpret_cast<Mword>(space) >> 4)
+            ^ (cxx::int_value<Page>(page) * 0x9e3779b1UL);
+  return (h ^ (h >> 16)) & (number_of_entries() - 1);
+}
+
+PRIVATE inline NEEDS[Mapping_tree::has_index, Mapping_tree::index_slots,
+                     Mapping_tree::number_of_entries, <cstring>]
+void
+Mapping_tree::index_clear()
+{
+  if (has_index())
+    memset(index_slots(), 0, number_of_entries() * sizeof(Index_slot));
+}
+
+/**
+ * The mapping an index slot points to.
+ * \return the mapping, or 0 if the slot is empty or stale, i.e., points to
+ *         a free entry or a submap.
+ *
+ * Slots never point behind the end tag: the index is rebuilt whenever the
+ * tree is compacted, and all other operations leave only free entries
+ * behind the end tag.
+ */
+PRIVATE inline NEEDS[Mapping_tree::mappings, Mapping_tree::number_of_entries]
+Mapping *
+Mapping_tree::index_entry(Index_slot o)
+{
+  if (!o || o > number_of_entries())
+    return 0;
+
+  Mapping *m = mappings() + o - 1;
+  if (m->unused() || m->submap())
+    return 0;
+
+  return m;
+}
+
+/**
+ * Record the position of a new or moved mapping in the index.
+ *
+ * Each key has two candidate slots.  The first one is used unless it holds
+ * a valid hint for a different mapping, in which case the second one is
+ * overwritten.
+ */
+PUBLIC inline NEEDS[Mapping_tree::has_index, Mapping_tree::index_slots,
+                    Mapping_tree::index_hash, Mapping_tree::index_entry]
+void
+Mapping_tree::index_add(Mapping *m)
+{
+  if (!has_index() || m->unused() || m->submap())
+    return;
+
+  Index_slot *slots = index_slots();
+  Space *space = m->space();
+  Page page = m->page();
+  unsigned h = index_hash(space, page);
+
+  Mapping *other = index_entry(slots[h]);
+  if (other && other != m
+      && (other->space() != space || other->page() != page))
+    h ^= 1;
+
+  slots[h] = (m - mappings()) + 1;
+}
+
+/**
+ * Find a mapping using the hint index.
+ * \return the mapping of `space` at `page`, or 0 if the tree has no index
+ *         or the index has no valid hint for it.
+ */
+PUBLIC inline NEEDS[Mapping_tree::has_index, Mapping_tree::index_slots,
+                    Mapping_tree::index_hash, Mapping_tree::index_entry]
+Mapping *
+Mapping_tree::index_lookup(Space *space, Page page)
+{
+  if (!has_index())
+    return 0;
+
+  Index_slot *slots = index_slots();
+  unsigned h = index_hash(space, page);
+  for (unsigned i = 0; i < 2; ++i, h ^= 1)
+    {
+      Mapping *m = index_entry(slots[h]);
+      if (m && m->space() == space && m->page() == page)
+        return m;
+    }
+
+  return 0;
+}
+
 // A utility function to find the tree header belonging to a mapping. 
 
 /** Our Mapping_tree.
@@ -506,13 +632,17 @@ Mapping_tree::copy_compact_tree(Mapping_tree *dst, Mapping_tree *src)
   dst->_empty_count = 0;
 #endif
 
+  // entries move, so rebuild the index from scratch
+  dst->index_clear();
+
   Mapping *d = dst->mappings();
 
   for (Mapping *s = src->mappings();
        s && !s->is_end_tag();
        s = src->next(s))
     {
-      *d++ = *s;
+      *d = *s;
+      dst->index_add(d++);
       dst->_count += 1;
     }
 
@@ -686,6 +816,7 @@ Mapping_tree::allocate(Ram_quota *payer, Mapping *parent,
       while (free + 1 != insert)
         {
           *free = *(free + 1);
+          index_add(free);
           free++;
         }
 
@@ -723,6 +854,7 @@ Mapping_tree::allocate(Ram_quota *payer, Mapping *parent,
       while (insert > free)
         {
           *insert = *(insert - 1);
+          index_add(insert);
           --insert;
         }
     }
@@ -854,6 +986,7 @@ Mapping_tree::grant(Mapping* m, Space *new_space, Page page,
 
   m->set_space(new_space);
   m->set_page(page);
+  index_add(m);
 
   if (submap)
     submap_ops.grant(submap, new_space, page);
@@ -862,18 +995,22 @@ Mapping_tree::grant(Mapping* m, Space *new_space, Page page,
   return true;
 }
 
-PUBLIC inline
+PUBLIC inline NEEDS[Mapping_tree::index_lookup, Mapping_tree::index_add]
 Mapping *
 Mapping_tree::lookup(Space *space, Page page)
 {
-
-  Mapping *m;
+  Mapping *m = index_lookup(space, page);
+  if (m)
+    return m;
 
   for (m = mappings(); m; m = next(m))
     {
       assert (!m->submap());
       if (m->space() == space && m->page() == page)
-        return m;
+        {
+          index_add(m);
+          return m;
+        }
     }
 
   return 0;
@@ -926,6 +1063,7 @@ Base_mappable::insert(Mapping* parent, Space *space, Page page)
 
   free->set_space(space);
   free->set_page(page);
+  t->index_add(free);
 
   t->check_integrity();
   return free;
@@ -49,6 +49,18 @@ public:
   FIASCO_SPACE_VIRTUAL
   void tlb_flush(bool);
 
+  /**
+   * Flush the TLB entries of the region of size 2^`order` at `virt`.
+   *
+   * Affects the current CPU only, unless tlb_page_flush_broadcast() is
+   * true. Defaults to tlb_flush(true).
+   */
+  FIASCO_SPACE_VIRTUAL
+  void tlb_flush_page(Vaddr virt, Page_order order);
+
+  /// Does tlb_flush_page() reach all CPUs without IPIs?
+  static bool tlb_page_flush_broadcast();
+
   /** Insert a page-table entry, or upgrade an existing entry with new
    *  attributes.
    *
@@ -250,6 +262,16 @@ Mem_space::Page_order Mem_space::_glbl_page_sizes[Max_num_global_page_sizes];
 unsigned Mem_space::_num_glbl_page_sizes;
 bool Mem_space::_glbl_page_sizes_finished;
 
+IMPLEMENT_DEFAULT
+void
+Mem_space::tlb_flush_page(Vaddr, Page_order)
+{ tlb_flush(true); }
+
+IMPLEMENT_DEFAULT inline
+bool
+Mem_space::tlb_page_flush_broadcast()
+{ return false; }
+
 PROTECTED static
 void
 Mem_space::add_global_page_size(Page_order o)
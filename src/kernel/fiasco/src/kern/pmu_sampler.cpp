@@ -0,0 +1,435 @@
+INTERFACE:
+
+#include "types.h"
+
+class Task;
+
+/**
+ * Statistical profiler driven by performance counter overflows.
+ *
+ * A sampling session programs one performance counter of a CPU to raise
+ * an interrupt every `period` events. Each interrupt appends a sample to a
+ * ring in kernel-user memory of the task that started the session, where
+ * a user-level server drains it without entering the kernel. Every CPU
+ * has its own ring and runs its own session, so the interrupt handler
+ * never synchronizes with other CPUs. Sessions are controlled through the
+ * scheduler object, see Scheduler::sys_profile().
+ */
+class Pmu_sampler
+{
+public:
+  enum Op
+  {
+    Op_start = 0,
+    Op_stop  = 1,
+  };
+
+  enum Sample_flags
+  {
+    Sample_kernel = 1, ///< interrupted a kernel thread, `pc` is invalid
+    Sample_pad    = 2, ///< no sample, skip to the start of the ring
+  };
+
+  enum
+  {
+    Max_depth  = 16,   ///< maximum call chain length of a sample
+    Min_words  = 256,  ///< minimum size of the record area in words
+    Min_period = 1000, ///< minimum number of events between two samples
+  };
+
+  /**
+   * Control words at the start of a sample ring, followed by the record
+   * area.
+   *
+   * `head` and `tail` are free-running word indexes into the record area.
+   * The kernel appends records at `head` and publishes the new `head` after
+   * the record is written. The server consumes records at `tail` and
+   * advances `tail` when it is done with them. A record never wraps around
+   * the end of the area, the rest of the area is filled with a
+   * Sample_pad record instead.
+   */
+  struct Ring
+  {
+    Mword head;  ///< written by the kernel
+    Mword tail;  ///< written by the server
+    Mword lost;  ///< samples dropped because the ring was full
+    Mword size;  ///< size of the record area in words, a power of two
+  };
+
+  /**
+   * A sample record, followed by `depth` return addresses, innermost
+   * first.
+   *
+   * `pc` and the call chain are taken from the user state of the
+   * interrupted thread, i.e. a thread preempted in the kernel is accounted
+   * to the user IP of its last kernel entry.
+   */
+  struct Sample
+  {
+    Unsigned16 words;  ///< size of the record in words, including the chain
+    Unsigned8  flags;  ///< Sample_flags
+    Unsigned8  depth;  ///< number of return addresses after the record
+    Unsigned32 cpu;
+    Unsigned64 time;   ///< Clock of `cpu`
+    Mword thread;      ///< debug ID of the interrupted thread
+    Mword task;        ///< debug ID of its task
+    Mword pc;
+  };
+
+  static_assert(sizeof(Sample) % sizeof(Mword) == 0,
+                "Sample must consist of whole words");
+};
+
+// ------------------------------------------------------------------------
+INTERFACE [pmu_sampler]:
+
+#include "clock.h"
+#include "per_cpu_data.h"
+
+class Entry_frame;
+class Space;
+
+EXTENSION class Pmu_sampler
+{
+private:
+  struct Cpu_state
+  {
+    explicit Cpu_state(Cpu_number cpu) : clock(cpu) {}
+
+    Clock clock;
+    Ring *ring = 0;    ///< kernel alias of the ring, 0 if not sampling
+    Task *task = 0;    ///< task owning the ring, holds a reference
+    Mword mask = 0;    ///< size of the record area - 1
+    Mword head = 0;    ///< the kernel's copy of Ring::head
+    Mword lost = 0;
+    Unsigned32 period = 0;
+    Unsigned8 depth = 0;
+  };
+
+  struct Start_args
+  {
+    Ring *ring;
+    Task *task;
+    Mword size;
+    Unsigned32 event;
+    Unsigned32 period;
+    Unsigned8 depth;
+    unsigned irq;
+  };
+
+  static Per_cpu<Cpu_state> _cpu;
+};
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [!pmu_sampler]:
+
+#include "l4_types.h"
+
+PUBLIC static inline
+int
+Pmu_sampler::control(Cpu_number, Mword const *, unsigned)
+{ return -L4_err::ENosys; }
+
+PUBLIC static inline
+void
+Pmu_sampler::task_destroyed(Task *)
+{}
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [pmu_sampler]:
+
+#include <cstring>
+#include "config.h"
+#include "cpu.h"
+#include "cpu_call.h"
+#include "cpu_lock.h"
+#include "entry_frame.h"
+#include "globals.h"
+#include "kernel_task.h"
+#include "l4_types.h"
+#include "lock_guard.h"
+#include "mem.h"
+#include "minmax.h"
+#include "task.h"
+
+DEFINE_PER_CPU Per_cpu<Pmu_sampler::Cpu_state>
+  Pmu_sampler::_cpu(Per_cpu_data::Cpu_num);
+
+/**
+ * Start or stop the sampling session of `cpu`.
+ *
+ * \param v  v[0] is the Op. Op_start takes the ring address and its size
+ *           in bytes within kernel-user memory of the calling task, the
+ *           event to count, the period, the maximum call chain depth and
+ *           the interrupt number of the performance monitoring unit, in
+ *           v[1] to v[6].
+ * \param n  number of words in `v`.
+ *
+ * \return 0 on success, or a negative error code.
+ */
+PUBLIC static
+int
+Pmu_sampler::control(Cpu_number cpu, Mword const *v, unsigned n)
+{
+  if (EXPECT_FALSE(n < 1))
+    return -L4_err::EMsgtooshort;
+
+  switch (v[0])
+    {
+    case Op_start:
+      if (EXPECT_FALSE(n < 7))
+        return -L4_err::EMsgtooshort;
+      return start(cpu, v[1], v[2], v[3], v[4], v[5], v[6]);
+
+    case Op_stop:
+      return stop(cpu);
+
+    default:
+      return -L4_err::ENosys;
+    }
+}
+
+PRIVATE static
+int
+Pmu_sampler::start(Cpu_number cpu, Address ring, Mword size, Mword event,
+                   Mword period, Mword depth, Mword irq)
+{
+  if (!arch_available())
+    return -L4_err::ENosys;
+
+  if (period < Min_period || period > (1UL << 31) || !arch_irq_valid(irq))
+    return -L4_err::EInval;
+
+  if (size < sizeof(Ring) + Min_words * sizeof(Mword) || size != (unsigned)size)
+    return -L4_err::EInval;
+
+  Task *task = static_cast<Task *>(current()->space());
+  User<Ring>::Ptr u_ring((Ring *)ring);
+  Space::Ku_mem const *m = task->find_ku_mem(u_ring, size);
+  if (!m)
+    return -L4_err::EInval;
+
+  Mword words = (size - sizeof(Ring)) / sizeof(Mword);
+  Mword area = Min_words;
+  while (area * 2 <= words)
+    area *= 2;
+
+  Start_args a;
+  a.ring = m->kern_addr(u_ring);
+  a.task = task;
+  a.size = area;
+  a.event = event;
+  a.period = period;
+  a.depth = min<Mword>(depth, Max_depth);
+  a.irq = irq;
+
+  task->inc_ref();
+
+  int err = -L4_err::EInval;
+  on_cpu(cpu, [&a, &err](Cpu_number)
+    {
+      err = start_cpu(a);
+      return false;
+    });
+
+  if (err)
+    release(task);
+
+  return err;
+}
+
+PRIVATE static
+int
+Pmu_sampler::stop(Cpu_number cpu)
+{
+  Task *task = 0;
+  on_cpu(cpu, [&task](Cpu_number)
+    {
+      task = stop_cpu();
+      return false;
+    });
+
+  if (!task)
+    return -L4_err::EInval;
+
+  release(task);
+  return 0;
+}
+
+/**
+ * Stop all sessions sampling into a ring of `task`, which is being
+ * destroyed. Otherwise the sessions would keep the task alive and keep
+ * writing to its kernel-user memory.
+ */
+PUBLIC static
+void
+Pmu_sampler::task_destroyed(Task *task)
+{
+  for (Cpu_number cpu = Cpu_number::first(); cpu < Config::max_num_cpus();
+       ++cpu)
+    {
+      if (!Cpu::online(cpu) || access_once(&_cpu.cpu(cpu).task) != task)
+        continue;
+
+      Task *t = 0;
+      on_cpu(cpu, [task, &t](Cpu_number)
+        {
+          if (_cpu.current().task == task)
+            t = stop_cpu();
+          return false;
+        });
+
+      if (t)
+        release(t);
+    }
+}
+
+/// Run `func` on `cpu` with interrupts disabled there.
+PRIVATE static
+void
+Pmu_sampler::on_cpu(Cpu_number cpu, cxx::functor<bool (Cpu_number)> &&func)
+{
+  Cpu_mask cpus;
+  cpus.set(cpu);
+
+  auto guard = lock_guard<Lock_guard_inverse_policy>(cpu_lock);
+  Cpu_call::cpu_call_many(cpus, cxx::move(func));
+}
+
+/// Drop the reference taken on `task` by start().
+PRIVATE static
+void
+Pmu_sampler::release(Task *task)
+{
+  if (task->dec_ref())
+    return;
+
+  current()->rcu_wait();
+  delete task;
+}
+
+PRIVATE static
+int
+Pmu_sampler::start_cpu(Start_args const &a)
+{
+  Cpu_state &s = _cpu.current();
+  if (s.ring)
+    return -L4_err::EBusy;
+
+  if (!arch_alloc_irq(a.irq))
+    return -L4_err::EInval;
+
+  s.ring = a.ring;
+  s.task = a.task;
+  s.mask = a.size - 1;
+  s.head = 0;
+  s.lost = 0;
+  s.period = a.period;
+  s.depth = a.depth;
+
+  s.ring->head = 0;
+  s.ring->tail = 0;
+  s.ring->lost = 0;
+  s.ring->size = a.size;
+
+  arch_start(a.event, a.period);
+  return 0;
+}
+
+/// \return the task of the stopped session, 0 if none was running.
+PRIVATE static
+Task *
+Pmu_sampler::stop_cpu()
+{
+  Cpu_state &s = _cpu.current();
+  if (!s.ring)
+    return 0;
+
+  arch_stop();
+
+  Task *task = s.task;
+  s.ring = 0;
+  s.task = 0;
+  return task;
+}
+
+/**
+ * Handle a counter overflow interrupt of the current CPU.
+ *
+ * \pre Interrupts are disabled.
+ */
+PUBLIC static
+void
+Pmu_sampler::overflow()
+{
+  Cpu_state &s = _cpu.current();
+  if (EXPECT_FALSE(!s.ring) || !arch_rearm(s.period))
+    return;
+
+  Thread *t = current_thread();
+  Space *space = t->space();
+  Mword chain[Max_depth];
+
+  Sample smp{};
+  smp.flags = 0;
+  smp.depth = 0;
+  smp.cpu = cxx::int_value<Cpu_number>(current_cpu());
+  smp.time = s.clock.read();
+  smp.thread = t->dbg_id();
+  smp.task = static_cast<Task *>(space)->dbg_id();
+  smp.pc = 0;
+
+  if (space == Kernel_task::kernel_task())
+    smp.flags |= Sample_kernel;
+  else
+    {
+      Entry_frame const *regs = t->regs();
+      smp.pc = regs->ip();
+      smp.depth = user_chain(space, regs, chain, s.depth);
+    }
+
+  smp.words = sizeof(Sample) / sizeof(Mword) + smp.depth;
+  put(s, &smp, chain);
+}
+
+/**
+ * Append a record to the ring of `s`.
+ *
+ * The server may have written anything to Ring::tail, so every index into
+ * the record area is masked and a bogus `tail` only loses samples.
+ */
+PRIVATE static
+void
+Pmu_sampler::put(Cpu_state &s, Sample const *smp, Mword const *chain)
+{
+  Mword *data = reinterpret_cast<Mword *>(s.ring + 1);
+  Mword const size = s.mask + 1;
+  Mword const used = s.head - access_once(&s.ring->tail);
+  Mword const off = s.head & s.mask;
+  Mword const pad = smp->words > size - off ? size - off : 0;
+
+  if (used > size || size - used < pad + smp->words)
+    {
+      write_now(&s.ring->lost, ++s.lost);
+      return;
+    }
+
+  if (pad)
+    {
+      Sample p{};
+      p.words = pad;
+      p.flags = Sample_pad;
+      p.depth = 0;
+      memcpy(&data[off], &p, sizeof(Mword));
+      s.head += pad;
+    }
+
+  Mword *rec = &data[s.head & s.mask];
+  memcpy(rec, smp, sizeof(Sample));
+  memcpy(rec + sizeof(Sample) / sizeof(Mword), chain,
+         smp->depth * sizeof(Mword));
+  s.head += smp->words;
+
+  Mem::mp_wmb();
+  write_now(&s.ring->head, s.head);
+}
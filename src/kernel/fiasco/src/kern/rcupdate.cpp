@@ -101,6 +101,8 @@ public:
   Rcu_list _c;
   Rcu_list _d;
   Cpu_number _cpu;
+
+  unsigned long _deferred;  ///< process_callbacks() calls that hit the limit
 };
 
 
@@ -122,6 +124,10 @@ private:
 
   Cpu_mask _active_cpus;
 
+  Rcu_batch _expedite_until; ///< batches up to this one are expedited
+  Cpu_mask _expedite_cpus;   ///< CPUs waiting for an expedited batch
+  unsigned long _expedited;  ///< number of expedite requests
+  Mword _pending_objs;       ///< kernel objects freed after a grace period
 };
 
 /**
@@ -136,6 +142,13 @@ class Rcu
   friend class Jdb_rcupdate;
 
 public:
+  enum
+  {
+    /// Maximum number of callbacks invoked by one process_callbacks() call,
+    /// the rest is deferred to the next call.
+    Batch_limit = 64,
+  };
+
   /// The lock to prevent a quiescent state.
   typedef Cpu_lock Lock;
   static Rcu_glbl *rcu() { return &_rcu; }
@@ -190,7 +203,10 @@ IMPLEMENTATION:
 
 #include "cpu.h"
 #include "cpu_lock.h"
+#include "atomic.h"
+#include "config.h"
 #include "globals.h"
+#include "ipi.h"
 #include "lock_guard.h"
 #include "mem.h"
 #include "static_init.h"
@@ -222,13 +238,17 @@ DEFINE_PER_CPU static Per_cpu<Rcu_timeout> _rcu_timeout;
 PUBLIC
 Rcu_glbl::Rcu_glbl()
 : _current(-300),
-  _completed(-300)
+  _completed(-300),
+  _expedite_until(-300),
+  _expedited(0),
+  _pending_objs(0)
 {}
 
 PUBLIC
 Rcu_data::Rcu_data(Cpu_number cpu)
 : _idle(true),
-  _cpu(cpu)
+  _cpu(cpu),
+  _deferred(0)
 {}
 
 
@@ -249,27 +269,31 @@ Rcu_data::enqueue(Rcu_item *i)
   ++_len;
 }
 
+/**
+ * Invoke at most Rcu::Batch_limit callbacks of the done list.
+ *
+ * Callbacks left over stay in the done list, which keeps the CPU pending,
+ * so that they are invoked by the next process_callbacks() call.
+ */
 PRIVATE inline NOEXPORT NEEDS["cpu_lock.h", "lock_guard.h"]
 bool
 Rcu_data::do_batch()
 {
   int count = 0;
   bool need_resched = false;
-  for (Rcu_list::Const_iterator l = _d.begin(); l != _d.end();)
+  while (!_d.empty() && count < Rcu::Batch_limit)
     {
-      Rcu_item *i = *l;
-      ++l;
-
+      Rcu_item *i = _d.pop_front();
       need_resched |= i->_call_back(i);
       ++count;
     }
 
-  // XXX: I do not know why this and the former stuff is w/o cpu lock
-  //      but the couting needs it?
-  _d.clear();
-
-  // XXX: we use clear, we seemingly worked through the whole list
-  //_d.head(l);
+  if (!_d.empty())
+    {
+      // let others run before we continue with the rest
+      ++_deferred;
+      need_resched = true;
+    }
 
     {
       auto guard = lock_guard(cpu_lock);
@@ -279,6 +303,26 @@ Rcu_data::do_batch()
   return need_resched;
 }
 
+PRIVATE inline
+bool
+Rcu_glbl::expedited() const
+{ return _expedite_until >= _current; }
+
+/**
+ * Send an IPI to all CPUs in `cpus` but the current one. The IPI handler
+ * passes through Rcu::do_pending_work(), i.e., reports a quiescent state
+ * and invokes callbacks whose grace period is over.
+ */
+PRIVATE inline NOEXPORT NEEDS["ipi.h"]
+void
+Rcu_glbl::kick(Cpu_mask const &cpus)
+{
+  Cpu_number const self = current_cpu();
+  for (Cpu_number n = Cpu_number::first(); n < Config::max_num_cpus(); ++n)
+    if (n != self && cpus.get(n))
+      Ipi::send(Ipi::Request, self, n);
+}
+
 PRIVATE inline NOEXPORT
 void
 Rcu_glbl::start_batch()
@@ -290,6 +334,11 @@ Rcu_glbl::start_batch()
       ++_current;
       Mem::mp_mb();
       _cpus = _active_cpus;
+
+      // collect the quiescent states right away instead of waiting for
+      // the next timer tick of each CPU
+      if (expedited())
+        kick(_cpus);
     }
 }
 
@@ -344,22 +393,36 @@ Rcu_glbl::cpu_quiet(Cpu_number cpu)
   _cpus.clear(cpu);
   if (_cpus.empty())
     {
+      if (expedited())
+        {
+          // waiters shall invoke their callbacks without waiting for a tick
+          kick(_expedite_cpus);
+          if (_current >= _expedite_until)
+            _expedite_cpus = Cpu_mask();
+        }
+
       _completed = _current;
       start_batch();
     }
 }
 
+/**
+ * \param now  The CPU is in a quiescent state right now. This counts for
+ *             a grace period that started before, even if this CPU did not
+ *             notice it yet.
+ */
 PRIVATE
 void
-Rcu_data::check_quiescent_state(Rcu_glbl *rgp)
+Rcu_data::check_quiescent_state(Rcu_glbl *rgp, bool now)
 {
   if (_q_batch != rgp->_current)
     {
       // start new grace period
       _pending = 1;
-      _q_passed = 0;
+      _q_passed = now;
       _q_batch = rgp->_current;
-      return;
+      if (!now)
+        return;
     }
 
   // Is the grace period already completed for this cpu?
@@ -428,7 +491,7 @@ Rcu_data::~Rcu_data()
 
 PUBLIC
 bool FIASCO_WARN_RESULT
-Rcu_data::process_callbacks(Rcu_glbl *rgp)
+Rcu_data::process_callbacks(Rcu_glbl *rgp, bool quiescent = false)
 {
   LOG_TRACE("Rcu callbacks", "rcu", ::current(), Rcu::Log_rcu,
       l->cpu = _cpu;
@@ -459,7 +522,12 @@ Rcu_data::process_callbacks(Rcu_glbl *rgp)
 	}
     }
 
-  check_quiescent_state(rgp);
+  check_quiescent_state(rgp, quiescent);
+
+  // an expedited grace period may have ended right now
+  if (!_c.empty() && rgp->_completed >= _batch)
+    _d.append(_c);
+
   if (!_d.empty())
     return do_batch();
 
@@ -544,7 +612,55 @@ Rcu::do_pending_work(Cpu_number cpu)
   if (pending(cpu))
     {
       inc_q_cnt(cpu);
-      return process_callbacks(cpu);
+      return _rcu_data.cpu(cpu).process_callbacks(&_rcu, _rcu.expedited());
     }
   return false;
 }
+
+/**
+ * Request an expedited grace period for the callbacks queued on the
+ * current CPU.
+ *
+ * Instead of waiting until every CPU passes a timer tick, all CPUs that
+ * still need to pass a quiescent state get an IPI. The current CPU must
+ * be in a quiescent state, which holds for a thread about to block in
+ * Context::rcu_wait().
+ *
+ * \pre cpu_lock is held.
+ */
+PUBLIC static
+void
+Rcu::expedite()
+{
+  Cpu_number const cpu = current_cpu();
+  Rcu_glbl *rgp = rcu();
+
+    {
+      auto guard = lock_guard(rgp->_lock);
+      ++rgp->_expedited;
+
+      // our callbacks wait for the next batch, or for the one after if
+      // this CPU still waits for the next batch with older callbacks
+      if (rgp->_current + 2 > rgp->_expedite_until)
+        rgp->_expedite_until = rgp->_current + 2;
+
+      rgp->_expedite_cpus.set(cpu);
+
+      // speed up the batch in progress, our callbacks wait for its end
+      if (rgp->_completed != rgp->_current)
+        rgp->kick(rgp->_cpus);
+    }
+
+  inc_q_cnt(cpu);
+  // a thread going to block reschedules anyway
+  (void)_rcu_data.cpu(cpu).process_callbacks(rgp, true);
+}
+
+/**
+ * Account `objs` kernel objects whose memory is released after the next
+ * grace period, negative values for objects that were released.
+ */
+PUBLIC static inline NEEDS["atomic.h"]
+void
+Rcu::account_pending(long objs)
+{ atomic_mp_add(&_rcu._pending_objs, (Mword)objs); }
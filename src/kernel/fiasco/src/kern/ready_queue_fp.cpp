@@ -25,16 +25,81 @@ private:
   typedef typename E::Fp_list List;
   unsigned prio_highest;
   List prio_next[256];
+  E *_idle;
+  unsigned _nr_ready;
 
 public:
   void set_idle(E *sc)
-  { sc->_prio = Config::Kernel_prio; }
+  {
+    _idle = sc;
+    sc->_prio = Config::Kernel_prio;
+  }
+
+  /// Number of queued sched contexts, not counting the idle thread.
+  unsigned nr_ready() const { return _nr_ready; }
 
   void enqueue(E *, bool);
   void dequeue(E *);
   E *next_to_run() const;
 };
 
+// ---------------------------------------------------------------------------
+INTERFACE [(sched_fixed_prio || sched_fp_wfq) && sched_fp_bitmap]:
+
+/**
+ * Two-level bitmap of the non-empty priority levels of a Ready_queue_fp.
+ *
+ * The second level has one bit per priority, the first level one bit per
+ * non-zero word of the second level. This way the highest non-empty
+ * priority is found with two count-leading-zero operations instead of
+ * walking down the priority lists.
+ */
+class Ready_queue_fp_bitmap
+{
+public:
+  void set(unsigned prio)
+  {
+    unsigned w = prio / Bpw;
+    _map[w] |= Mword(1) << (prio % Bpw);
+    _top |= Mword(1) << w;
+  }
+
+  void clear(unsigned prio)
+  {
+    unsigned w = prio / Bpw;
+    _map[w] &= ~(Mword(1) << (prio % Bpw));
+    if (!_map[w])
+      _top &= ~(Mword(1) << w);
+  }
+
+  unsigned highest() const
+  {
+    if (!_top)
+      return 0;
+
+    unsigned w = Bpw - 1 - __builtin_clzl(_top);
+    return w * Bpw + Bpw - 1 - __builtin_clzl(_map[w]);
+  }
+
+private:
+  enum
+  {
+    Bpw   = sizeof(Mword) * 8,
+    Words = 256 / Bpw,
+  };
+
+  static_assert(Words <= Bpw, "first bitmap level too small");
+
+  Mword _top;
+  Mword _map[Words];
+};
+
+EXTENSION class Ready_queue_fp
+{
+private:
+  Ready_queue_fp_bitmap _prio_map;
+};
+
 
 // ---------------------------------------------------------------------------
 IMPLEMENTATION [sched_fixed_prio || sched_fp_wfq]:
@@ -67,10 +132,10 @@ Ready_queue_fp<E>::enqueue(E *i, bool is_current_sched)
 
   unsigned short prio = i->prio();
 
-  if (prio > prio_highest)
-    prio_highest = prio;
-
+  mark_prio(prio);
   prio_next[prio].push(i, is_current_sched ? List::Front : List::Back);
+  if (i != _idle)
+    ++_nr_ready;
 }
 
 /**
@@ -90,9 +155,9 @@ Ready_queue_fp<E>::dequeue(E *i)
   unsigned short prio = i->prio();
 
   prio_next[prio].remove(i);
-
-  while (prio_next[prio_highest].empty() && prio_highest)
-    prio_highest--;
+  unmark_prio(prio);
+  if (i != _idle)
+    --_nr_ready;
 }
 
 
@@ -113,3 +178,68 @@ void
 Ready_queue_fp<E>::deblock_refill(E *)
 {}
 
+
+// ---------------------------------------------------------------------------
+IMPLEMENTATION [(sched_fixed_prio || sched_fp_wfq) && !sched_fp_bitmap]:
+
+PUBLIC template<typename E> static inline
+char const *
+Ready_queue_fp<E>::variant_name()
+{ return "linear"; }
+
+PRIVATE inline
+template<typename E>
+void
+Ready_queue_fp<E>::mark_prio(unsigned prio)
+{
+  if (prio > prio_highest)
+    prio_highest = prio;
+}
+
+/**
+ * Find the new highest non-empty priority by walking down the priority
+ * lists.
+ */
+PRIVATE inline
+template<typename E>
+void
+Ready_queue_fp<E>::unmark_prio(unsigned)
+{
+  while (prio_next[prio_highest].empty() && prio_highest)
+    prio_highest--;
+}
+
+
+// ---------------------------------------------------------------------------
+IMPLEMENTATION [(sched_fixed_prio || sched_fp_wfq) && sched_fp_bitmap]:
+
+PUBLIC template<typename E> static inline
+char const *
+Ready_queue_fp<E>::variant_name()
+{ return "bitmap"; }
+
+PRIVATE inline
+template<typename E>
+void
+Ready_queue_fp<E>::mark_prio(unsigned prio)
+{
+  _prio_map.set(prio);
+  if (prio > prio_highest)
+    prio_highest = prio;
+}
+
+/**
+ * Find the new highest non-empty priority using the priority bitmap.
+ */
+PRIVATE inline
+template<typename E>
+void
+Ready_queue_fp<E>::unmark_prio(unsigned prio)
+{
+  if (!prio_next[prio].empty())
+    return;
+
+  _prio_map.clear(prio);
+  if (prio == prio_highest)
+    prio_highest = _prio_map.highest();
+}
@@ -9,8 +9,31 @@ struct L4_sched_param_wfq : public L4_sched_param
   enum : Smword { Class = -2 };
   Mword quantum;
   Mword weight;
+  /// Non-zero to run in the Sched_group passed as the second capability
+  /// to Scheduler::sys_run(), whose copy of the parameters then holds the
+  /// group. Only used if `length` covers it, older users pass the
+  /// parameters without it.
+  Mword group;
+
+  bool has_group() const
+  { return length >= sizeof(L4_sched_param_wfq) && group; }
 };
 
+/**
+ * Ready queue of the weighted-fair scheduler.
+ *
+ * Ready sched contexts are kept in an intrusive pairing heap ordered by
+ * their virtual deadline, so the queue has no storage of its own and no
+ * limit on its size. A member of a Sched_group is queued in the heap of
+ * the group's entity for this CPU instead, and that entity is queued in the
+ * heap of its parent as long as the group has ready members. The deadline
+ * of an entity advances by the quanta its members consume divided by the
+ * weight of the group.
+ *
+ * A queued element has `_ready_link` pointing to the link that refers to
+ * it: the root of its heap, the first-child link of its parent or the next
+ * link of its left sibling.
+ */
 template< typename E >
 class Ready_queue_wfq
 {
@@ -19,6 +42,8 @@ class Ready_queue_wfq
   friend class Jdb_thread_list_policy;
 
 public:
+  enum { Max_group_depth = 4 };
+
   E *current_sched() const { return _current_sched; }
   void activate(E *s) { _current_sched = s; }
   E *idle;
@@ -34,14 +59,22 @@ public:
   void dequeue(E *);
   E *next_to_run() const;
 
+  /// Number of queued sched contexts, not counting group entities.
+  unsigned nr_ready() const { return _nr_ready; }
+
 private:
-  void swap(unsigned a, unsigned b);
-  void heap_up(unsigned a);
-  void heap_down(unsigned a);
+  static Cpu_number cpu_of(E *x);
+  static E *parent(E *x, Cpu_number cpu);
+  static unsigned ancestors(E *x, E **v);
+  static E *link(E *a, E *b);
+  static E *merge_pairs(E *h);
+  static void heap_insert(E **root, E *n);
+  static void heap_remove(E **root, E *n);
+  E **heap_of(E *x, Cpu_number cpu);
 
   E *_current_sched;
-  unsigned _cnt;
-  E *_heap[1024];
+  E *_root;
+  unsigned _nr_ready;
 
   static typename E::Wfq_sc *_e(E *e) { return E::wfq_elem(e); }
 };
@@ -71,13 +104,94 @@ IMPLEMENTATION [sched_wfq || sched_fp_wfq]:
 #include "std_macros.h"
 
 
+/**
+ * CPU of the group entities above `x`.
+ *
+ * Only members of groups need it, so the common case does not look at the
+ * context of `x`.
+ */
+IMPLEMENT inline
+template<typename E>
+Cpu_number
+Ready_queue_wfq<E>::cpu_of(E *x)
+{ return _e(x)->_group ? x->home_cpu() : Cpu_number::first(); }
+
+/// The entity of the group of `x` on `cpu`, 0 if `x` is not in a group.
+IMPLEMENT inline
+template<typename E>
+E *
+Ready_queue_wfq<E>::parent(E *x, Cpu_number cpu)
+{
+  E *g = _e(x)->_group;
+  return g ? g + cxx::int_value<Cpu_number>(cpu) : 0;
+}
+
+IMPLEMENT inline
+template<typename E>
+E **
+Ready_queue_wfq<E>::heap_of(E *x, Cpu_number cpu)
+{
+  E *p = parent(x, cpu);
+  return p ? &_e(p)->_members : &_root;
+}
+
+/**
+ * Store `x` and the entities of the groups above it in `v`, innermost
+ * first.
+ *
+ * \return the number of elements stored.
+ */
+IMPLEMENT inline
+template<typename E>
+unsigned
+Ready_queue_wfq<E>::ancestors(E *x, E **v)
+{
+  Cpu_number cpu = cpu_of(x);
+  unsigned n = 0;
+  for (; x && n <= Max_group_depth; x = parent(x, cpu))
+    v[n++] = x;
+
+  return n;
+}
+
+/**
+ * Check whether `a` runs before `b`, comparing the deadlines of their
+ * ancestors in the innermost group they share.
+ */
+PUBLIC static
+template<typename E>
+bool
+Ready_queue_wfq<E>::precedes(E *a, E *b)
+{
+  if (EXPECT_TRUE(!_e(a)->_group && !_e(b)->_group))
+    return *_e(a) < *_e(b);
+
+  E *pa[Max_group_depth + 1];
+  E *pb[Max_group_depth + 1];
+  unsigned na = ancestors(a, pa);
+  unsigned nb = ancestors(b, pb);
+
+  while (na > 1 && nb > 1 && pa[na - 1] == pb[nb - 1])
+    {
+      --na;
+      --nb;
+    }
+
+  return *_e(pa[na - 1]) < *_e(pb[nb - 1]);
+}
+
 IMPLEMENT inline
 template<typename E>
 E *
 Ready_queue_wfq<E>::next_to_run() const
 {
-  if (_cnt)
-    return _heap[0];
+  if (E *x = _root)
+    {
+      // queued entities always have ready members
+      while (_e(x)->_entity)
+        x = _e(x)->_members;
+      return x;
+    }
 
   if (_current_sched)
     _e(idle)->_dl = _e(_current_sched)->_dl;
@@ -85,56 +199,124 @@ Ready_queue_wfq<E>::next_to_run() const
   return idle;
 }
 
+/**
+ * Link the heaps `a` and `b`, the root with the later deadline becomes the
+ * first child of the other.
+ *
+ * \return the new root, its next link and `_ready_link` are stale.
+ */
 IMPLEMENT inline
 template<typename E>
-void
-Ready_queue_wfq<E>::swap(unsigned a, unsigned b)
+E *
+Ready_queue_wfq<E>::link(E *a, E *b)
 {
-  _e(_heap[a])->_ready_link = &_heap[b];
-  _e(_heap[b])->_ready_link = &_heap[a];
-  E *s = _heap[a];
-  _heap[a] = _heap[b];
-  _heap[b] = s;
+  if (*_e(b) < *_e(a))
+    {
+      E *t = a;
+      a = b;
+      b = t;
+    }
+
+  E *c = _e(a)->_ph_child;
+  _e(b)->_ph_next = c;
+  if (c)
+    _e(c)->_ready_link = &_e(b)->_ph_next;
+
+  _e(a)->_ph_child = b;
+  _e(b)->_ready_link = &_e(a)->_ph_child;
+  return a;
 }
 
-IMPLEMENT inline
+/**
+ * Merge the siblings starting at `h` into one heap, with the usual two
+ * passes of the pairing heap.
+ *
+ * \return the new root, its `_ready_link` is stale.
+ */
+IMPLEMENT
 template<typename E>
-void
-Ready_queue_wfq<E>::heap_up(unsigned a)
+E *
+Ready_queue_wfq<E>::merge_pairs(E *h)
 {
-  for (;a > 0;)
+  // link pairs from left to right, stacking the results
+  E *s = 0;
+  while (h)
+    {
+      E *a = h;
+      E *b = _e(a)->_ph_next;
+      if (b)
+        {
+          h = _e(b)->_ph_next;
+          a = link(a, b);
+        }
+      else
+        h = 0;
+
+      _e(a)->_ph_next = s;
+      s = a;
+    }
+
+  if (!s)
+    return 0;
+
+  // link the stacked heaps from right to left
+  E *r = s;
+  s = _e(r)->_ph_next;
+  while (s)
     {
-      unsigned p = (a-1)/2;
-      if (*_e(_heap[p]) < *_e(_heap[a]))
-	return;
-      swap(p, a);
-      a = p;
+      E *n = _e(s)->_ph_next;
+      r = link(r, s);
+      s = n;
     }
+
+  _e(r)->_ph_next = 0;
+  return r;
 }
 
 IMPLEMENT inline
 template<typename E>
 void
-Ready_queue_wfq<E>::heap_down(unsigned a)
+Ready_queue_wfq<E>::heap_insert(E **root, E *n)
 {
-  for (;;)
-    {
-      unsigned c1 = 2*a + 1;
-      unsigned c2 = 2*a + 2;
-
-      if (_cnt <= c1)
-	return;
+  _e(n)->_ph_child = 0;
+  _e(n)->_ph_next = 0;
 
-      if (_cnt > c2 && *_e(_heap[c2]) <= *_e(_heap[c1]))
-	c1 = c2;
+  E *r = *root ? link(*root, n) : n;
+  *root = r;
+  _e(r)->_ready_link = root;
+  _e(r)->_ph_next = 0;
+}
 
-      if (*_e(_heap[a]) <= *_e(_heap[c1]))
-	return;
+IMPLEMENT inline
+template<typename E>
+void
+Ready_queue_wfq<E>::heap_remove(E **root, E *n)
+{
+  E *sub = merge_pairs(_e(n)->_ph_child);
 
-      swap(c1, a);
+  if (n == *root)
+    *root = sub;
+  else
+    {
+      // cut `n` out of the list of its siblings
+      E *next = _e(n)->_ph_next;
+      *_e(n)->_ready_link = next;
+      if (next)
+        _e(next)->_ready_link = _e(n)->_ready_link;
+
+      if (sub)
+        *root = link(*root, sub);
+    }
 
-      a = c1;
+  if (E *r = *root)
+    {
+      _e(r)->_ready_link = root;
+      _e(r)->_ph_next = 0;
     }
+
+  _e(n)->_ready_link = 0;
+  _e(n)->_ph_child = 0;
+  _e(n)->_ph_next = 0;
 }
 
 /**
@@ -151,13 +333,24 @@ Ready_queue_wfq<E>::enqueue(E *i, bool /*is_current_sched**/)
   if (EXPECT_FALSE (i->in_ready_list()))
     return;
 
-  unsigned n = _cnt++;
+  ++_nr_ready;
+  Cpu_number cpu = cpu_of(i);
+  for (E *x = i;;)
+    {
+      E **h = heap_of(x, cpu);
+
+      // a group must not gain credit while it has no ready members
+      if (x != i && *h && _e(x)->_dl < _e(*h)->_dl)
+        _e(x)->_dl = _e(*h)->_dl;
+
+      heap_insert(h, x);
 
-  E *&h = _heap[n];
-  h = i;
-  _e(i)->_ready_link = &h;
+      E *p = parent(x, cpu);
+      if (!p || _e(p)->_ready_link)
+        return;
 
-  heap_up(n);
+      x = p;
+    }
 }
 
 /**
@@ -174,31 +367,56 @@ Ready_queue_wfq<E>::dequeue(E *i)
   if (EXPECT_FALSE (!i->in_ready_list() || i == idle))
     return;
 
-  unsigned x = _e(i)->_ready_link - _heap;
-
-  if (x == --_cnt)
+  --_nr_ready;
+  Cpu_number cpu = cpu_of(i);
+  for (E *x = i;;)
     {
-      _e(i)->_ready_link = 0;
-      return;
-    }
+      E *p = parent(x, cpu);
+      heap_remove(p ? &_e(p)->_members : &_root, x);
+
+      // a group stays queued as long as it has ready members
+      if (!p || _e(p)->_members)
+        return;
 
-  swap(x, _cnt);
-  heap_down(x);
-  _e(i)->_ready_link = 0;
+      x = p;
+    }
 }
 
 /**
- * Enqueue context in ready-list.
+ * Requeue context after its quantum was replenished and charge the quantum
+ * to the groups it ran in.
  */
 PUBLIC
 template<typename E>
 void
 Ready_queue_wfq<E>::requeue(E *i)
 {
+  if (EXPECT_FALSE(i == idle))
+    return;
+
+  Cpu_number cpu = cpu_of(i);
+  if (i->in_ready_list())
+    {
+      E **h = heap_of(i, cpu);
+      heap_remove(h, i);
+      heap_insert(h, i);
+    }
+
+  for (E *x = i, *p; (p = parent(x, cpu)); x = p)
+    {
+      E **h = heap_of(p, cpu);
+      bool queued = _e(p)->_ready_link;
+      if (queued)
+        heap_remove(h, p);
+
+      _e(p)->_dl += _e(i)->_q / _e(p)->_w;
+
+      if (queued)
+        heap_insert(h, p);
+    }
+
   if (!i->in_ready_list())
     enqueue(i, false);
-
-  heap_down(_e(i)->_ready_link - _heap);
 }
 
 
@@ -207,8 +425,20 @@ void
 Ready_queue_wfq<E>::deblock_refill(E *sc)
 {
   Unsigned64 da = 0;
-  if (EXPECT_TRUE(_current_sched != 0))
-    da = _e(_current_sched)->_dl;
+  if (_e(sc)->_group)
+    {
+      // members of a group only compete with their siblings
+      E *m = _e(parent(sc, cpu_of(sc)))->_members;
+      if (!m)
+        return;
+      da = _e(m)->_dl;
+    }
+  else if (EXPECT_TRUE(_current_sched != 0))
+    {
+      // compare with the top-level ancestor of the current timeslice
+      E *cs[Max_group_depth + 1];
+      da = _e(cs[ancestors(_current_sched, cs) - 1])->_dl;
+    }
 
   if (_e(sc)->_dl >= da)
     return;
@@ -218,4 +448,3 @@ Ready_queue_wfq<E>::deblock_refill(E *sc)
     _e(sc)->_left = _e(sc)->_q;
   _e(sc)->_dl = da;
 }
-
@@ -170,3 +170,9 @@ bool
 Sched_context::dominates(Sched_context *sc)
 { return prio() > sc->prio(); }
 
+
+/// There are no scheduling groups in the fixed-priority scheduler.
+PUBLIC inline
+void
+Sched_context::leave_group()
+{}
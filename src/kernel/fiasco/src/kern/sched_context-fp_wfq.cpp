@@ -60,6 +60,13 @@ private:
 
     unsigned _w;
     unsigned _qdw;
+
+    // not aliased by Fp_sc, these stay valid in the fixed-priority class
+    Sched_context *_ph_child;  ///< first child in the pairing heap
+    Sched_context *_ph_next;   ///< next sibling in the pairing heap
+    Sched_context *_group;     ///< entities of the enclosing Sched_group
+    Sched_context *_members;   ///< for group entities: ready members
+    bool _entity;              ///< stands for a Sched_group on one CPU
   };
 
   union Sc
@@ -96,6 +103,9 @@ public:
     Sched_context *next_to_run() const;
     void deblock_refill(Sched_context *sc);
 
+    unsigned nr_ready() const
+    { return fp_rq.nr_ready() + wfq_rq.nr_ready(); }
+
   private:
     friend class Jdb_thread_list;
     Sched_context *_current_sched;
@@ -111,6 +121,7 @@ IMPLEMENTATION [sched_fp_wfq]:
 #include "cpu_lock.h"
 #include "std_macros.h"
 #include "config.h"
+#include "sched_group.h"
 
 /**
  * Constructor
@@ -123,6 +134,9 @@ Sched_context::Sched_context()
   _sc.fp._q = Config::Default_time_slice;
   _sc.fp._left = Config::Default_time_slice;
   _sc.fp._ready_next = 0;
+  _sc.wfq._group = 0;
+  _sc.wfq._members = 0;
+  _sc.wfq._entity = false;
 }
 
 IMPLEMENT inline
@@ -163,6 +177,7 @@ Sched_context::set(L4_sched_param const *_p)
   if (p->p.sched_class >= 0)
     {
       // legacy fixed prio
+      leave_group();
       _t = Fixed_prio;
       _sc.fp._p = p->legacy_fixed_prio.prio;
       if (p->legacy_fixed_prio.prio > 255)
@@ -176,6 +191,7 @@ Sched_context::set(L4_sched_param const *_p)
   switch (p->p.sched_class)
     {
     case L4_sched_param_fixed_prio::Class:
+      leave_group();
       _t = Fixed_prio;
 
       _sc.fp._p = p->fixed_prio.prio;
@@ -188,14 +204,23 @@ Sched_context::set(L4_sched_param const *_p)
 
       break;
     case L4_sched_param_wfq::Class:
-      if (p->wfq.quantum == 0 || p->wfq.weight == 0)
-        return -L4_err::EInval;
-      _t = Wfq;
-      _sc.wfq._p = 0;
-      _sc.wfq._q = p->wfq.quantum;
-      _sc.wfq._w = p->wfq.weight;
-      _sc.wfq._qdw =  p->wfq.quantum / p->wfq.weight;
-      break;
+      {
+        if (p->wfq.quantum == 0 || p->wfq.weight == 0)
+          return -L4_err::EInval;
+
+        Sched_context *g = 0;
+        if (p->wfq.has_group())
+          g = reinterpret_cast<Sched_group *>(p->wfq.group)->join();
+
+        leave_group();
+        _t = Wfq;
+        _sc.wfq._p = 0;
+        _sc.wfq._q = p->wfq.quantum;
+        _sc.wfq._w = p->wfq.weight;
+        _sc.wfq._qdw =  p->wfq.quantum / p->wfq.weight;
+        _sc.wfq._group = g;
+        break;
+      }
     default:
       return L4_err::ERange;
     };
@@ -262,9 +287,46 @@ Sched_context::dominates(Sched_context *sc)
   if (sc->_t == Fixed_prio)
     return false;
 
-  return _sc.wfq._dl < sc->_sc.wfq._dl;
+  return Ready_queue_wfq<Sched_context>::precedes(this, sc);
+}
+
+/// Leave the Sched_group of this thread, if any.
+PUBLIC
+void
+Sched_context::leave_group()
+{
+  if (!_sc.wfq._group)
+    return;
+
+  Sched_context *g = _sc.wfq._group;
+  _sc.wfq._group = 0;
+  Sched_group::leave(g);
 }
 
+/**
+ * Make this the entity of a Sched_group on one CPU.
+ *
+ * \param parent  entities of the parent group, or 0.
+ */
+PUBLIC
+void
+Sched_context::init_group_entity(Sched_context *parent, unsigned weight)
+{
+  _t = Wfq;
+  _sc.wfq._p = 0;
+  _sc.wfq._ready_link = 0;
+  _sc.wfq._idle = 0;
+  _sc.wfq._dl = 0;
+  _sc.wfq._w = weight;
+  _sc.wfq._group = parent;
+  _sc.wfq._entity = true;
+}
+
+PUBLIC inline
+void
+Sched_context::set_group_weight(unsigned weight)
+{ _sc.wfq._w = weight; }
+
 PUBLIC inline
 void
 Sched_context::replenish()
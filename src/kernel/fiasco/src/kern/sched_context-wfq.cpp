@@ -36,7 +36,12 @@ private:
   static Sched_context *wfq_elem(Sched_context *x) { return x; }
 
   Sched_context **_ready_link;
+  Sched_context *_ph_child;  ///< first child in the pairing heap
+  Sched_context *_ph_next;   ///< next sibling in the pairing heap
+  Sched_context *_group;     ///< entities of the enclosing Sched_group, or 0
+  Sched_context *_members;   ///< for group entities: heap of ready members
   bool _idle:1;
+  bool _entity:1;            ///< stands for a Sched_group on one CPU
   Unsigned64 _dl;
   Unsigned64 _left;
 
@@ -53,6 +58,7 @@ IMPLEMENTATION [sched_wfq]:
 #include <cassert>
 #include "config.h"
 #include "cpu_lock.h"
+#include "sched_group.h"
 #include "std_macros.h"
 
 
@@ -62,7 +68,12 @@ IMPLEMENTATION [sched_wfq]:
 PUBLIC
 Sched_context::Sched_context()
 : _ready_link(0),
+  _ph_child(0),
+  _ph_next(0),
+  _group(0),
+  _members(0),
   _idle(0),
+  _entity(0),
   _dl(0),
   _left(Config::Default_time_slice),
   _q(Config::Default_time_slice),
@@ -91,6 +102,12 @@ Sched_context::set(L4_sched_param const *_p)
   if (p->wfq.quantum == 0 || p->wfq.weight == 0)
     return -L4_err::EInval;
 
+  Sched_context *g = 0;
+  if (p->wfq.has_group())
+    g = reinterpret_cast<Sched_group *>(p->wfq.group)->join();
+
+  leave_group();
+  _group = g;
   _dl = 0;
   _q = p->wfq.quantum;
   _w = p->wfq.weight;
@@ -98,6 +115,38 @@ Sched_context::set(L4_sched_param const *_p)
   return 0;
 }
 
+/// Leave the Sched_group of this thread, if any.
+PUBLIC
+void
+Sched_context::leave_group()
+{
+  if (!_group)
+    return;
+
+  Sched_context *g = _group;
+  _group = 0;
+  Sched_group::leave(g);
+}
+
+/**
+ * Make this the entity of a Sched_group on one CPU.
+ *
+ * \param parent  entities of the parent group, or 0.
+ */
+PUBLIC
+void
+Sched_context::init_group_entity(Sched_context *parent, unsigned weight)
+{
+  _entity = 1;
+  _group = parent;
+  _w = weight;
+}
+
+PUBLIC inline
+void
+Sched_context::set_group_weight(unsigned weight)
+{ _w = weight; }
+
 /**
  * Return remaining time quantum of Sched_context
  */
@@ -145,7 +194,7 @@ Sched_context::dominates(Sched_context *sc)
   if (_idle)
     LOG_MSG_3VAL(current(), "idl", (Mword)sc, _dl, sc->_dl);
 #endif
-  return !_idle && _dl < sc->_dl;
+  return !_idle && Ready_queue_base::precedes(this, sc);
 }
 
 
@@ -56,6 +56,7 @@ public:
 IMPLEMENTATION:
 
 #include <cassert>
+#include "context.h"
 #include "timer.h"
 #include "timeout.h"
 #include "globals.h"
@@ -63,6 +64,16 @@ IMPLEMENTATION:
 
 DEFINE_PER_CPU Per_cpu<Sched_context::Ready_queue> Sched_context::rq;
 
+/**
+ * Home CPU of the owner, whose ready queue this is queued in.
+ *
+ * Not inline, so that the ready queues need not include context.h.
+ */
+PUBLIC
+Cpu_number
+Sched_context::home_cpu() const
+{ return context()->home_cpu(); }
+
 /**
  * Set currently active global Sched_context.
  */
@@ -0,0 +1,258 @@
+INTERFACE [sched_wfq || sched_fp_wfq]:
+
+#include "config.h"
+#include "kobject_helper.h"
+#include "ref_obj.h"
+#include "sched_context.h"
+
+class Ram_quota;
+
+/// The entities of a Sched_group, one per CPU.
+struct Sched_group_ents
+{
+  Sched_context _ent[Config::Max_num_cpus];
+};
+
+/**
+ * Scheduling group of the weighted-fair scheduler.
+ *
+ * A group competes with the threads and groups next to it by its own
+ * weight, independent of the number of its members, and shares the time it
+ * gets among its members by their weights. Groups nest up to
+ * Ready_queue_wfq::Max_group_depth levels. A group has one entity per CPU,
+ * which stands for the group in the ready queue of that CPU.
+ *
+ * Groups are created through a factory and charged to its quota. A new
+ * group is nested in the group passed as capability with the create
+ * request, if any. Threads join a group by passing its capability to
+ * Scheduler::sys_run(), see L4_sched_param_wfq::group. Members and child
+ * groups hold a reference, so a group lives until its last capability is
+ * deleted and its last member has left.
+ */
+class Sched_group
+: public Sched_group_ents,
+  public Kobject_h<Sched_group, Kobject>,
+  public Ref_cnt_obj
+{
+public:
+  enum Op
+  {
+    Op_set_weight = 0,
+  };
+
+private:
+  Sched_group *_parent;
+  unsigned _depth;
+  Ram_quota *_quota;
+};
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [sched_wfq || sched_fp_wfq]:
+
+#include "kmem_slab.h"
+#include "l4_buf_iter.h"
+#include "l4_types.h"
+#include "ram_quota.h"
+
+JDB_DEFINE_TYPENAME(Sched_group, "\033[34mSgroup\033[m");
+
+static Kmem_slab_t<Sched_group> _sched_group_allocator("Sched_group");
+
+PRIVATE inline
+Sched_group::Sched_group(Ram_quota *q, Sched_group *parent, unsigned weight)
+: _parent(parent), _depth(parent ? parent->_depth + 1 : 1), _quota(q)
+{
+  // dropped by put() once the last capability is deleted
+  inc_ref();
+  if (parent)
+    parent->inc_ref();
+
+  for (auto &e: _ent)
+    e.init_group_entity(parent ? parent->_ent : 0, weight);
+}
+
+PUBLIC
+Sched_group::~Sched_group()
+{
+  if (_parent)
+    release(_parent);
+}
+
+PUBLIC inline NEEDS[<cstddef>]
+void *
+Sched_group::operator new (size_t, void *b) throw()
+{ return b; }
+
+PUBLIC
+void
+Sched_group::operator delete (void *_g)
+{
+  Sched_group *g = (Sched_group *)_g;
+  Ram_quota *q = g->_quota;
+  asm ("" : "=m"(*g));
+
+  _sched_group_allocator.free(g);
+  q->free(sizeof(Sched_group));
+}
+
+PUBLIC static
+Sched_group *
+Sched_group::create(Ram_quota *q, Sched_group *parent, unsigned weight)
+{
+  Auto_quota<Ram_quota> quota(q, sizeof(Sched_group));
+  if (EXPECT_FALSE(!quota))
+    return 0;
+
+  void *m = _sched_group_allocator.alloc();
+  if (EXPECT_FALSE(!m))
+    return 0;
+
+  quota.release();
+  return new (m) Sched_group(q, parent, weight);
+}
+
+PUBLIC inline
+unsigned
+Sched_group::depth() const
+{ return _depth; }
+
+PUBLIC
+bool
+Sched_group::put() override
+{ return dec_ref() == 0; }
+
+/**
+ * Drop a reference of a member or a child group.
+ *
+ * Without references the group has neither capabilities nor members, so
+ * none of its entities is queued anywhere and nobody can find it anymore.
+ */
+PUBLIC static
+void
+Sched_group::release(Sched_group *g)
+{
+  if (g->dec_ref() == 0)
+    delete g;
+}
+
+/**
+ * Add a member to this group.
+ *
+ * \return the entities of the group, to be used as the `_group` of the
+ *         member.
+ */
+PUBLIC
+Sched_context *
+Sched_group::join()
+{
+  inc_ref();
+  return _ent;
+}
+
+/**
+ * Remove a member from the group with the entities `ent`.
+ *
+ * \pre The member is not in a ready queue.
+ */
+PUBLIC static
+void
+Sched_group::leave(Sched_context *ent)
+{
+  Sched_group_ents *e = reinterpret_cast<Sched_group_ents *>(ent);
+  release(static_cast<Sched_group *>(e));
+}
+
+PRIVATE
+L4_msg_tag
+Sched_group::sys_set_weight(L4_msg_tag tag, Utcb const *utcb)
+{
+  if (EXPECT_FALSE(tag.words() < 2))
+    return commit_result(-L4_err::EMsgtooshort);
+
+  Mword weight = access_once(&utcb->values[1]);
+  if (weight == 0 || weight != (unsigned)weight)
+    return commit_result(-L4_err::EInval);
+
+  for (auto &e: _ent)
+    e.set_group_weight(weight);
+
+  return commit_result(0);
+}
+
+PUBLIC
+L4_msg_tag
+Sched_group::kinvoke(L4_obj_ref, L4_fpage::Rights rights, Syscall_frame *f,
+                     Utcb const *utcb, Utcb *)
+{
+  L4_msg_tag tag = f->tag();
+
+  if (!Ko::check_basics(&tag, rights, L4_msg_tag::Label_sched_group,
+                        L4_fpage::Rights::CW()))
+    return tag;
+
+  switch (access_once(&utcb->values[0]))
+    {
+    case Op_set_weight:
+      return sys_set_weight(tag, utcb);
+
+    default:
+      return commit_result(-L4_err::ENosys);
+    }
+}
+
+namespace {
+
+/**
+ * Create a group with the weight in values[2], nested in the group passed
+ * as the optional capability.
+ */
+static Kobject_iface * FIASCO_FLATTEN
+sched_group_factory(Ram_quota *q, Space *space,
+                    L4_msg_tag tag, Utcb const *utcb,
+                    int *err)
+{
+  *err = L4_err::EInval;
+  if (EXPECT_FALSE(tag.words() < 3))
+    return 0;
+
+  Mword weight = utcb->values[2];
+  if (weight == 0 || weight != (unsigned)weight)
+    return 0;
+
+  L4_snd_item_iter snd_items(utcb, tag.words());
+  Sched_group *parent = 0;
+
+  if (tag.items() && snd_items.next())
+    {
+      L4_fpage p(snd_items.get()->d);
+      if (EXPECT_FALSE(!p.is_objpage()))
+        return 0;
+
+      L4_fpage::Rights parent_rights = L4_fpage::Rights(0);
+      parent = cxx::dyn_cast<Sched_group*>(space->lookup_local(p.obj_index(),
+                                                              &parent_rights));
+      if (EXPECT_FALSE(!parent))
+        {
+          *err = L4_err::ENoent;
+          return 0;
+        }
+
+      if (parent->depth() >= Ready_queue_wfq<Sched_context>::Max_group_depth)
+        return 0;
+
+      *err = L4_err::EPerm;
+      if (EXPECT_FALSE(!(parent_rights & L4_fpage::Rights::CW())))
+        return 0;
+    }
+
+  *err = L4_err::ENomem;
+  return Sched_group::create(q, parent, weight);
+}
+
+static inline void __attribute__((constructor)) FIASCO_INIT
+register_factory()
+{
+  Kobject_iface::set_factory(L4_msg_tag::Label_sched_group,
+                             sched_group_factory);
+}
+}
@@ -14,6 +14,9 @@ public:
     Info       = 0,
     Run_thread = 1,
     Idle_time  = 2,
+    Stats      = 3,
+    Profile    = 4,
+    Balance    = 6,
   };
 
   static Scheduler scheduler;
@@ -31,6 +34,10 @@ IMPLEMENTATION:
 #include "l4_buf_iter.h"
 #include "l4_types.h"
 #include "entry_frame.h"
+#include "kern_stat.h"
+#include "load_balancer.h"
+#include "minmax.h"
+#include "pmu_sampler.h"
 
 
 JDB_DEFINE_TYPENAME(Scheduler, "\033[34mSched\033[m");
@@ -74,8 +81,13 @@ Scheduler::sys_run(L4_fpage::Rights, Syscall_frame *f, Utcb const *utcb)
 	return commit_result(-L4_err::EInval);
     }
 
+  if (EXPECT_FALSE(!tag.items()))
+    return commit_result(-L4_err::EInval);
+
+  L4_snd_item_iter snd_items(utcb, tag.words());
+  Space *const space = ::current()->space();
   Ko::Rights rights;
-  Thread *thread = Ko::deref<Thread>(&tag, utcb, &rights);
+  Thread *thread = Ko::deref_next<Thread>(&tag, utcb, snd_items, space, &rights);
   if (!thread)
     return tag;
 
@@ -83,7 +95,9 @@ Scheduler::sys_run(L4_fpage::Rights, Syscall_frame *f, Utcb const *utcb)
   Mword _store[sz];
   memcpy(_store, &utcb->values[1], sz * sizeof(Mword));
 
-  L4_sched_param const *sched_param = reinterpret_cast<L4_sched_param const *>(_store);
+  L4_sched_param *sched_param = reinterpret_cast<L4_sched_param *>(_store);
+  if (!get_group(sched_param, &tag, utcb, snd_items, space))
+    return tag;
 
   Thread::Migration info;
 
@@ -105,7 +119,9 @@ Scheduler::sys_run(L4_fpage::Rights, Syscall_frame *f, Utcb const *utcb)
            cxx::int_value<Cpu_number>(sched_param->cpus.offset()),
            cxx::int_value<Order>(sched_param->cpus.granularity()));
 
+  Load_balancer::place(thread, sched_param->cpus);
   thread->migrate(&info);
+  put_group(sched_param);
 
   return commit_result(0);
 }
@@ -122,6 +138,115 @@ Scheduler::op_sched_idle(L4_cpu_set const &cpus, Cpu_time *time)
   return commit_result(0);
 }
 
+/**
+ * Read the Kern_stat statistics of one CPU.
+ *
+ * values[1] holds the CPU set, the first online CPU in it is used,
+ * values[2] selects the block to read, see Kern_stat::read().
+ */
+PRIVATE
+L4_msg_tag
+Scheduler::sys_stats(Syscall_frame *f, Utcb const *iutcb, Utcb *outcb)
+{
+  if (EXPECT_FALSE(f->tag().words() < 3))
+    return commit_result(-L4_err::EMsgtooshort);
+
+  L4_cpu_set const *cpus = reinterpret_cast<L4_cpu_set const *>(&iutcb->values[1]);
+  Cpu_number const cpu = cpus->first(Cpu::online_mask(), Config::max_num_cpus());
+  if (EXPECT_FALSE(cpu == Config::max_num_cpus()))
+    return commit_result(-L4_err::EInval);
+
+  int words = Kern_stat::read(cpu, access_once(&iutcb->values[2]), outcb->values);
+  if (words < 0)
+    return commit_result(words);
+
+  return commit_result(0, words);
+}
+
+/**
+ * Control the PMU sampling session of one CPU.
+ *
+ * values[1] holds the CPU set, the first online CPU in it is used,
+ * the following words are passed to Pmu_sampler::control().
+ */
+PRIVATE
+L4_msg_tag
+Scheduler::sys_profile(Syscall_frame *f, Utcb const *iutcb)
+{
+  if (EXPECT_FALSE(f->tag().words() < 3))
+    return commit_result(-L4_err::EMsgtooshort);
+
+  L4_cpu_set const *cpus = reinterpret_cast<L4_cpu_set const *>(&iutcb->values[1]);
+  Cpu_number const cpu = cpus->first(Cpu::online_mask(), Config::max_num_cpus());
+  if (EXPECT_FALSE(cpu == Config::max_num_cpus()))
+    return commit_result(-L4_err::EInval);
+
+  Mword v[8];
+  unsigned n = min<unsigned>(f->tag().words() - 2, sizeof(v) / sizeof(v[0]));
+  for (unsigned i = 0; i < n; ++i)
+    v[i] = access_once(&iutcb->values[i + 2]);
+
+  return commit_result(Pmu_sampler::control(cpu, v, n));
+}
+
+/**
+ * Control the load balancer.
+ *
+ * values[1] is the Load_balancer::Op. Op_enable takes the period in
+ * microseconds in values[2]. Op_stats takes the CPU set in values[2], the
+ * first online CPU in it is used. Op_pin takes the flag in values[2] and the
+ * thread as capability item.
+ */
+PRIVATE
+L4_msg_tag
+Scheduler::sys_balance(Syscall_frame *f, Utcb const *iutcb, Utcb *outcb)
+{
+  L4_msg_tag tag = f->tag();
+  if (EXPECT_FALSE(tag.words() < 2))
+    return commit_result(-L4_err::EMsgtooshort);
+
+  Mword op = access_once(&iutcb->values[1]);
+  if (op == Load_balancer::Op_disable)
+    return commit_result(Load_balancer::disable());
+
+  if (EXPECT_FALSE(tag.words() < 3))
+    return commit_result(-L4_err::EMsgtooshort);
+
+  switch (op)
+    {
+    case Load_balancer::Op_enable:
+      return commit_result(Load_balancer::enable(access_once(&iutcb->values[2])));
+
+    case Load_balancer::Op_stats:
+        {
+          L4_cpu_set const *cpus
+            = reinterpret_cast<L4_cpu_set const *>(&iutcb->values[2]);
+          Cpu_number const cpu = cpus->first(Cpu::online_mask(), Config::max_num_cpus());
+          if (EXPECT_FALSE(cpu == Config::max_num_cpus()))
+            return commit_result(-L4_err::EInval);
+
+          int words = Load_balancer::read(cpu, outcb->values);
+          if (words < 0)
+            return commit_result(words);
+
+          return commit_result(0, words);
+        }
+
+    case Load_balancer::Op_pin:
+        {
+          Ko::Rights rights;
+          Thread *thread = Ko::deref<Thread>(&tag, iutcb, &rights);
+          if (!thread)
+            return tag;
+
+          return commit_result(Load_balancer::pin(thread, access_once(&iutcb->values[2])));
+        }
+
+    default:
+      return commit_result(-L4_err::ENosys);
+    }
+}
+
 PRIVATE
 L4_msg_tag
 Scheduler::op_sched_info(L4_cpu_set_descr const &s, Mword *m, Mword *max_cpus)
@@ -224,6 +349,71 @@ Scheduler::kinvoke(L4_obj_ref ref, L4_fpage::Rights rights, Syscall_frame *f,
     case Info:       return Msg_sched_info::call(this, f->tag(), iutcb, outcb);
     case Run_thread: return sys_run(rights, f, iutcb);
     case Idle_time:  return Msg_sched_idle::call(this, f->tag(), iutcb, outcb);
+    case Stats:      return sys_stats(f, iutcb, outcb);
+    case Profile:    return sys_profile(f, iutcb);
+    case Balance:    return sys_balance(f, iutcb, outcb);
     default:         return commit_result(-L4_err::ENosys);
     }
 }
+
+// ----------------------------------------------------------------------------
+IMPLEMENTATION [!(sched_wfq || sched_fp_wfq)]:
+
+PRIVATE static inline
+bool
+Scheduler::get_group(L4_sched_param *, L4_msg_tag *, Utcb const *,
+                     L4_snd_item_iter &, Space *)
+{ return true; }
+
+PRIVATE static inline
+void
+Scheduler::put_group(L4_sched_param *)
+{}
+
+// ----------------------------------------------------------------------------
+IMPLEMENTATION [sched_wfq || sched_fp_wfq]:
+
+#include "ready_queue_wfq.h"
+#include "sched_group.h"
+
+/**
+ * Replace the group flag of weighted-fair parameters by the Sched_group
+ * passed as the next capability item, see L4_sched_param_wfq::group.
+ *
+ * The group is referenced until put_group(), the thread takes its own
+ * reference when it joins.
+ */
+PRIVATE static
+bool
+Scheduler::get_group(L4_sched_param *sp, L4_msg_tag *tag, Utcb const *utcb,
+                     L4_snd_item_iter &snd_items, Space *space)
+{
+  if (sp->sched_class != L4_sched_param_wfq::Class)
+    return true;
+
+  L4_sched_param_wfq *p = static_cast<L4_sched_param_wfq *>(sp);
+  if (!p->has_group())
+    return true;
+
+  Ko::Rights rights;
+  Sched_group *g = Ko::deref_next<Sched_group>(tag, utcb, snd_items, space,
+                                               &rights);
+  if (!g)
+    return false;
+
+  g->inc_ref();
+  p->group = reinterpret_cast<Mword>(g);
+  return true;
+}
+
+PRIVATE static
+void
+Scheduler::put_group(L4_sched_param *sp)
+{
+  if (sp->sched_class != L4_sched_param_wfq::Class)
+    return;
+
+  L4_sched_param_wfq *p = static_cast<L4_sched_param_wfq *>(sp);
+  if (p->has_group())
+    Sched_group::release(reinterpret_cast<Sched_group *>(p->group));
+}
@@ -5,12 +5,35 @@ INTERFACE:
 #include "kobject_helper.h"
 #include "prio_list.h"
 
+/**
+ * Counting semaphore, triggered like an IRQ.
+ *
+ * Besides the kernel counter, a semaphore can be used with a counter word
+ * in kernel-user memory of the calling task, which user code updates
+ * atomically without entering the kernel as long as there is no
+ * contention:
+ *
+ * - A positive value is the number of available units, a negative value is
+ *   minus the number of threads that decided to wait.
+ * - down() decrements the word and calls Op_down_user if the old value was
+ *   not positive.
+ * - up() increments the word only if it is not negative, otherwise it
+ *   calls Op_up_user, which increments the word in the kernel and wakes a
+ *   waiter.
+ *
+ * The kernel counter then holds wake-ups for waiters that decremented the
+ * word but did not enter the kernel yet. A waiter that times out or is
+ * canceled increments the word again, so the word stays consistent
+ * without any action of the user.
+ */
 class Semaphore : public Kobject_h<Semaphore, Irq>
 {
 public:
   friend class Jdb_kobject_irq;
   enum Op {
-    Op_down = 0
+    Op_down      = 0,
+    Op_down_user = 1, ///< wait on contention of the counter word in values[1]
+    Op_up_user   = 2, ///< wake a waiter of the counter word in values[1]
   };
 
 protected:
@@ -21,7 +44,9 @@ protected:
 //-----------------------------------------------------------------------------
 IMPLEMENTATION:
 
+#include "atomic.h"
 #include "ipc_timeout.h"
+#include "space.h"
 
 JDB_DEFINE_TYPENAME(Semaphore,  "\033[37mIRQ sem\033[m");
 
@@ -144,9 +169,92 @@ Semaphore::down(Thread *ct)
    return run;
 }
 
+/**
+ * Wait for an up of a counter word, after the caller announced itself as
+ * waiter by decrementing the word.
+ *
+ * \return true if a pending wake-up was consumed and `ct` can run.
+ */
+PRIVATE inline NOEXPORT
+bool
+Semaphore::down_user(Thread *ct)
+{
+  auto g = lock_guard(_waiting.lock());
+  if (_queued > 0)
+    {
+      --_queued;
+      return true;
+    }
+
+  ct->set_partner(sem_partner());
+  ct->state_change_dirty(~Thread_ready, Thread_receive_wait);
+  ct->set_wait_queue(&_waiting);
+  ct->sender_enqueue(&_waiting, ct->sched()->prio());
+  return false;
+}
+
+/// Atomically add `v` to the counter word `c` and return its old value.
+PRIVATE static inline NEEDS["atomic.h"]
+Smword
+Semaphore::fetch_add_user(Smword *c, Smword v)
+{
+  Smword old;
+  do
+    old = access_once(c);
+  while (!mp_cas(c, old, old + v));
+
+  return old;
+}
+
+/**
+ * Count up the counter word `c` and wake a waiter if a thread announced
+ * itself as waiter.
+ */
+PRIVATE inline NOEXPORT
+void
+Semaphore::up_user(Smword *c)
+{
+  Thread *t = 0;
+    {
+      auto g = lock_guard(_waiting.lock());
+      // all waiters may have timed out since the caller looked at the word
+      if (fetch_add_user(c, 1) >= 0)
+        return;
+
+      if (Prio_list_elem *f = _waiting.first())
+        {
+          _waiting.dequeue(f);
+          t = static_cast<Thread*>(Sender::cast(f));
+          t->set_wait_queue(0);
+        }
+      else if (_queued < LONG_MAX)
+        // the waiter did not enter the kernel yet
+        ++_queued;
+    }
+
+  if (t)
+    t->activate();
+}
+
+/**
+ * Look up the counter word at `addr` in kernel-user memory of the current
+ * task.
+ *
+ * \return the kernel alias of the word, or 0 if `addr` is not in
+ *         kernel-user memory or not 8-byte aligned.
+ */
+PRIVATE static
+Smword *
+Semaphore::user_counter(Mword addr)
+{
+  User<Smword>::Ptr u((Smword *)addr);
+  Space::Ku_mem const *m = current()->space()->find_ku_mem(u, sizeof(Smword));
+  return m ? m->kern_addr(u) : 0;
+}
+
 PRIVATE inline NOEXPORT
 L4_msg_tag ALWAYS_INLINE
-Semaphore::sys_down(L4_timeout t, Utcb const *utcb)
+Semaphore::sys_down(L4_timeout t, Utcb const *utcb, Smword *ucount = 0)
 {
   Thread *const c_thread = ::current_thread();
   assert_opt (c_thread);
@@ -157,7 +265,10 @@ Semaphore::sys_down(L4_timeout t, Utcb const *utcb)
                        | Thread_receive_wait
   };
 
-  down(c_thread);
+  if (ucount)
+    down_user(c_thread);
+  else
+    down(c_thread);
 
   IPC_timeout timeout;
 
@@ -173,7 +284,21 @@ Semaphore::sys_down(L4_timeout t, Utcb const *utcb)
   if (s & Thread_wait_mask)
     c_thread->state_del_dirty(Thread_wait_mask);
 
-  if (EXPECT_FALSE(s & (Thread_cancel | Thread_timeout)))
+  if (EXPECT_FALSE(ucount && (s & (Thread_cancel | Thread_timeout))))
+    {
+      // only a waiter that was not woken up withdraws from the counter word
+      auto g = lock_guard(_waiting.lock());
+      if (c_thread->in_sender_list())
+        {
+          c_thread->set_partner(0);
+          c_thread->set_wait_queue(0);
+          _waiting.dequeue(c_thread);
+          fetch_add_user(ucount, 1);
+          return commit_error(utcb, (s & Thread_cancel) ? L4_error::R_canceled
+                                                        : L4_error::R_timeout);
+        }
+    }
+  else if (EXPECT_FALSE(s & (Thread_cancel | Thread_timeout)))
     {
       if (c_thread->in_sender_list())
         {
@@ -210,6 +335,25 @@ Semaphore::kinvoke(L4_obj_ref, L4_fpage::Rights /*rights*/, Syscall_frame *f,
         case Op_down:
           return sys_down(f->timeout().rcv, utcb);
 
+        case Op_down_user:
+        case Op_up_user:
+            {
+              if (EXPECT_FALSE(tag.words() < 2))
+                return commit_result(-L4_err::EMsgtooshort);
+
+              Smword *c = user_counter(access_once(&utcb->values[1]));
+              if (EXPECT_FALSE(!c))
+                return commit_result(-L4_err::EInval);
+
+              if (op == Op_up_user)
+                {
+                  up_user(c);
+                  return commit_result(0);
+                }
+
+              return sys_down(f->timeout().rcv, utcb, c);
+            }
+
         default:
           return commit_result(-L4_err::ENosys);
         }
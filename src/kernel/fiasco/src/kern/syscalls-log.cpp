@@ -45,15 +45,18 @@ IMPLEMENT void FIASCO_FLATTEN sys_ipc_log_wrapper()
       Tb_entry_ipc *tb = EXPECT_TRUE(Jdb_ipc_trace::log_buf())
                        ? Jdb_tbuf::new_entry<Tb_entry_ipc>()
                        : &_local;
-      tb->set(curr, regs->ip(), ipc_regs, utcb,
-	      dbg_id, curr->sched_context()->left());
-
-      entry_event_num = tb->number();
-
-      if (EXPECT_TRUE(Jdb_ipc_trace::log_buf()))
-	Jdb_tbuf::commit_entry();
-      else
-	Jdb_tbuf::direct_log_entry(tb, "IPC");
+      if (tb)
+        {
+          tb->set(curr, regs->ip(), ipc_regs, utcb,
+                  dbg_id, curr->sched_context()->left());
+
+          entry_event_num = tb->number();
+
+          if (EXPECT_TRUE(Jdb_ipc_trace::log_buf()))
+            Jdb_tbuf::commit_entry();
+          else
+            Jdb_tbuf::direct_log_entry(tb, "IPC");
+        }
     }
 
 
@@ -66,13 +69,16 @@ IMPLEMENT void FIASCO_FLATTEN sys_ipc_log_wrapper()
       Tb_entry_ipc_res *tb = static_cast<Tb_entry_ipc_res*>
 	(EXPECT_TRUE(Jdb_ipc_trace::log_buf()) ? Jdb_tbuf::new_entry()
 					    : &_local);
-      tb->set(curr, regs->ip(), ipc_regs, utcb, utcb->error.raw(),
-	      entry_event_num, have_snd, false);
-
-      if (EXPECT_TRUE(Jdb_ipc_trace::log_buf()))
-	Jdb_tbuf::commit_entry();
-      else
-	Jdb_tbuf::direct_log_entry(tb, "IPC result");
+      if (tb)
+        {
+          tb->set(curr, regs->ip(), ipc_regs, utcb, utcb->error.raw(),
+                  entry_event_num, have_snd, false);
+
+          if (EXPECT_TRUE(Jdb_ipc_trace::log_buf()))
+            Jdb_tbuf::commit_entry();
+          else
+            Jdb_tbuf::direct_log_entry(tb, "IPC result");
+        }
     }
 }
 
@@ -100,6 +106,8 @@ IMPLEMENT void FIASCO_FLATTEN sys_ipc_trace_wrapper()
   // kernel is locked here => no Lock_guard <...> needed
   Tb_entry_ipc_trace *tb =
     static_cast<Tb_entry_ipc_trace*>(Jdb_tbuf::new_entry());
+  if (!tb)
+    return;
 
   tb->set(curr, ef->ip(), orig_tsc, snd_dst, regs->from_spec(),
           L4_msg_tag(0,0,0,0), 0, 0);
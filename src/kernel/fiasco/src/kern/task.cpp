@@ -62,10 +62,11 @@ IMPLEMENTATION:
 #include "ram_quota.h"
 #include "thread_state.h"
 #include "paging.h"
+#include "pmu_sampler.h"
 
 JDB_DEFINE_TYPENAME(Task, "\033[31mTask\033[m");
 static Kmem_slab_t<Task::Ku_mem> _k_u_mem_list_alloc("Ku_mem");
-Slab_cache *Space::Ku_mem::a = _k_u_mem_list_alloc.slab();
+Kmem_slab *Space::Ku_mem::a = _k_u_mem_list_alloc.slab();
 
 extern "C" void vcpu_resume(Trap_state *, Return_frame *sp)
    FIASCO_FASTCALL FIASCO_NORETURN;
@@ -288,7 +289,7 @@ Task::Task(Ram_quota *q, Mem_space::Dir_type* pdir, Caps c)
 static Kmem_slab_t<Task> _task_allocator("Task");
 
 PROTECTED static
-Slab_cache*
+Kmem_slab *
 Task::allocator()
 { return _task_allocator.slab(); }
 
@@ -375,6 +376,7 @@ Task::destroy(Kobject ***reap_list)
 {
   Kobject::destroy(reap_list);
 
+  Pmu_sampler::task_destroyed(this);
   fpage_unmap(this, L4_fpage::all_spaces(L4_fpage::Rights::FULL()), L4_map_mask::full(), reap_list);
 }
 
@@ -46,12 +46,18 @@ protected:
     L4_fpage::Rights rights;
     bool timeout;
     bool have_rcv;
+    bool pull;     ///< the receiver has been reserved to pull the message
 
     Thread::Check_sender result;
   };
 
   Syscall_frame *_snd_regs;
   L4_fpage::Rights _ipc_send_rights;
+
+  /// DRQ of the remote sender whose message we have to pull (see
+  /// remote_ipc_send()). Whoever clears it first, the receiver starting to
+  /// pull or the sender giving up, owns the request.
+  Drq *_ipc_pull_rq;
 };
 
 class Buf_utcb_saver
@@ -122,6 +128,7 @@ IMPLEMENTATION:
 #include "config.h"
 #include "cpu_lock.h"
 #include "ipc_timeout.h"
+#include "kern_stat.h"
 #include "lock_guard.h"
 #include "logdefs.h"
 #include "map_util.h"
@@ -473,6 +480,11 @@ Thread::do_ipc(L4_msg_tag const &tag, bool have_send, Thread *partner,
 
   assert (!(state() & Thread_ipc_mask));
 
+  bool const is_call = have_send && have_receive && sender == partner;
+  Kern_stat::Span call_stat(Kern_stat::Hist_ipc_call, is_call);
+  if (is_call)
+    Kern_stat::inc(Kern_stat::Cnt_ipc_call);
+
   prepare_receive(sender, have_receive ? regs : 0);
   bool activate_partner = false;
   Cpu_number current_cpu = ::current_cpu();
@@ -577,19 +589,30 @@ Thread::do_ipc(L4_msg_tag const &tag, bool have_send, Thread *partner,
         next = get_next_sender(sender);
     }
 
-  if (next)
+  for (;;)
     {
-      state_change_dirty(~Thread_ipc_mask, Thread_receive_in_progress);
-      next->ipc_send_msg(this);
-      state_del_dirty(Thread_ipc_mask);
-    }
-  else if (have_receive)
-    {
-      if ((state() & Thread_full_ipc_mask) == Thread_receive_wait)
-        goto_sleep(t.rcv, sender, utcb().access(true));
+      if (next)
+        {
+          state_change_dirty(~Thread_ipc_mask, Thread_receive_in_progress);
+          next->ipc_send_msg(this);
+          state_del_dirty(Thread_ipc_mask);
+        }
+      else if (have_receive)
+        {
+          if ((state() & Thread_full_ipc_mask) == Thread_receive_wait)
+            goto_sleep(t.rcv, sender, utcb().access(true));
+
+          if (sender && sender == partner && partner->caller() == this)
+            partner->reset_caller();
+        }
+
+      // a remote sender reserved us to pull its message items
+      if (EXPECT_TRUE(!(this->state() & Thread_receive_in_progress))
+          || remote_ipc_pull(sender))
+        break;
 
-      if (sender && sender == partner && partner->caller() == this)
-        partner->reset_caller();
+      // the sender gave up before we got to pull, receive again
+      next = get_next_sender(sender);
     }
 
   Mword state = this->state();
@@ -1119,8 +1142,8 @@ Thread::set_ipc_send_rights(L4_fpage::Rights c)
 }
 
 PRIVATE inline NOEXPORT
-bool
-Thread::remote_ipc_send(Ipc_remote_request *rq)
+Context::Drq::Result
+Thread::remote_ipc_send(Drq *src, Ipc_remote_request *rq)
 {
 
 #if 0
@@ -1136,15 +1159,20 @@ Thread::remote_ipc_send(Ipc_remote_request *rq)
          rq->timeout);
 #endif
 
+  // the receiver sits in do_ipc() only if it is in a plain receive wait,
+  // check_sender() may put a vCPU into receive state for an upcall
+  bool rcv_in_ipc = (rq->partner->state() & Thread_ipc_mask)
+                    == Thread_receive_wait;
+
   switch (expect(rq->partner->check_sender(this, rq->timeout), Check_sender::Ok))
     {
     case Check_sender::Failed:
       xcpu_state_change(~Thread_ipc_mask, 0);
       rq->result = Check_sender::Failed;
-      return false;
+      return Drq::done();
     case Check_sender::Queued:
       rq->result = Check_sender::Queued;
-      return false;
+      return Drq::done();
     default:
       break;
     }
@@ -1154,16 +1182,55 @@ Thread::remote_ipc_send(Ipc_remote_request *rq)
           || rq->partner->utcb().access()->inherit_fpu()))
     rq->partner->spill_fpu_if_owner();
 
-  // trigger remote_ipc_receiver_ready path, because we may need to grab locks
-  // and this is forbidden in a DRQ handler. So transfer the IPC in usual
-  // thread code. However, this induces a overhead of two extra IPIs.
+  // Message items may need to grab locks, which is forbidden in a DRQ
+  // handler. In the common case the receiver waits in do_ipc() and we let
+  // it pull the message in its own context: it is made ready right away and
+  // answers our DRQ when done, so the whole send costs a single IPI round
+  // trip. The sender stays blocked in the DRQ meanwhile, keeping its UTCB,
+  // registers, and this request valid. A sender with a zero send timeout
+  // does not wait for the receiver and takes the path below; otherwise the
+  // sender may withdraw the reservation until the receiver starts to pull.
   if (rq->tag.items())
     {
+      if (EXPECT_TRUE(rcv_in_ipc && rq->timeout && !rq->tag.transfer_fpu()
+                      && !_utcb_handler && !rq->partner->_utcb_handler))
+        {
+          Thread *rcv = rq->partner;
+          //LOG_MSG_3VAL(rcv, "rpull", dbg_id(), 0, 0);
+          rcv->_ipc_pull_rq = src;
+          rcv->set_partner(this);
+          rcv->state_change_dirty(~Thread_ipc_mask,
+                                  Thread_receive_in_progress | Thread_ready);
+          if (rcv->home_cpu() == current_cpu() && current() != rcv)
+            Sched_context::rq.current().ready_enqueue(rcv->sched());
+
+          // The sender may give up waiting once it sees `pull`. If its
+          // timeout or cancel came in before it could see `pull`, withdraw
+          // the reservation here; the receiver then just receives again.
+          write_now(&rq->pull, true);
+          Mem::mp_mb();
+          if (EXPECT_FALSE(state() & (Thread_cancel | Thread_timeout))
+              && mp_cas(&rcv->_ipc_pull_rq, src, (Drq *)0))
+            {
+              utcb().access()->error = (state() & Thread_cancel)
+                                       ? L4_error::Canceled
+                                       : L4_error::Timeout;
+              xcpu_state_change(~Thread_ipc_mask, 0);
+              rq->result = Check_sender::Failed;
+              return Drq::need_resched();
+            }
+
+          return Drq::no_answer_resched();
+        }
+
+      // Otherwise trigger the remote_ipc_receiver_ready path and transfer
+      // the IPC in usual sender thread code. However, this induces an
+      // overhead of two extra IPIs.
       //LOG_MSG_3VAL(rq->partner, "pull", dbg_id(), 0, 0);
       xcpu_state_change(~Thread_send_wait, Thread_ready);
       rq->partner->state_change_dirty(~(Thread_ipc_mask | Thread_ready), Thread_ipc_transfer);
       rq->result = Check_sender::Ok;
-      return true;
+      return Drq::need_resched();
     }
   bool success = transfer_msg(rq->tag, rq->partner, rq->regs, _ipc_send_rights);
   if (success && rq->have_rcv)
@@ -1176,7 +1243,7 @@ Thread::remote_ipc_send(Ipc_remote_request *rq)
   if (rq->partner->home_cpu() == current_cpu() && current() != rq->partner)
     Sched_context::rq.current().ready_enqueue(rq->partner->sched());
 
-  return true;
+  return Drq::need_resched();
 }
 
 PRIVATE static
@@ -1184,9 +1251,80 @@ Context::Drq::Result
 Thread::handle_remote_ipc_send(Drq *src, Context *, void *_rq)
 {
   Ipc_remote_request *rq = (Ipc_remote_request*)_rq;
-  bool r = nonull_static_cast<Thread*>(src->context())->remote_ipc_send(rq);
-  //LOG_MSG_3VAL(src, "rse<", current_cpu(), (Mword)src, r);
-  return r ? Drq::need_resched() : Drq::done();
+  //LOG_MSG_3VAL(src, "rse<", current_cpu(), (Mword)src, 0);
+  return nonull_static_cast<Thread*>(src->context())->remote_ipc_send(src, rq);
+}
+
+/**
+ * Receive the message of a remote sender that reserved us in
+ * remote_ipc_send().
+ *
+ * Runs in the receiver's context, so the item transfer may block on the
+ * mapping locks. Finally answers the sender's DRQ, which also delivers the
+ * sender's state change.
+ *
+ * \param sender  The sender we wait for, 0 for an open wait.
+ * \retval true   The message has been received or failed to transfer.
+ * \retval false  The sender gave up before we could pull its message, we
+ *                are in receive wait again.
+ *
+ * \pre cpu_lock must be held
+ */
+PRIVATE
+bool
+Thread::remote_ipc_pull(Sender *sender)
+{
+  assert (cpu_lock.test());
+
+  Drq *drq = access_once(&_ipc_pull_rq);
+  if (EXPECT_FALSE(!drq || !mp_cas(&_ipc_pull_rq, drq, (Drq *)0)))
+    {
+      state_change_dirty(~Thread_ipc_mask, Thread_receive_wait);
+      set_partner(sender);
+      return false;
+    }
+
+  Thread *snd = nonull_static_cast<Thread*>(const_cast<Sender*>(partner()));
+  Ipc_remote_request *rq = (Ipc_remote_request*)drq->arg;
+
+  bool success = snd->transfer_msg(rq->tag, this, rq->regs,
+                                   snd->_ipc_send_rights);
+  if (success && rq->have_rcv)
+    snd->xcpu_state_change(~Thread_send_wait, Thread_receive_wait);
+  else
+    snd->xcpu_state_change(~Thread_ipc_mask, 0);
+
+  rq->result = success ? Check_sender::Done : Check_sender::Failed;
+  state_del_dirty(Thread_ipc_mask);
+  snd->enqueue_drq(drq, Drq::Target_ctxt);
+  return true;
+}
+
+/**
+ * Fail the message of a remote sender that reserved us in
+ * remote_ipc_send() but that we will never pull, because we are being
+ * killed.
+ *
+ * \pre cpu_lock must be held
+ */
+PUBLIC
+void
+Thread::abort_remote_ipc_pull()
+{
+  assert (cpu_lock.test());
+
+  Drq *drq = access_once(&_ipc_pull_rq);
+  if (!drq || !mp_cas(&_ipc_pull_rq, drq, (Drq *)0))
+    return;
+
+  Thread *snd = nonull_static_cast<Thread*>(const_cast<Sender*>(partner()));
+  Ipc_remote_request *rq = (Ipc_remote_request*)drq->arg;
+
+  snd->utcb().access()->error = L4_error::Not_existent;
+  snd->xcpu_state_change(~Thread_ipc_mask, 0);
+  rq->result = Check_sender::Failed;
+  state_del_dirty(Thread_ipc_mask);
+  snd->enqueue_drq(drq, Drq::Target_ctxt);
 }
 
 /**
@@ -1207,6 +1345,7 @@ Thread::remote_handshake_receiver(L4_msg_tag const &tag, Thread *partner,
   rq.have_rcv = have_receive;
   rq.partner = partner;
   rq.timeout = !snd_t.is_zero();
+  rq.pull = false;
   rq.regs = regs;
   rq.rights = rights;
   _snd_regs = regs;
@@ -1218,7 +1357,45 @@ Thread::remote_handshake_receiver(L4_msg_tag const &tag, Thread *partner,
   if (tag.transfer_fpu())
     spill_fpu_if_owner();
 
-  partner->drq(handle_remote_ipc_send, &rq);
+  // The send timeout also bounds the time we wait for a reserved receiver
+  // to pull our message, which depends on the receiver's priority.
+  IPC_timeout timeout;
+  if (EXPECT_FALSE(snd_t.is_finite() && !snd_t.is_zero()))
+    {
+      Unsigned64 tval = snd_t.microsecs(Timer::system_clock(),
+                                        utcb().access(true));
+      if (tval)
+        set_timeout(&timeout, tval);
+      else
+        state_add_dirty(Thread_timeout);
+    }
+
+  // give up if the receiver was reserved and did not start to pull our
+  // message before the timeout or a cancel hit
+  Drq *drq = own_drq();
+  partner->drq(drq, handle_remote_ipc_send, &rq,
+               Drq::Target_ctxt, Drq::Wait,
+               [this, partner, drq, &rq]()
+    {
+      Mem::mp_mb();
+      if (EXPECT_TRUE(!(state() & (Thread_cancel | Thread_timeout)))
+          || !access_once(&rq.pull)
+          || !mp_cas(&partner->_ipc_pull_rq, drq, (Drq *)0))
+        return false;
+
+      utcb().access(true)->error = (state() & Thread_cancel)
+                                   ? L4_error::Canceled
+                                   : L4_error::Timeout;
+      state_del_dirty(Thread_cancel | Thread_timeout);
+      rq.result = Check_sender::Failed;
+      return true;
+    });
+
+  reset_timeout();
+
+  // a queued sender keeps an expired timeout for do_send_wait()
+  if (rq.result != Check_sender::Queued)
+    state_del_dirty(Thread_timeout);
 
   return rq.result;
 }
@@ -28,6 +28,9 @@ Thread::page_fault_log(Address pfa, unsigned error_code, unsigned long eip)
       Tb_entry_pf *tb = static_cast<Tb_entry_pf*>
 	(EXPECT_TRUE(Jdb_pf_trace::log_buf()) ? Jdb_tbuf::new_entry()
 				    : &_local);
+      if (!tb)
+        return;
+
       tb->set(this, eip, pfa, error_code, current()->space());
 
       if (EXPECT_TRUE(Jdb_pf_trace::log_buf()))
@@ -5,6 +5,7 @@ IMPLEMENTATION:
 #include "config.h"
 #include "cpu.h"
 #include "kdb_ke.h"
+#include "kern_stat.h"
 #include "kmem.h"
 #include "logdefs.h"
 #include "processor.h"
@@ -29,7 +30,8 @@ IMPLEMENTATION:
  */
 IMPLEMENT inline NEEDS[<cstdio>,"kdb_ke.h","processor.h",
 		       "config.h","std_macros.h","logdefs.h",
-		       "warn.h",Thread::page_fault_log, "paging.h"]
+		       "warn.h",Thread::page_fault_log, "paging.h",
+		       "kern_stat.h"]
 int Thread::handle_page_fault(Address pfa, Mword error_code, Mword pc,
                               Return_frame *regs)
 {
@@ -55,6 +57,7 @@ int Thread::handle_page_fault(Address pfa, Mword error_code, Mword pc,
 
 
   CNT_PAGE_FAULT;
+  Kern_stat::inc(Kern_stat::Cnt_page_fault);
 
   // TODO: put this into a debug_page_fault_handler
   if (EXPECT_FALSE(log_page_fault()))
@@ -80,8 +83,11 @@ int Thread::handle_page_fault(Address pfa, Mword error_code, Mword pc,
         }
 
       // user mode page fault -- send pager request
-      if (handle_page_fault_pager(_pager, pfa, error_code,
-                                  L4_msg_tag::Label_page_fault))
+      Kern_stat::Stamp pf_start = Kern_stat::stamp();
+      bool handled = handle_page_fault_pager(_pager, pfa, error_code,
+                                             L4_msg_tag::Label_page_fault);
+      Kern_stat::record(Kern_stat::Hist_page_fault, pf_start);
+      if (handled)
         return 1;
 
       goto error;
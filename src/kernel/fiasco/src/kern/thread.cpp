@@ -55,6 +55,7 @@ public:
     Op_vcpu_control = 7,
     Op_gdt_x86 = 0x10,
     Op_set_tpidruro_arm = 0x10,
+    Op_pmu_arm = 0x11,
     Op_set_segment_base_amd64 = 0x12,
     Op_segment_info_amd64 = 0x13,
   };
@@ -257,7 +258,9 @@ Thread::unbind()
 
   if (old)
     {
-      current()->rcu_wait();
+      Rcu::account_pending(1);
+      current()->rcu_wait(true);
+      Rcu::account_pending(-1);
       delete old;
     }
 
@@ -302,6 +305,7 @@ Thread::~Thread()		// To be called in locked state.
   *--init_sp = 0;
   Fpu_alloc::free_state(fpu_state());
   assert (!in_ready_list());
+  sched_context()->leave_group();
 }
 
 // IPC-gate deletion stuff ------------------------------------
@@ -393,7 +397,7 @@ Thread::continuation_test_and_restore()
 // state requests/manipulation
 //
 
-PUBLIC inline NEEDS ["config.h", "timeout.h"]
+PUBLIC inline NEEDS ["config.h", "load_balancer.h", "timeout.h"]
 void
 Thread::handle_timer_interrupt()
 {
@@ -402,11 +406,15 @@ Thread::handle_timer_interrupt()
   if (!Config::Fine_grained_cputime)
     consume_time(Config::Scheduler_granularity);
 
+  fold_pmu();
+
   bool resched = Rcu::do_pending_work(_cpu);
+  resched |= Timeout_q::timeout_queue.cpu(_cpu).do_timeouts();
+  // migrating the current thread must wait until the timeouts are done
+  resched |= Load_balancer::push();
 
   // Check if we need to reschedule due to timeouts or wakeups
-  if ((Timeout_q::timeout_queue.cpu(_cpu).do_timeouts() || resched)
-      && !Sched_context::rq.current().schedule_in_progress)
+  if (resched && !Sched_context::rq.current().schedule_in_progress)
     {
       schedule();
       assert (timeslice_timeout.cpu(current_cpu())->is_set());	// Coma check
@@ -532,6 +540,9 @@ Thread::do_kill()
         s->ipc_receiver_aborted();
         Proc::preemption_point();
       }
+
+    // a remote sender may wait for us to pull its message
+    abort_remote_ipc_pull();
   }
 
   // if engaged in IPC operation, stop it
@@ -729,7 +740,8 @@ Thread::start_migration()
 
   if (m->cpu == home_cpu())
     {
-      set_sched_params(m->sp);
+      if (m->sp)
+        set_sched_params(m->sp);
       Mem::mp_mb();
       write_now(&m->in_progress, true);
       return reinterpret_cast<Migration*>(0x1); // bit one == 1 --> need to reschedule
@@ -1007,7 +1019,9 @@ Thread::migrate_away(Migration *inf, bool remote)
     }
 
   Sched_context *sc = sched_context();
-  sc->set(inf->sp);
+  // without parameters, as from the load balancer, keep the current ones
+  if (inf->sp)
+    sc->set(inf->sp);
   sc->replenish();
   set_sched(sc);
 
@@ -1084,11 +1098,91 @@ protected:
 };
 
 
+// ----------------------------------------------------------------------------
+INTERFACE [mp]:
+
+#include "cpu_mask.h"
+
+EXTENSION class Thread
+{
+private:
+  /// CPUs the load balancer may move this thread to, empty if none.
+  Cpu_mask _balance_cpus;
+  bool _balance_pinned = false;
+};
+
 // ----------------------------------------------------------------------------
 IMPLEMENTATION [mp]:
 
 #include "ipi.h"
 
+/**
+ * Set the CPUs the load balancer may move this thread to.
+ *
+ * Threads placed on a single CPU are never moved.
+ */
+PUBLIC
+void
+Thread::set_balance_cpus(L4_cpu_set const &cpus)
+{
+  Cpu_mask m;
+  unsigned n = 0;
+  for (Cpu_number i = Cpu_number::first(); i < Config::max_num_cpus(); ++i)
+    if (cpus.contains(i))
+      {
+        m.set(i);
+        ++n;
+      }
+
+  _balance_cpus = n > 1 ? m : Cpu_mask();
+}
+
+PUBLIC inline
+Cpu_mask const &
+Thread::balance_cpus() const
+{ return _balance_cpus; }
+
+PUBLIC inline
+void
+Thread::set_balance_pinned(bool pinned)
+{ write_now(&_balance_pinned, pinned); }
+
+PUBLIC inline
+bool
+Thread::balance_pinned() const
+{ return access_once(&_balance_pinned); }
+
+/**
+ * Move this thread to `m->cpu` on behalf of the load balancer, keeping its
+ * scheduling parameters.
+ *
+ * \pre This is the current thread of its home CPU, which is the current
+ *      CPU, and `m->sp` is 0. Not called from a timeout, this may switch
+ *      to the kernel context.
+ * \param[out] resched  set if a reschedule is necessary.
+ * \return false if another migration of the thread is pending.
+ */
+PUBLIC
+bool
+Thread::balance_to(Migration *m, bool *resched)
+{
+  assert (cpu_lock.test());
+  assert (!m->sp);
+
+  if (!mp_cas(&_migration, (Migration *)0, m))
+    return false;
+
+  LOG_TRACE("Thread migration", "mig", this, Migration_log,
+      l->state = state(false);
+      l->src_cpu = home_cpu();
+      l->target_cpu = m->cpu;
+      l->user_ip = regs()->ip();
+  );
+
+  *resched = do_migration();
+  return true;
+}
+
 PUBLIC
 void
 Thread::migrate(Migration *info)
@@ -1234,7 +1328,9 @@ Thread::migrate_away(Migration *inf, bool remote)
         check (q.dequeue(&_pending_rq, Queue_item::Ok));
 
       Sched_context *sc = sched_context();
-      sc->set(inf->sp);
+      // without parameters, as from the load balancer, keep the current ones
+      if (inf->sp)
+        sc->set(inf->sp);
       sc->replenish();
       set_sched(sc);
 
@@ -44,16 +44,28 @@ private:
 };
 
 
+/**
+ * Per-CPU queue of timeouts, organized as a hierarchical timing wheel.
+ *
+ * Level 0 has one bucket per tick (2^Wheel_tick_shift us), each further
+ * level covers Wheel_slots buckets of the level below. A timeout is put
+ * into the lowest level that can hold its wakeup time, so arming and
+ * cancelling are O(1). Whenever level 0 wraps around the next bucket of
+ * level 1 is cascaded down (and so on for the higher levels). Timeouts
+ * beyond the range of the highest level are kept in an overflow list that
+ * is re-examined whenever the highest level wraps around.
+ */
 class Timeout_q
 {
 private:
-  /**
-   * Timeout queue count (2^n) and  distance between two queues in 2^n.
-   */
   enum
   {
-    Wakeup_queue_count	  = 8,
-    Wakeup_queue_distance = 12 // i.e. (1<<12)us
+    Wheel_tick_shift = 10, // i.e. (1<<10)us per level-0 bucket
+    Wheel_slot_bits  = 6,
+    Wheel_slots      = 1 << Wheel_slot_bits,
+    Wheel_slot_mask  = Wheel_slots - 1,
+    Wheel_levels     = 4,
+    Wheel_queues     = Wheel_levels * Wheel_slots + 1, // + overflow list
   };
 
   typedef Timeout::To_list To_list;
@@ -61,15 +73,26 @@ private:
   typedef To_list::Const_iterator Const_iterator;
 
   /**
-   * The timeout queues.
+   * The timeout buckets, followed by the overflow list.
    */
-  To_list _q[Wakeup_queue_count];
+  To_list _q[Wheel_queues];
+
+  /**
+   * Per level, one bit per bucket that may be non-empty. A bit may be
+   * stale after Timeout::reset() removed the last entry of a bucket, it is
+   * cleared the next time the bucket is processed.
+   */
+  Unsigned64 _occupied[Wheel_levels];
 
   /**
    * The current programmed timeout.
    */
   Unsigned64 _current;
-  Unsigned64 _old_clock;
+
+  /**
+   * The level-0 tick up to which the wheel has been processed.
+   */
+  Unsigned64 _tick;
 
 public:
   static Per_cpu<Timeout_q> timeout_queue;
@@ -92,37 +115,72 @@ IMPLEMENTATION:
 DEFINE_PER_CPU Per_cpu<Timeout_q> Timeout_q::timeout_queue;
 
 
+/**
+ * Get a timeout list by its flat index.
+ *
+ * The buckets of all levels are numbered consecutively, the overflow list
+ * comes last.
+ */
 PUBLIC inline
 Timeout_q::To_list &
 Timeout_q::first(int index)
-{ return _q[index & (Wakeup_queue_count-1)]; }
+{ return _q[(unsigned)index % Wheel_queues]; }
 
 PUBLIC inline
 Timeout_q::To_list const &
 Timeout_q::first(int index) const
-{ return _q[index & (Wakeup_queue_count-1)]; }
+{ return _q[(unsigned)index % Wheel_queues]; }
 
 PUBLIC inline
 unsigned
-Timeout_q::queues() const { return Wakeup_queue_count; }
+Timeout_q::queues() const { return Wheel_queues; }
 
+PRIVATE inline
+Timeout_q::To_list &
+Timeout_q::bucket(unsigned level, unsigned slot)
+{ return _q[level * Wheel_slots + slot]; }
+
+PRIVATE inline
+Timeout_q::To_list &
+Timeout_q::overflow()
+{ return _q[Wheel_queues - 1]; }
 
 /**
- * Enqueue a new timeout.
+ * Put a timeout into the lowest wheel level that covers its wakeup time.
  */
-PUBLIC inline NEEDS[Timeout_q::first, "timer.h", "config.h"]
+PRIVATE inline NEEDS[Timeout_q::bucket, Timeout_q::overflow]
 void
-Timeout_q::enqueue(Timeout *to)
+Timeout_q::insert(Timeout *to)
 {
-  int queue = (to->_wakeup >> Wakeup_queue_distance) & (Wakeup_queue_count-1);
+  Unsigned64 t = to->_wakeup >> Wheel_tick_shift;
 
-  To_list &q = first(queue);
-  Iterator tmp = q.begin();
+  // timeouts in the past go into the current bucket
+  if (t < _tick)
+    t = _tick;
 
-  while (tmp != q.end() && tmp->_wakeup < to->_wakeup)
-    ++tmp;
+  for (unsigned l = 0; l < Wheel_levels; ++l)
+    {
+      unsigned shift = l * Wheel_slot_bits;
+      if ((t >> shift) - (_tick >> shift) < Wheel_slots)
+        {
+          unsigned slot = (t >> shift) & Wheel_slot_mask;
+          bucket(l, slot).push_front(to);
+          _occupied[l] |= Unsigned64(1) << slot;
+          return;
+        }
+    }
 
-  q.insert_before(to, tmp);
+  overflow().push_front(to);
+}
+
+/**
+ * Enqueue a new timeout.
+ */
+PUBLIC inline NEEDS[Timeout_q::insert, "timer.h", "config.h"]
+void
+Timeout_q::enqueue(Timeout *to)
+{
+  insert(to);
 
   if (Config::Scheduler_one_shot && (to->_wakeup <= _current))
     {
@@ -263,113 +321,280 @@ Timeout::dequeue(bool is_expired = true)
 }
 
 /**
- * Handles the timeouts, i.e. call expired() for the expired timeouts
- * and programs the "oneshot timer" to the next timeout.
+ * Move all timeouts of the current bucket of the given level (and, if
+ * that level wrapped around, of the levels above) down the wheel.
+ */
+PRIVATE
+void
+Timeout_q::cascade(unsigned level)
+{
+  if (level == Wheel_levels)
+    {
+      To_list l;
+      while (!overflow().empty())
+        l.push_front(overflow().pop_front());
+
+      while (!l.empty())
+        insert(l.pop_front());
+
+      return;
+    }
+
+  unsigned slot = (_tick >> (level * Wheel_slot_bits)) & Wheel_slot_mask;
+
+  // the higher level must be cascaded first, it may refill this bucket
+  if (slot == 0)
+    cascade(level + 1);
+
+  if (!(_occupied[level] & (Unsigned64(1) << slot)))
+    return;
+
+  _occupied[level] &= ~(Unsigned64(1) << slot);
+
+  To_list &b = bucket(level, slot);
+  To_list l;
+  while (!b.empty())
+    l.push_front(b.pop_front());
+
+  while (!l.empty())
+    {
+      stat_cascaded();
+      insert(l.pop_front());
+    }
+}
+
+/**
+ * Expire all timeouts of the current level-0 bucket that are due.
  * @return true if a reschedule is necessary, false otherwise.
  */
-PUBLIC inline NEEDS [<cassert>, <climits>, "kip.h", "timer.h", "config.h",
-                     Timeout::expire]
+PRIVATE inline NEEDS[Timeout::expire, Timeout_q::bucket, Timeout_q::stat_expired]
 bool
-Timeout_q::do_timeouts()
+Timeout_q::expire_bucket(Unsigned64 clock)
 {
+  unsigned slot = _tick & Wheel_slot_mask;
+  if (!(_occupied[0] & (Unsigned64(1) << slot)))
+    return false;
+
   bool reschedule = false;
+  To_list &q = bucket(0, slot);
+  Iterator timeout = q.begin();
 
-  // We test if the time between 2 activiations of this function is greater
-  // than the distance between two timeout queues.
-  // To avoid to lose timeouts, we calculating the missed queues and
-  // scan them too.
-  // This can only happen, if we dont enter the timer interrupt for a long
-  // time, usual with one shot timer.
-  // Because we initalize old_dequeue_time with zero,
-  // we can get an "miss" on the first timerinterrupt.
-  // But this is booting the system, which is uncritical.
+  while (timeout != q.end())
+    {
+      if (timeout->_wakeup > clock)
+        {
+          ++timeout;
+          continue;
+        }
 
-  // Calculate which timeout queues needs to be checked.
-  int start = (_old_clock >> Wakeup_queue_distance);
-  int diff  = (Kip::k()->clock >> Wakeup_queue_distance) - start;
-  int end   = (start + diff + 1) & (Wakeup_queue_count - 1);
+      Timeout *to = *timeout;
+      timeout = q.erase(timeout);
+      stat_expired(clock - to->_wakeup);
+      reschedule |= to->expire();
+    }
 
-  // wrap around
-  start = start & (Wakeup_queue_count - 1);
+  if (q.empty())
+    _occupied[0] &= ~(Unsigned64(1) << slot);
 
-  // test if an complete miss
-  if (diff >= Wakeup_queue_count)
-    start = end = 0; // scan all queues
+  return reschedule;
+}
 
-  // update old_clock for the next run
-  _old_clock = Kip::k()->clock;
+/**
+ * Check whether timeouts may be waiting in the levels above level 0.
+ */
+PRIVATE inline NEEDS[Timeout_q::overflow]
+bool
+Timeout_q::have_upper_timeouts()
+{
+  for (unsigned l = 1; l < Wheel_levels; ++l)
+    if (_occupied[l])
+      return true;
 
-  // ensure we always terminate
-  assert((end >= 0) && (end < Wakeup_queue_count));
+  return !overflow().empty();
+}
 
-  for (;;)
-    {
-      To_list &q = first(start);
-      Iterator timeout = q.begin();
+/**
+ * Compute the next point in time the wheel needs attention, i.e., the
+ * earliest wakeup in the next non-empty level-0 bucket, but not later than
+ * the next cascade if the upper levels hold timeouts. Buckets behind the
+ * current slot belong to the next round of level 0, which starts with
+ * that cascade.
+ */
+PRIVATE
+Unsigned64
+Timeout_q::next_event()
+{
+  Unsigned64 cascade = ((_tick | Wheel_slot_mask) + 1) << Wheel_tick_shift;
+  Unsigned64 occ = _occupied[0];
+  unsigned slot = _tick & Wheel_slot_mask;
 
-      // now scan this queue for timeouts below current clock
-      while (timeout != q.end() && timeout->_wakeup <= (Kip::k()->clock))
+  // rotate so that the current bucket is bit 0
+  occ = (occ >> slot) | (slot ? occ << (Wheel_slots - slot) : 0);
+
+  while (occ)
+    {
+      unsigned d = __builtin_ctzll(occ);
+      To_list &q = bucket(0, (slot + d) & Wheel_slot_mask);
+      if (!q.empty())
         {
-          Timeout *to = *timeout;
-          timeout = q.erase(timeout);
-          reschedule |= to->expire();
+          Unsigned64 m = have_upper_timeouts() ? cascade : ~Unsigned64(0);
+          for (Iterator i = q.begin(); i != q.end(); ++i)
+            if (i->_wakeup < m)
+              m = i->_wakeup;
+          return m;
         }
+      occ &= ~(Unsigned64(1) << d);
+    }
 
-      // next queue
-      start = (start + 1) & (Wakeup_queue_count - 1);
+  return cascade;
+}
 
-      if (start == end)
-	break;
-    }
+/**
+ * Handles the timeouts, i.e. call expired() for the expired timeouts
+ * and programs the "oneshot timer" to the next timeout.
+ * @return true if a reschedule is necessary, false otherwise.
+ */
+PUBLIC inline NEEDS [<cassert>, <climits>, "kip.h", "timer.h", "config.h",
+                     Timeout_q::expire_bucket]
+bool
+Timeout_q::do_timeouts()
+{
+  bool reschedule = false;
+  Unsigned64 clock = Kip::k()->clock;
+  Unsigned64 now = clock >> Wheel_tick_shift;
 
-  if (Config::Scheduler_one_shot)
+  // If we did not run for a while (usually with the one-shot timer) the
+  // wheel has to catch up. Empty level-0 buckets are skipped, so this
+  // takes at most one step per level-0 wrap-around.
+  for (;;)
     {
-      // scan all queues for the next minimum
-      //_current = (Unsigned64) ULONG_LONG_MAX;
-      _current = Kip::k()->clock + 10000; //ms
-      bool update_timer = true;
+      reschedule |= expire_bucket(clock);
 
-      for (int i = 0; i < Wakeup_queue_count; i++)
-	{
-	  // make sure that something enqueued other than the dummy element
-	  if (first(i).empty())
-	    continue;
+      if (_tick >= now)
+        break;
 
-	  update_timer = true;
+      unsigned slot = _tick & Wheel_slot_mask;
+      Unsigned64 next = (_tick | Wheel_slot_mask) + 1;
+      Unsigned64 occ = slot == Wheel_slot_mask
+                       ? 0 : _occupied[0] & (~Unsigned64(0) << (slot + 1));
+      if (occ)
+        next = (_tick & ~Unsigned64(Wheel_slot_mask)) + __builtin_ctzll(occ);
 
-	  if (first(i).front()->_wakeup < _current)
-	    _current =  first(i).front()->_wakeup;
-	}
+      _tick = next < now ? next : now;
 
-      if (update_timer)
-	Timer::update_timer(_current);
+      if (!(_tick & Wheel_slot_mask))
+        cascade(1);
+    }
 
+  if (Config::Scheduler_one_shot)
+    {
+      _current = next_event();
+      if (_current > clock + 10000) //ms
+        _current = clock + 10000;
+
+      Timer::update_timer(_current);
     }
   return reschedule;
 }
 
 PUBLIC inline
 Timeout_q::Timeout_q()
-: _current(ULONG_LONG_MAX), _old_clock(0)
-{}
+: _current(ULONG_LONG_MAX), _tick(0)
+{
+  for (unsigned i = 0; i < Wheel_levels; ++i)
+    _occupied[i] = 0;
+}
 
-PUBLIC inline
+PRIVATE static inline
+bool
+Timeout_q::have_timeouts(To_list const &t, Timeout const *ignore)
+{
+  if (t.empty())
+    return false;
+
+  To_list::Const_iterator f = t.begin();
+  return *f != ignore || (++f) != t.end();
+}
+
+PUBLIC inline NEEDS[Timeout_q::have_timeouts]
 bool
 Timeout_q::have_timeouts(Timeout const *ignore) const
 {
-  for (unsigned i = 0; i < Wakeup_queue_count; ++i)
+  for (unsigned l = 0; l < Wheel_levels; ++l)
+    for (Unsigned64 occ = _occupied[l]; occ; occ &= occ - 1)
+      if (have_timeouts(_q[l * Wheel_slots + __builtin_ctzll(occ)], ignore))
+        return true;
+
+  return have_timeouts(_q[Wheel_queues - 1], ignore);
+}
+
+/**
+ * Number of timeouts and of non-empty buckets on the given wheel level,
+ * level Wheel_levels denotes the overflow list.
+ */
+PUBLIC
+void
+Timeout_q::level_occupancy(unsigned level, unsigned *buckets,
+                           unsigned *timeouts) const
+{
+  unsigned n = level < Wheel_levels ? (unsigned)Wheel_slots : 1;
+  *buckets = 0;
+  *timeouts = 0;
+
+  for (unsigned i = 0; i < n; ++i)
     {
-      To_list const &t = first(i);
-      if (!t.empty())
-        {
-          To_list::Const_iterator f = t.begin();
-          if (*f == ignore && (++f) == t.end())
-            continue;
+      To_list const &t = first(level * Wheel_slots + i);
+      if (t.empty())
+        continue;
 
-          return true;
-        }
+      ++*buckets;
+      for (Const_iterator c = t.begin(); c != t.end(); ++c)
+        ++*timeouts;
     }
+}
 
-  return false;
+PUBLIC static inline
+unsigned
+Timeout_q::levels()
+{ return Wheel_levels; }
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [!debug]:
+
+PRIVATE inline
+void
+Timeout_q::stat_expired(Unsigned64)
+{}
+
+PRIVATE inline
+void
+Timeout_q::stat_cascaded()
+{}
+
+// ------------------------------------------------------------------------
+IMPLEMENTATION [debug]:
+
+EXTENSION class Timeout_q
+{
+private:
+  friend class Jdb_list_timeouts;
+  Mword _stat_expired;
+  Mword _stat_cascaded;
+  Unsigned64 _stat_lag_sum;
+  Unsigned64 _stat_lag_max;
+};
+
+PRIVATE inline
+void
+Timeout_q::stat_expired(Unsigned64 lag)
+{
+  ++_stat_expired;
+  _stat_lag_sum += lag;
+  if (lag > _stat_lag_max)
+    _stat_lag_max = lag;
 }
 
+PRIVATE inline
+void
+Timeout_q::stat_cascaded()
+{ ++_stat_cascaded; }
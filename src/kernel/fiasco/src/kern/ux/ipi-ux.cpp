@@ -56,6 +56,20 @@ Ipi::bcast(Message m, Cpu_number from_cpu)
       Pic::send_ipi(i, m);
 }
 
+PUBLIC static
+unsigned
+Ipi::send_mcast(Message m, Cpu_number from_cpu, Cpu_mask const &to)
+{
+  unsigned sent = 0;
+  for (Cpu_number n = Cpu_number::first(); n < Config::max_num_cpus(); ++n)
+    if (to.get(n))
+      {
+        send(m, from_cpu, n);
+        ++sent;
+      }
+  return sent;
+}
+
 PUBLIC static
 unsigned long
 Ipi::gate(unsigned char data)
@@ -0,0 +1,19 @@
+INTERFACE:
+
+class Ram_quota;
+
+/**
+ * Minimal Space for the mapdb tests: the mapping database only needs
+ * an identity to store in mappings and a quota to charge them to.
+ */
+class Space
+{
+public:
+  explicit Space(Ram_quota *q) : _quota(q) {}
+  Ram_quota *ram_quota() const { return _quota; }
+
+private:
+  Ram_quota *_quota;
+};
+
+IMPLEMENTATION:
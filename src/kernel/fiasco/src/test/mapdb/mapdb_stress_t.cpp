@@ -0,0 +1,166 @@
+IMPLEMENTATION:
+
+/*
+ * Mapping-database stress test.
+ *
+ * Every physical frame gets more children than Index_min_size_id
+ * entries, so all lookups below go through the hint index of
+ * Mapping_tree.  The children are then granted and flushed in a
+ * scrambled order, which moves and drops index entries, and every
+ * surviving mapping is looked up again after each round.
+ */
+
+#include <cassert>
+#include <cstdio>
+
+#include "mapdb.h"
+#include "mapping_tree.h"
+#include "ram_quota.h"
+#include "space.h"
+
+enum
+{
+  Page_shift  = 12,
+  Phys_frames = 4,
+  Children    = 96,	// > 64 entries: the tree gets an index
+  Rounds      = 16,
+};
+
+struct Test_quota : public Ram_quota {};
+
+static Test_quota quota;
+static Space sigma0(&quota);
+static Space *spaces[Children];
+
+/// Virtual address of child `nr` of `frame` after `round` grants; unique
+/// per (nr, frame, round), so no two live mappings share a key.
+static Mapdb::Pfn va_of(unsigned nr, unsigned frame, unsigned round)
+{
+  return Mapdb::Pfn((Address(round * Children + nr) * Phys_frames
+                     + frame + Phys_frames) << Page_shift);
+}
+
+static Mapdb::Pfn phys_of(unsigned frame)
+{ return Mapdb::Pfn(Address(frame) << Page_shift); }
+
+static Mapdb::Pcnt page_size()
+{ return Mapdb::Pcnt(Address(1) << Page_shift); }
+
+/// Round of the last grant and current owner of each child.
+static unsigned where[Children][Phys_frames];
+static unsigned owner[Children][Phys_frames];
+static bool alive[Children][Phys_frames];
+
+static unsigned next_rand()
+{
+  static unsigned s = 0x2545f491;
+  s = s * 1103515245 + 12345;
+  return s >> 8;
+}
+
+static void
+check_all(Mapdb *mapdb, unsigned frame)
+{
+  for (unsigned i = 0; i < Children; ++i)
+    {
+      Mapping *m;
+      Mapdb::Frame f;
+      Space *s = spaces[owner[i][frame]];
+      Mapdb::Pfn va = va_of(i, frame, where[i][frame]);
+      bool found = mapdb->lookup(s, va, phys_of(frame), &m, &f);
+
+      // flushed mappings must be gone from the index as well
+      assert (found == alive[i][frame]);
+      if (!found)
+        continue;
+
+      assert (m->space() == s);
+      assert (Mapdb::vaddr(f, m) == va);
+      Mapdb::free(f);
+    }
+}
+
+int
+main()
+{
+  static size_t const page_shifts[] = { Page_shift };
+  Mapdb *mapdb = new Mapdb(&sigma0, Mapping::Page(Phys_frames),
+                           page_shifts, 1);
+
+  for (unsigned i = 0; i < Children; ++i)
+    spaces[i] = new Space(&quota);
+
+  // Populate: one insert per lookup()/free() cycle, as the API demands.
+  for (unsigned frame = 0; frame < Phys_frames; ++frame)
+    for (unsigned i = 0; i < Children; ++i)
+      {
+        Mapping *root;
+        Mapdb::Frame f;
+
+        bool found = mapdb->lookup(&sigma0, phys_of(frame), phys_of(frame),
+                                   &root, &f);
+        assert (found);
+        Mapping *m = mapdb->insert(f, root, spaces[i], va_of(i, frame, 0),
+                                   phys_of(frame), page_size());
+        assert (m);
+        Mapdb::free(f);
+
+        where[i][frame] = 0;
+        owner[i][frame] = i;
+        alive[i][frame] = true;
+      }
+
+  for (unsigned frame = 0; frame < Phys_frames; ++frame)
+    check_all(mapdb, frame);
+
+  printf("mapdb: %u frames x %u children inserted\n",
+         (unsigned)Phys_frames, (unsigned)Children);
+
+  // Grant and flush in random order, re-checking every survivor.
+  unsigned granted = 0, flushed = 0;
+  for (unsigned round = 1; round < Rounds; ++round)
+    {
+      for (unsigned frame = 0; frame < Phys_frames; ++frame)
+        for (unsigned n = 0; n < Children / 4; ++n)
+          {
+            unsigned i = next_rand() % Children;
+            if (!alive[i][frame])
+              continue;
+
+            Mapping *m;
+            Mapdb::Frame f;
+            Mapdb::Pfn va = va_of(i, frame, where[i][frame]);
+
+            bool found = mapdb->lookup(spaces[owner[i][frame]], va,
+                                       phys_of(frame), &m, &f);
+            assert (found);
+
+            if (next_rand() % 8 == 0)
+              {
+                Mapdb::flush(f, m, L4_map_mask::full(), va, va + page_size());
+                alive[i][frame] = false;
+                ++flushed;
+              }
+            else
+              {
+                unsigned no = next_rand() % Children;
+                bool ok = mapdb->grant(f, m, spaces[no], va_of(i, frame, round));
+                assert (ok);
+                owner[i][frame] = no;
+                where[i][frame] = round;
+                ++granted;
+              }
+
+            Mapdb::free(f);
+          }
+
+      for (unsigned frame = 0; frame < Phys_frames; ++frame)
+        check_all(mapdb, frame);
+    }
+
+  printf("mapdb: %u rounds, %u grants, %u flushes: OK\n",
+         (unsigned)Rounds, granted, flushed);
+
+  delete mapdb;
+  return 0;
+}
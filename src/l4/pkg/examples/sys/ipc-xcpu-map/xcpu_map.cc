@@ -0,0 +1,133 @@
+/**
+ * \file
+ * \brief Cross-CPU IPC ping-pong benchmark with and without map items.
+ *
+ * A client thread on one CPU calls a server thread on another CPU, once
+ * with a plain one-word message and once with a message that additionally
+ * maps a page of the client into the server's receive window. The average
+ * round-trip times show the extra cost of transferring message items
+ * across CPUs.
+ */
+/*
+ * This file is distributed under the terms of the GNU General Public
+ * License 2. Please see the COPYING-GPL-2 file for details.
+ */
+#include <l4/sys/ipc.h>
+#include <l4/sys/kip.h>
+#include <l4/sys/scheduler>
+#include <l4/re/env>
+
+#include <pthread-l4.h>
+#include <stdio.h>
+
+enum { Rounds = 100000 };
+
+static char snd_page[L4_PAGESIZE] __attribute__((aligned(L4_PAGESIZE)));
+static char rcv_page[L4_PAGESIZE] __attribute__((aligned(L4_PAGESIZE)));
+
+static pthread_t server;
+
+/* Setup the server's receive window for exactly one page. */
+static void setup_rcv_buffer()
+{
+  l4_buf_regs_t *br = l4_utcb_br();
+  br->bdr = 0;
+  br->br[0] = L4_ITEM_MAP;
+  br->br[1] = l4_fpage((l4_addr_t)rcv_page, L4_PAGESHIFT, L4_FPAGE_RW).raw;
+}
+
+static void *server_fn(void *)
+{
+  l4_umword_t label;
+  l4_msgtag_t tag;
+
+  setup_rcv_buffer();
+  tag = l4_ipc_wait(l4_utcb(), &label, L4_IPC_NEVER);
+  while (1)
+    {
+      if (l4_ipc_error(tag, l4_utcb()))
+        printf("server: IPC error: %lx\n", l4_ipc_error(tag, l4_utcb()));
+
+      setup_rcv_buffer();
+      tag = l4_ipc_reply_and_wait(l4_utcb(), l4_msgtag(0, 0, 0, 0),
+                                  &label, L4_IPC_NEVER);
+    }
+  return 0;
+}
+
+static int run_on_cpu(L4::Cap<L4::Thread> t, unsigned cpu)
+{
+  l4_sched_param_t sp = l4_sched_param(20);
+  sp.affinity = l4_sched_cpu_set(cpu, 0);
+  return l4_error(L4Re::Env::env()->scheduler()->run_thread(t, sp));
+}
+
+/* Do Rounds calls to the server and return the average round trip in
+ * microseconds times 1000. */
+static unsigned long bench(bool map_item)
+{
+  l4_cap_idx_t srv = pthread_l4_cap(server);
+  l4_kernel_info_t *kip = l4re_kip();
+  l4_msgtag_t tag = map_item ? l4_msgtag(0, 0, 1, 0) : l4_msgtag(0, 1, 0, 0);
+
+  l4_cpu_time_t start = l4_kip_clock(kip);
+  for (unsigned i = 0; i < Rounds; ++i)
+    {
+      l4_msg_regs_t *mr = l4_utcb_mr();
+      if (map_item)
+        {
+          mr->mr[0] = l4_map_control((l4_addr_t)snd_page, 0, 0);
+          mr->mr[1] = l4_fpage((l4_addr_t)snd_page, L4_PAGESHIFT,
+                               L4_FPAGE_RW).raw;
+        }
+      else
+        mr->mr[0] = i;
+
+      l4_msgtag_t r = l4_ipc_call(srv, l4_utcb(), tag, L4_IPC_NEVER);
+      if (l4_ipc_error(r, l4_utcb()))
+        {
+          printf("client: IPC error: %lx\n", l4_ipc_error(r, l4_utcb()));
+          return 0;
+        }
+    }
+  l4_cpu_time_t end = l4_kip_clock(kip);
+
+  return (end - start) * 1000 / Rounds;
+}
+
+int main(void)
+{
+  l4_umword_t cpu_nrs;
+  l4_sched_cpu_set_t cs = l4_sched_cpu_set(0, 0);
+  L4::Cap<L4::Scheduler> s = L4Re::Env::env()->scheduler();
+
+  if (l4_error(s->info(&cpu_nrs, &cs)) < 0 || cpu_nrs < 2
+      || !s->is_online(1))
+    {
+      printf("Need at least two online CPUs.\n");
+      return 1;
+    }
+
+  snd_page[0] = 1; // make sure the page is present
+
+  if (pthread_create(&server, NULL, server_fn, NULL))
+    {
+      printf("Thread creation failed\n");
+      return 1;
+    }
+
+  if (run_on_cpu(L4::Cap<L4::Thread>(pthread_l4_cap(server)), 1)
+      || run_on_cpu(L4Re::Env::env()->main_thread(), 0))
+    {
+      printf("Could not distribute threads on CPUs 0 and 1\n");
+      return 1;
+    }
+
+  unsigned long plain = bench(false);
+  unsigned long mapped = bench(true);
+
+  printf("X-CPU call, 1 word:     %lu.%03lu us\n", plain / 1000, plain % 1000);
+  printf("X-CPU call, 1 map item: %lu.%03lu us\n", mapped / 1000, mapped % 1000);
+
+  return 0;
+}
@@ -0,0 +1,194 @@
+/**
+ * \file
+ * \brief Lock throughput of a kernel semaphore with and without the user
+ *        counter fast path.
+ *
+ * A semaphore with one unit is used as a mutex, once with every down and
+ * up going to the kernel and once with the counter in kernel-user memory,
+ * where the kernel is only entered on contention. Each variant runs once
+ * with a single thread and once with two threads on two CPUs competing for
+ * the lock, and the average time of a lock/unlock pair is printed.
+ */
+/*
+ * This file is distributed under the terms of the GNU General Public
+ * License 2. Please see the COPYING-GPL-2 file for details.
+ */
+#include <l4/sys/ipc.h>
+#include <l4/sys/kip.h>
+#include <l4/sys/scheduler>
+#include <l4/sys/semaphore>
+#include <l4/sys/factory>
+#include <l4/re/env>
+#include <l4/re/error_helper>
+#include <l4/re/util/cap_alloc>
+#include <l4/re/util/kumem_alloc>
+
+#include <pthread-l4.h>
+#include <stdio.h>
+
+enum { Rounds = 200000 };
+
+enum
+{
+  Op_down_user = 1,
+  Op_up_user   = 2,
+};
+
+static L4::Cap<L4::Semaphore> sem;
+static l4_mword_t *counter;
+static bool fast;
+static unsigned long shared;
+
+static long sem_user_op(unsigned op)
+{
+  l4_msg_regs_t *mr = l4_utcb_mr();
+  mr->mr[0] = op;
+  mr->mr[1] = (l4_umword_t)counter;
+  return l4_error(l4_ipc_call(sem.cap(), l4_utcb(),
+                              l4_msgtag(L4_PROTO_SEMAPHORE, 2, 0, 0),
+                              L4_IPC_NEVER));
+}
+
+/* Take one unit, entering the kernel only if none is available. */
+static void fast_down()
+{
+  if (__atomic_fetch_sub(counter, 1, __ATOMIC_ACQUIRE) > 0)
+    return;
+
+  if (sem_user_op(Op_down_user) < 0)
+    printf("down failed\n");
+}
+
+/* Return one unit, entering the kernel only if there is a waiter. */
+static void fast_up()
+{
+  l4_mword_t v = __atomic_load_n(counter, __ATOMIC_RELAXED);
+  while (v >= 0)
+    if (__atomic_compare_exchange_n(counter, &v, v + 1, true,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      return;
+
+  if (sem_user_op(Op_up_user) < 0)
+    printf("up failed\n");
+}
+
+static void lock_loop()
+{
+  for (unsigned i = 0; i < Rounds; ++i)
+    {
+      if (fast)
+        fast_down();
+      else
+        sem->down();
+
+      ++shared;
+
+      if (fast)
+        fast_up();
+      else
+        sem->up();
+    }
+}
+
+static void *competitor_fn(void *)
+{
+  lock_loop();
+  return 0;
+}
+
+static int run_on_cpu(L4::Cap<L4::Thread> t, unsigned cpu)
+{
+  l4_sched_param_t sp = l4_sched_param(20);
+  sp.affinity = l4_sched_cpu_set(cpu, 0);
+  return l4_error(L4Re::Env::env()->scheduler()->run_thread(t, sp));
+}
+
+/* Run the lock loop in one or two threads and return the average time of
+ * one lock/unlock pair in nanoseconds. */
+static unsigned long bench(bool use_fast, bool contended)
+{
+  fast = use_fast;
+  shared = 0;
+  *counter = 1;
+
+  // the kernel counter holds the unit when the fast path is not used
+  if (!use_fast)
+    sem->up();
+
+  l4_kernel_info_t *kip = l4re_kip();
+  l4_cpu_time_t start = l4_kip_clock(kip);
+
+  pthread_t competitor;
+  if (contended)
+    {
+      if (pthread_create(&competitor, NULL, competitor_fn, NULL)
+          || run_on_cpu(L4::Cap<L4::Thread>(pthread_l4_cap(competitor)), 1))
+        {
+          printf("Could not start the competing thread on CPU 1\n");
+          return 0;
+        }
+    }
+
+  lock_loop();
+
+  if (contended)
+    pthread_join(competitor, NULL);
+
+  l4_cpu_time_t end = l4_kip_clock(kip);
+
+  // take the unit back so that the next run starts from scratch
+  if (!use_fast)
+    sem->down();
+
+  unsigned long pairs = contended ? 2UL * Rounds : Rounds;
+  if (shared != pairs)
+    printf("Lost updates: %lu of %lu\n", pairs - shared, pairs);
+
+  return (end - start) * 1000 / pairs;
+}
+
+int main(void)
+{
+  try
+    {
+      l4_umword_t cpu_nrs;
+      l4_sched_cpu_set_t cs = l4_sched_cpu_set(0, 0);
+      L4::Cap<L4::Scheduler> s = L4Re::Env::env()->scheduler();
+
+      if (l4_error(s->info(&cpu_nrs, &cs)) < 0 || cpu_nrs < 2
+          || !s->is_online(1))
+        {
+          printf("Need at least two online CPUs.\n");
+          return 1;
+        }
+
+      sem = L4Re::chkcap(L4Re::Util::cap_alloc.alloc<L4::Semaphore>());
+      L4Re::chksys(L4Re::Env::env()->factory()->create(sem),
+                   "Failed to create semaphore.");
+
+      l4_addr_t kumem;
+      L4Re::chksys(L4Re::Util::kumem_alloc(&kumem, 0),
+                   "Failed to allocate kernel-user memory.");
+      counter = (l4_mword_t *)kumem;
+
+      L4Re::chksys(run_on_cpu(L4Re::Env::env()->main_thread(), 0),
+                   "Could not run on CPU 0.");
+
+      unsigned long k_single = bench(false, false);
+      unsigned long f_single = bench(true, false);
+      unsigned long k_contended = bench(false, true);
+      unsigned long f_contended = bench(true, true);
+
+      printf("Lock/unlock, 1 thread,  kernel:    %lu ns\n", k_single);
+      printf("Lock/unlock, 1 thread,  fast path: %lu ns\n", f_single);
+      printf("Lock/unlock, 2 threads, kernel:    %lu ns\n", k_contended);
+      printf("Lock/unlock, 2 threads, fast path: %lu ns\n", f_contended);
+      return 0;
+    }
+  catch (L4::Runtime_error &e)
+    {
+      fprintf(stderr, "Runtime error: %s.\n", e.str());
+    }
+
+  return 1;
+}
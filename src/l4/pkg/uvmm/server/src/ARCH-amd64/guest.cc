@@ -463,7 +463,21 @@ Guest::handle_exit_vmx(Vmm::Vcpu_ptr vcpu)
       vms->vmx_write(L4VCPU_VMCS_GUEST_ACTIVITY_STATE, 1);
 
       if (!lapic(vcpu)->is_irq_pending())
-        wait_for_ipc(l4_utcb(), L4_IPC_NEVER);
+        {
+          auto *utcb = l4_utcb();
+          auto now_ns = []() { return l4_tsc_to_ns(l4_rdtsc()); };
+          Halt_poll &hp = _halt_poll[vcpu.get_vcpu_id()];
+          if (!hp.poll(now_ns, [&]()
+                {
+                  process_pending_ipc(vcpu, utcb);
+                  return lapic(vcpu)->is_irq_pending();
+                }))
+            {
+              l4_uint64_t start = now_ns();
+              wait_for_ipc(utcb, L4_IPC_NEVER);
+              hp.blocked(now_ns() - start);
+            }
+        }
 
       vms->unhalt();
       return L4_EOK;
@@ -8,7 +8,9 @@
  */
 #pragma once
 
+#include <l4/re/env.h>
 #include <l4/util/cpu.h>
+#include <l4/util/rdtsc.h>
 #include <l4/vbus/vbus>
 #include <l4/l4virtio/l4virtio>
 
@@ -42,6 +44,9 @@ public:
     add_mmio_device(_apics->mmio_region(), _apics);
 
     register_msr_device(_apics);
+
+    // the TSC is the clock of halt polling
+    l4_tsc_init(L4_TSC_INIT_AUTO, l4re_kip());
   }
 
   static Guest *create_instance();
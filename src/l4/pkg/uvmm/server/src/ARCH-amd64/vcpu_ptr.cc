@@ -1,6 +1,8 @@
 
 #include <l4/util/cpu.h>
 
+#include <cstring>
+
 #include "vcpu_ptr.h"
 #include "vm_state_vmx.h"
 #include "mad.h"
@@ -16,6 +18,9 @@ Vcpu_ptr::create_state(Vcpu_ptr::Vm_state_t type)
       reinterpret_cast<l4_umword_t>(new Vmx_state(extended_state()));
   else
     throw L4::Runtime_error(-L4_ENOSYS, "Unsupported HW virtualization type.");
+
+  _s->user_data[Reg_mmio_decode] =
+    reinterpret_cast<l4_umword_t>(new Mmio_decode_cache());
 }
 
 Vcpu_ptr::Vm_state_t
@@ -57,6 +62,22 @@ Vcpu_ptr::decode_mmio() const
       return m;
     }
 
+  // Drivers access their registers from a few instructions only, skip the
+  // decoder if the instruction at this IP was decoded before.
+  l4_uint64_t insn;
+  memcpy(&insn, reinterpret_cast<void const *>(opcode), sizeof(insn));
+  Mmio_decode_cache::Entry &ce = decode_cache()->slot(vms->ip());
+  if (ce.ip == vms->ip() && ce.insn == insn)
+    {
+      m.access = ce.access;
+      m.width = ce.width;
+      if (m.access == Mem_access::Load)
+        _s->user_data[Reg_mmio_read] = ce.reg;
+      else
+        m.value = *decode_reg_ptr(ce.reg) >> ce.shift;
+      return m;
+    }
+
   // amd64: vcpu regs == exc_regs
   l4_exc_regs_t *reg = reinterpret_cast<l4_exc_regs_t *>(&_s->r);
   using namespace L4mad;
@@ -103,6 +124,18 @@ Vcpu_ptr::decode_mmio() const
     }
   // else unknown; Other already set.
 
+  // only register operands are independent of the register contents
+  if (   (m.access == Mem_access::Load && tgt.dtype == L4mad::Desc_reg)
+      || (m.access == Mem_access::Store && src.dtype == L4mad::Desc_reg))
+    {
+      ce.ip = vms->ip();
+      ce.insn = insn;
+      ce.access = m.access;
+      ce.width = m.width;
+      ce.reg = m.access == Mem_access::Load ? tgt.val >> tgt.shift : src.val;
+      ce.shift = m.access == Mem_access::Load ? 0 : src.shift;
+    }
+
   return m;
 }
 
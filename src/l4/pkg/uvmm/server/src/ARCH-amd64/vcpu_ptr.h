@@ -16,6 +16,33 @@ namespace Vmm {
 
 class Pt_walker;
 
+/**
+ * Decoded MMIO instructions of one vCPU, indexed by guest IP.
+ *
+ * An entry only matches if the instruction bytes at the IP are unchanged,
+ * so the cache stays valid when the guest modifies its code or switches
+ * address spaces.
+ */
+struct Mmio_decode_cache
+{
+  enum { Size = 32 };
+
+  struct Entry
+  {
+    l4_umword_t ip = ~0UL;
+    l4_uint64_t insn = 0;  ///< first eight instruction bytes
+    Mem_access::Kind access = Mem_access::Other;
+    char width = 0;
+    l4_umword_t reg = 0;   ///< MAD register number of the operand
+    unsigned char shift = 0;
+  };
+
+  Entry &slot(l4_umword_t ip)
+  { return e[(ip ^ (ip >> 5)) % Size]; }
+
+  Entry e[Size];
+};
+
 class Vcpu_ptr : public Generic_vcpu_ptr
 {
 public:
@@ -24,6 +51,7 @@ public:
     Reg_vmm_type = Reg_arch_base,
     Reg_ptw_ptr,
     Reg_mmio_read,
+    Reg_mmio_decode,
   };
   enum class Vm_state_t { Vmx, Svm };
 
@@ -72,6 +100,12 @@ private:
     return (void *)(((char *)_s) + L4_VCPU_OFFSET_EXT_STATE);
   }
 
+  Mmio_decode_cache *decode_cache() const
+  {
+    return reinterpret_cast<Mmio_decode_cache *>(
+      _s->user_data[Reg_mmio_decode]);
+  }
+
   Vm_state_t determine_vmm_type();
   void create_state(Vm_state_t type);
   l4_umword_t *decode_reg_ptr(int value) const;
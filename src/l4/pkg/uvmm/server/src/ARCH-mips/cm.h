@@ -171,6 +171,7 @@ public:
 
               (*_memmap)[Vmm::Region::ss(Vmm::Guest_addr(_cpc_base.base_addr()),
                                          Mips_cpc::Cpc_size)] = _cpc;
+              _memmap->update_table();
             }
           break;
         }
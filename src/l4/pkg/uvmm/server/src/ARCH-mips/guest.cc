@@ -19,6 +19,7 @@ Guest::Guest()
   _cpc(Vdev::make_device<Vdev::Mips_cpc>())
 {
   _memmap[_cm->mem_region()] = _cm;
+  _memmap.update_table();
   _cm->register_cpc(_cpc);
 }
 
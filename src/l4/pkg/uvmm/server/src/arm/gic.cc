@@ -356,6 +356,21 @@ Gic::Cpu::show(FILE *f, unsigned cpu)
       _local_irq[i].show(f, i);
 }
 
+void
+Gic::Cpu::show_inject_stats(FILE *f, unsigned cpu) const
+{
+  unsigned long n = cxx::access_once(&_inj_count);
+  l4_uint64_t ticks = cxx::access_once(&_inj_ticks);
+  l4_uint64_t khz = Vmm::Vcpu_ptr::cntfrq() / 1000;
+  if (!khz)
+    return;
+
+  // convert from counter ticks to nanoseconds
+  fprintf(f, "Cpu%d: %lu IRQs injected, latency avg %llu ns, max %llu ns\n",
+          cpu, n, n ? ticks * 1000000 / khz / n : 0ULL,
+          (l4_uint64_t)cxx::access_once(&_inj_max) * 1000000 / khz);
+}
+
 void
 Gic::Dist::show(FILE *f) const
 {
@@ -80,6 +80,9 @@ private:
     l4_uint32_t state() const
     { return _state; }
 
+    bool pending_and_enabled() const
+    { return is_pending_and_enabled(__atomic_load_n(&_state, __ATOMIC_ACQUIRE)); }
+
     bool enable()
     { return set_pe(enabled_bfm_t::Mask); }
 
@@ -115,12 +118,52 @@ private:
      * assigned" (see #get_empty_lr())
      */
     unsigned char lr;
-    Context() : eoi(0), lr(0) {};
+    /// Low word of the virtual counter when the IRQ became deliverable.
+    l4_uint32_t pend_time;
+    Context() : eoi(0), lr(0), pend_time(0) {};
   };
 
+  enum { Map_bits = sizeof(l4_umword_t) * 8 };
+
   cxx::unique_ptr<Pending[]> _pending;
   cxx::unique_ptr<Context[]> _irq;
 
+  /*
+   * One bit per IRQ that became pending and enabled. A bit is set after
+   * the state changed and only find_pending_irq() clears it again, once it
+   * sees that the IRQ is no longer pending or enabled. So a clear bit means
+   * the IRQ cannot be delivered, while a set bit has to be checked.
+   */
+  cxx::unique_ptr<l4_umword_t[]> _candidates;
+
+  void mark(Pending const *p, Context *c)
+  {
+    unsigned i = p - _pending.get();
+    __atomic_store_n(&c->pend_time, (l4_uint32_t)Vmm::Vcpu_ptr::cntvct(),
+                     __ATOMIC_RELAXED);
+    __atomic_or_fetch(&_candidates[i / Map_bits], 1UL << (i % Map_bits),
+                      __ATOMIC_RELEASE);
+  }
+
+  /**
+   * Check whether the IRQ `p`, which has `bit` set in `_candidates[w]`,
+   * is still pending and enabled, and drop the bit otherwise.
+   */
+  bool still_candidate(unsigned w, l4_umword_t bit, Pending const *p)
+  {
+    if (p->pending_and_enabled())
+      return true;
+
+    __atomic_and_fetch(&_candidates[w], ~bit, __ATOMIC_ACQ_REL);
+
+    // the IRQ may have become pending again before we dropped the bit
+    if (!p->pending_and_enabled())
+      return false;
+
+    __atomic_or_fetch(&_candidates[w], bit, __ATOMIC_RELEASE);
+    return true;
+  }
+
 public:
   class Const_irq
   {
@@ -139,6 +182,8 @@ public:
 
     unsigned cpu() const { return _p->cpu(); }
     unsigned lr() const { return _c->lr; }
+    l4_uint32_t pend_time() const
+    { return __atomic_load_n(&_c->pend_time, __ATOMIC_RELAXED); }
 
     Const_irq &operator ++ () { ++_c; ++_p; return *this; }
 
@@ -164,7 +209,7 @@ public:
     bool enable(bool ena) const
     {
       if (ena)
-        return _p->enable();
+        return deliverable(_p->enable());
       else
         return _p->disable();
     }
@@ -173,7 +218,7 @@ public:
     bool pending(bool pend) const
     {
       if (pend)
-        return _p->set_pending();
+        return deliverable(_p->set_pending());
       else
         return _p->clear_pending();
     }
@@ -191,7 +236,8 @@ public:
 
     void kick_from_cpu(unsigned char cpu)
     {
-      return _p->kick_from_cpu(cpu);
+      _p->kick_from_cpu(cpu);
+      _a->mark(_p, _c);
     }
 
 
@@ -216,7 +262,16 @@ public:
 
   private:
     friend class Irq_array;
-    Irq(Pending *p, Context *c) : Const_irq(p, c) {}
+    Irq(Pending *p, Context *c, Irq_array *a) : Const_irq(p, c), _a(a) {}
+
+    bool deliverable(bool made_pending) const
+    {
+      if (made_pending)
+        _a->mark(_p, _c);
+      return made_pending;
+    }
+
+    Irq_array *_a;
   };
 
 
@@ -224,37 +279,61 @@ public:
   {
     _pending = cxx::unique_ptr<Pending[]>(new Pending[irqs]);
     _irq     = cxx::unique_ptr<Context[]>(new Context[irqs]);
+    _candidates = cxx::unique_ptr<l4_umword_t[]>(
+      new l4_umword_t[(irqs + Map_bits - 1) / Map_bits]());
   }
 
   Irq operator [] (unsigned i)
-  { return Irq(_pending.get() + i, _irq.get() + i); }
+  { return Irq(_pending.get() + i, _irq.get() + i, this); }
 
   Const_irq operator [] (unsigned i) const
   { return Const_irq(_pending.get() + i, _irq.get() + i); }
 
+  /**
+   * Find the deliverable IRQ with the highest priority in [begin, end).
+   *
+   * Only IRQs marked in `_candidates` are looked at, so the cost depends
+   * on the number of pending IRQs instead of the number of IRQs.
+   */
   int find_pending_irq(unsigned char target_mask, unsigned char min_prio,
                        unsigned begin, unsigned end)
   {
     int hp_irq = -1;
     unsigned char hprio = min_prio;
 
-    for (Pending *p = _pending.get() + begin; p != _pending.get() + end; ++p)
+    for (unsigned w = begin / Map_bits; w * Map_bits < end; ++w)
       {
-        if (!p->enabled() || !p->pending())
-          continue;
+        l4_umword_t bits = __atomic_load_n(&_candidates[w], __ATOMIC_ACQUIRE);
+        while (bits)
+          {
+            l4_umword_t bit = bits & -bits;
+            bits &= ~bit;
 
-        if (!(p->target() & target_mask))
-          continue;
+            unsigned i = w * Map_bits + __builtin_ctzl(bit);
+            if (i < begin || i >= end)
+              continue;
 
-        if (p->cpu())
-          continue;
+            Pending *p = _pending.get() + i;
+            if (!still_candidate(w, bit, p))
+              continue;
 
-        if (!(p->prio() < hprio))
-          continue;
+            if (!(p->target() & target_mask))
+              continue;
 
-        // found a potential victim
-        hp_irq = p - _pending.get();
-        hprio = p->prio();
+            if (p->cpu())
+              continue;
+
+            if (!(p->prio() < hprio))
+              continue;
+
+            // found a potential victim
+            hp_irq = i;
+            hprio = p->prio();
+
+            // nothing can beat the highest priority
+            if (!hprio)
+              return hp_irq;
+          }
       }
 
     return hp_irq;
@@ -562,6 +641,7 @@ public:
   void dump_sgis() const;
 
   void show(FILE *f, unsigned cpu);
+  void show_inject_stats(FILE *f, unsigned cpu) const;
 
   Vmm::Arm::Gic_h::Vmcr vmcr() const
   {
@@ -593,6 +673,21 @@ public:
   L4Re::Util::Unique_cap<L4::Irq> _cpu_irq;
   bool _pending_work;
 
+  // injection latency in ticks of the virtual counter, only written by
+  // the thread of this CPU
+  unsigned long _inj_count = 0;
+  l4_uint64_t _inj_ticks = 0;
+  l4_uint32_t _inj_max = 0;
+
+  void account_injection(Irq_array::Irq const &irq)
+  {
+    l4_uint32_t d = (l4_uint32_t)Vmm::Vcpu_ptr::cntvct() - irq.pend_time();
+    cxx::write_now(&_inj_ticks, _inj_ticks + d);
+    cxx::write_now(&_inj_count, _inj_count + 1);
+    if (d > _inj_max)
+      cxx::write_now(&_inj_max, d);
+  }
+
   void _set_elsr(unsigned idx, l4_uint32_t bits) const
   {
     unsigned id = L4_VCPU_E_GIC_ELSR0 + idx * 4;
@@ -745,6 +840,7 @@ Cpu::add_pending_irq(unsigned lr, Irq_array::Irq const &irq,
   irq.set_lr(lr + 1);
   _set_lr(lr, new_lr);
   _clear_elsr(0, 1U << lr);
+  account_injection(irq);
   return true;
 }
 
@@ -1182,6 +1278,13 @@ public:
   }
 
   void show(FILE *f) const;
+
+  void show_inject_stats(FILE *f, unsigned cpu) const
+  {
+    if (cpu < cpus)
+      _cpu[cpu].show_inject_stats(f, cpu);
+  }
+
 private:
   void sgir_write(l4_uint32_t value);
   unsigned char _active_grp0_cpus;
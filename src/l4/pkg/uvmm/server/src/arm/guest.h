@@ -51,7 +51,8 @@ public:
 
   static Guest *create_instance();
 
-  void show_state_interrupts(FILE *, Vcpu_ptr) {}
+  void show_state_interrupts(FILE *f, Vcpu_ptr vcpu)
+  { _gic->show_inject_stats(f, vcpu.get_vcpu_id()); }
 
   cxx::Ref_ptr<Gic::Dist> gic() const
   { return _gic; }
@@ -74,6 +75,16 @@ public:
   void handle_smc_call(Vcpu_ptr vcpu);
 
 private:
+  bool timer_expired(Vcpu_ptr vcpu) const;
+
+  /// Nanoseconds since `start` in ticks of the virtual counter.
+  static l4_uint64_t ns_since(l4_uint64_t start)
+  {
+    l4_uint64_t d = Vcpu_ptr::cntvct() - start;
+    l4_uint64_t f = Vcpu_ptr::cntfrq();
+    return d / f * 1000000000ULL + d % f * 1000000000ULL / f;
+  }
+
   Cpu_dev *lookup_cpu(l4_uint32_t hwid) const;
   void check_guest_constraints(l4_addr_t ram_base) const;
   void arm_update_device_tree();
@@ -565,15 +565,33 @@ guest_memory_fault(Vcpu_ptr vcpu)
     }
 }
 
+bool
+Vmm::Guest::timer_expired(Vcpu_ptr vcpu) const
+{
+  return _timer
+         && (l4_vcpu_e_read_32(*vcpu, L4_VCPU_E_CNTVCTL) & 3) == 1
+         && vcpu.cntv_cval() <= vcpu.cntvct();
+}
+
 void
 Vmm::Guest::wait_for_timer_or_irq(Vcpu_ptr vcpu)
 {
   if (_gic->schedule_irqs(vmm_current_cpu_id))
     return;
 
+  auto *utcb = l4_utcb();
+  Halt_poll &hp = _halt_poll[vmm_current_cpu_id];
+  l4_uint64_t poll_start = vcpu.cntvct();
+  if (hp.poll([poll_start]() { return ns_since(poll_start); }, [&]()
+        {
+          process_pending_ipc(vcpu, utcb);
+          return _gic->schedule_irqs(vmm_current_cpu_id)
+                 || timer_expired(vcpu);
+        }))
+    return;
+
   l4_timeout_t to = L4_IPC_NEVER;
 
-  auto *utcb = l4_utcb();
   if (_timer
       && (l4_vcpu_e_read_32(*vcpu, L4_VCPU_E_CNTVCTL) & 3) == 1) // timer enabled and not masked
     {
@@ -590,7 +608,9 @@ Vmm::Guest::wait_for_timer_or_irq(Vcpu_ptr vcpu)
       l4_rcv_timeout(l4_timeout_abs_u(l4_kip_clock(l4re_kip()) + diff, 8, utcb), &to);
     }
 
+  l4_uint64_t start = vcpu.cntvct();
   wait_for_ipc(utcb, to);
+  hp.blocked(ns_since(start));
 }
 
 void
@@ -0,0 +1,731 @@
+/*
+ * Copyright (C) 2018 Kernkonzept GmbH.
+ *
+ * This file is distributed under the terms of the GNU General Public
+ * License, version 2.  Please see the COPYING-GPL-2 file for details.
+ */
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "debug.h"
+#include "device_factory.h"
+#include "guest.h"
+#include "mmio_device.h"
+#include "virtio_dev.h"
+#include "virtio_event_connector.h"
+
+#include <l4/sys/cxx/ipc_epiface>
+#include <l4/re/env>
+#include <l4/re/error_helper>
+#include <l4/re/util/env_ns>
+
+/**
+ * Virtio block device backed by a dataspace.
+ *
+ * The device offers one virtqueue per vCPU, so that the vCPUs of the guest
+ * do not contend for a queue. A notification only collects the available
+ * requests of the queue, merging requests that continue each other into
+ * one batch, and hands the batches to a pool of worker threads. A worker
+ * handles a batch as one contiguous disk range, copying adjacent guest
+ * buffers in one go, and triggers an IRQ of the device once it is
+ * done, whose handler puts the requests into the used ring and notifies
+ * the guest. So no vCPU waits for the data of a request.
+ *
+ * The dataspace is either given as capability or looked up by name in the
+ * namespace of uvmm, which also allows to use a file from rom. The device
+ * is read-only if the dataspace is.
+ *
+ * Device tree example:
+ *
+ *   virtio_blk@20000 {
+ *       compatible = "virtio,mmio";
+ *       reg = <0x20000 0x100>;
+ *       interrupt-parent = <&gic>;
+ *       interrupts = <0 123 4>;
+ *       l4vmm,vdev = "block";
+ *       l4vmm,virtiocap = "disk";    // or l4vmm,image = "rom/disk.img";
+ *       l4vmm,queues = <2>;          // optional, default: number of vCPUs
+ *       l4vmm,workers = <2>;         // optional
+ *       l4vmm,read-only;             // optional
+ *   };
+ */
+
+namespace {
+
+using namespace Vdev;
+
+class Virtio_block_mmio
+: public Virtio::Dev,
+  public Vmm::Ro_ds_mapper_t<Virtio_block_mmio>,
+  public Virtio::Mmio_connector<Virtio_block_mmio>,
+  public L4::Irqep_t<Virtio_block_mmio>
+{
+  typedef L4virtio::Svr::Virtqueue::Desc Desc;
+  typedef L4virtio::Svr::Virtqueue::Request Vq_request;
+  typedef L4virtio::Svr::Request_processor Request_processor;
+
+  enum
+  {
+    Sector_shift = 9,
+    Queue_length = 0x100,
+    Max_segments = 126,      ///< data segments per request, seg_max
+    Max_merge_bytes = 1 << 20,
+  };
+
+  enum Features_blk
+  {
+    F_seg_max  = 1 << 2,
+    F_ro       = 1 << 5,
+    F_blk_size = 1 << 6,
+    F_mq       = 1 << 12,
+  };
+
+  enum Request_type
+  {
+    T_in    = 0,
+    T_out   = 1,
+    T_flush = 4,
+  };
+
+  enum Request_status
+  {
+    S_ok     = 0,
+    S_ioerr  = 1,
+    S_unsupp = 2,
+  };
+
+  struct Blk_config
+  {
+    l4_uint64_t capacity;
+    l4_uint32_t size_max;
+    l4_uint32_t seg_max;
+    l4_uint16_t cylinders;
+    l4_uint8_t heads;
+    l4_uint8_t sectors;
+    l4_uint32_t blk_size;
+    l4_uint8_t physical_block_exp;
+    l4_uint8_t alignment_offset;
+    l4_uint16_t min_io_size;
+    l4_uint32_t opt_io_size;
+    l4_uint8_t writeback;
+    l4_uint8_t unused0;
+    l4_uint16_t num_queues;
+  } __attribute__((packed));
+
+  struct Blk_header
+  {
+    l4_uint32_t type;
+    l4_uint32_t ioprio;
+    l4_uint64_t sector;
+  };
+
+  struct Payload
+  {
+    char *data;
+    unsigned len;
+    bool writable;
+  };
+
+  struct Blk_request
+  {
+    Vq_request head;
+    unsigned queue;
+    unsigned generation;
+    l4_uint32_t type;
+    l4_uint64_t sector;
+    l4_uint64_t bytes = 0;
+    std::vector<Payload> segs;
+    l4_uint8_t *status = nullptr;
+    /// Next request merged into the same batch.
+    Blk_request *merged = nullptr;
+    /// Next batch in the work queue or next request in the done list.
+    Blk_request *next = nullptr;
+  };
+
+  struct Queue
+  {
+    Virtio::Virtqueue vq;
+    std::mutex lock;
+  };
+
+public:
+  Virtio_block_mmio(Vmm::Vm_ram *iommu, L4::Cap<L4Re::Dataspace> ds,
+                    bool read_only, unsigned queues, unsigned workers)
+  : Virtio::Dev(iommu, 0x44, L4VIRTIO_ID_BLOCK),
+    _num_queues(queues), _queues(new Queue[queues]),
+    _read_only(read_only || !(ds->flags() & L4Re::Dataspace::Map_rw))
+  {
+    _size = ds->size();
+    auto *e = L4Re::Env::env();
+    L4Re::chksys(e->rm()->attach(&_disk, _size,
+                                 L4Re::Rm::Search_addr
+                                 | (_read_only ? L4Re::Rm::Read_only : 0),
+                                 L4::Ipc::make_cap(ds, _read_only
+                                                       ? L4_CAP_FPAGE_RO
+                                                       : L4_CAP_FPAGE_RW)),
+                 "Attach virtio block dataspace");
+
+    Features feat(0);
+    feat.ring_indirect_desc() = true;
+    l4_uint32_t blk = F_seg_max | F_blk_size | F_mq;
+    if (_read_only)
+      blk |= F_ro;
+    _cfg_header->dev_features_map[0] = feat.raw | blk;
+    _cfg_header->num_queues = _num_queues;
+
+    auto *cfg = virtio_device_config<Blk_config>();
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->capacity = _size >> Sector_shift;
+    cfg->seg_max = Max_segments;
+    cfg->blk_size = 1 << Sector_shift;
+    cfg->num_queues = _num_queues;
+    update_virtio_config();
+
+    for (unsigned i = 0; i < _num_queues; ++i)
+      _queues[i].vq.config.num_max = Queue_length;
+
+    for (unsigned i = 0; i < workers; ++i)
+      _workers.emplace_back(&Virtio_block_mmio::work, this);
+
+    Dbg(Dbg::Dev, Dbg::Info, "blk")
+      .printf("%llu sectors%s, %u queues, %u workers\n",
+              cfg->capacity, _read_only ? " (read-only)" : "",
+              _num_queues, workers);
+  }
+
+  ~Virtio_block_mmio()
+  {
+    {
+      std::lock_guard<std::mutex> g(_work_lock);
+      _stop = true;
+    }
+    _work_cv.notify_all();
+    for (auto &t : _workers)
+      t.join();
+  }
+
+  int init_irqs(Vdev::Device_lookup *devs, Vdev::Dt_node const &self)
+  { return _evcon.init_irqs(devs, self); }
+
+  Virtio::Event_connector_irq *event_connector() { return &_evcon; }
+
+  void register_obj(L4::Registry_iface *registry)
+  { _done_irq = L4Re::chkcap(registry->register_irq_obj(this)); }
+
+  Virtio::Virtqueue *virtqueue(unsigned qn) override
+  {
+    if (qn >= _num_queues)
+      return nullptr;
+
+    return &_queues[qn].vq;
+  }
+
+  void reset() override
+  {
+    for (unsigned i = 0; i < _num_queues; ++i)
+      {
+        std::lock_guard<std::mutex> g(_queues[i].lock);
+        _queues[i].vq.disable();
+        _queues[i].vq.config.num_max = Queue_length;
+      }
+
+    // Completed requests still belong to the old rings, drop them. Only
+    // bump the generation now: until the queues were disabled, notify
+    // could still parse requests and tag them with the old generation.
+    __atomic_add_fetch(&_generation, 1, __ATOMIC_ACQ_REL);
+
+    // No new batches arrive with the queues disabled. Drop the queued ones
+    // and wait for the workers, which must not touch guest memory once the
+    // guest may reuse it.
+    Blk_request *queued;
+    {
+      std::unique_lock<std::mutex> g(_work_lock);
+      queued = _work_head;
+      _work_head = _work_tail = nullptr;
+      _idle_cv.wait(g, [this]() { return !_busy; });
+    }
+
+    while (queued)
+      {
+        Blk_request *n = queued->next;
+        for (Blk_request *r = queued; r;)
+          {
+            Blk_request *m = r->merged;
+            delete r;
+            r = m;
+          }
+        queued = n;
+      }
+  }
+
+  void virtio_queue_ready(unsigned ready)
+  {
+    auto *q = current_virtqueue();
+    if (!q)
+      return;
+
+    auto *qc = &q->config;
+    std::lock_guard<std::mutex> g(_queues[_cfg_header->queue_sel].lock);
+
+    if (ready == 0 && q->ready())
+      {
+        q->disable();
+        qc->ready = 0;
+      }
+    else if (ready == 1 && !q->ready())
+      {
+        qc->ready = 0;
+        l4_uint16_t num = qc->num;
+        // num must be: a power of two in range [1,num_max].
+        if (!num || (num & (num - 1)) || num > qc->num_max)
+          return;
+
+        q->init_queue(devaddr_to_virt<void>(qc->desc_addr),
+                      devaddr_to_virt<void>(qc->avail_addr),
+                      devaddr_to_virt<void>(qc->used_addr));
+        qc->ready = 1;
+      }
+  }
+
+  /**
+   * Collect the available requests of queue `qn` and pass them to the
+   * workers, merging consecutive requests that continue each other.
+   */
+  void virtio_queue_notify(unsigned qn)
+  {
+    if (qn >= _num_queues)
+      return;
+
+    Queue &q = _queues[qn];
+    Blk_request *batch = nullptr;
+    Blk_request *last = nullptr;
+    unsigned nsegs = 0;
+    l4_uint64_t batch_bytes = 0;
+
+    std::lock_guard<std::mutex> g(q.lock);
+    while (q.vq.ready())
+      {
+        auto r = q.vq.next_avail();
+        if (!r)
+          break;
+
+        Blk_request *req = parse(qn, r);
+        if (!req)
+          {
+            // not even a status byte to report the error
+            q.vq.consumed(r);
+            continue;
+          }
+
+        if (last && mergeable(last, req, nsegs, batch_bytes))
+          {
+            last->merged = req;
+            last = req;
+            nsegs += req->segs.size();
+            batch_bytes += req->bytes;
+            continue;
+          }
+
+        if (batch)
+          submit(batch);
+
+        batch = last = req;
+        nsegs = req->segs.size();
+        batch_bytes = req->bytes;
+      }
+
+    if (batch)
+      submit(batch);
+  }
+
+  void load_desc(Desc const &desc, Request_processor const *, Payload *p)
+  {
+    p->data = devaddr_to_virt<char>(desc.addr.get(), desc.len);
+    p->len = desc.len;
+    p->writable = desc.flags.write();
+  }
+
+  void load_desc(Desc const &desc, Request_processor const *,
+                 Desc const **table)
+  {
+    *table = devaddr_to_virt<Desc const>(desc.addr.get(), sizeof(Desc));
+  }
+
+  /// Put the requests completed by the workers into their used rings.
+  void handle_irq()
+  {
+    Blk_request *done = __atomic_exchange_n(&_done, nullptr, __ATOMIC_ACQUIRE);
+
+    // the list is in reverse order of completion
+    Blk_request *ordered = nullptr;
+    while (done)
+      {
+        Blk_request *n = done->next;
+        done->next = ordered;
+        ordered = done;
+        done = n;
+      }
+
+    Virtio::Event_set ev;
+    unsigned gen = __atomic_load_n(&_generation, __ATOMIC_ACQUIRE);
+    while (ordered)
+      {
+        Blk_request *r = ordered;
+        ordered = r->next;
+
+        Queue &q = _queues[r->queue];
+        if (r->generation == gen)
+          {
+            std::lock_guard<std::mutex> g(q.lock);
+            if (q.vq.ready())
+              {
+                q.vq.consumed(r->head, r->type == T_in ? r->bytes + 1 : 1);
+                if (!q.vq.no_notify_guest())
+                  {
+                    _irq_status_shadow |= 1;
+                    ev.set(q.vq.config.driver_notify_index);
+                  }
+              }
+          }
+
+        delete r;
+      }
+
+    if (_cfg_header->irq_status != _irq_status_shadow)
+      set_irq_status(_irq_status_shadow);
+
+    _evcon.send_events(cxx::move(ev));
+  }
+
+  void virtio_irq_ack(unsigned val)
+  {
+    _irq_status_shadow &= ~val;
+    if (_cfg_header->irq_status != _irq_status_shadow)
+      set_irq_status(_irq_status_shadow);
+
+    _evcon.clear_events(val);
+  }
+
+private:
+  /**
+   * Parse the descriptor chain of `r`: the request header, the data
+   * segments and the status byte at the end of the last segment.
+   *
+   * \return the request, or nullptr if it has no status byte to report
+   *         errors.
+   */
+  Blk_request *parse(unsigned qn, Vq_request const &r)
+  {
+    auto *req = new Blk_request();
+    req->head = r;
+    req->queue = qn;
+    req->generation = __atomic_load_n(&_generation, __ATOMIC_ACQUIRE);
+
+    bool valid = true;
+    try
+      {
+        Request_processor rp;
+        Payload p;
+        rp.start(this, r, &p);
+        if (p.len < sizeof(Blk_header) || p.writable)
+          valid = false;
+        else
+          {
+            auto const *hdr = reinterpret_cast<Blk_header const *>(p.data);
+            req->type = hdr->type;
+            req->sector = hdr->sector;
+          }
+
+        while (rp.has_more())
+          {
+            rp.next(this, &p);
+            req->segs.push_back(p);
+          }
+      }
+    catch (L4virtio::Svr::Bad_descriptor const &)
+      {
+        delete req;
+        return nullptr;
+      }
+    catch (L4::Runtime_error const &)
+      {
+        delete req;
+        return nullptr;
+      }
+
+    if (req->segs.empty() || !req->segs.back().writable)
+      {
+        delete req;
+        return nullptr;
+      }
+
+    Payload &last = req->segs.back();
+    req->status = reinterpret_cast<l4_uint8_t *>(last.data + last.len - 1);
+    if (--last.len == 0)
+      req->segs.pop_back();
+
+    for (auto const &s : req->segs)
+      {
+        // reads fill guest buffers, writes consume them
+        if (s.writable != (req->type == T_in))
+          valid = false;
+        req->bytes += s.len;
+      }
+
+    if (!valid || req->segs.size() > Max_segments)
+      req->type = ~0U;
+
+    return req;
+  }
+
+  /**
+   * Can `req` be appended to the batch ending with `last`, which has
+   * `nsegs` segments and `bytes` bytes in total?
+   */
+  bool mergeable(Blk_request const *last, Blk_request const *req,
+                 unsigned nsegs, l4_uint64_t bytes) const
+  {
+    return (req->type == T_in || req->type == T_out)
+           && req->type == last->type
+           && req->sector == last->sector + (last->bytes >> Sector_shift)
+           && !(last->bytes & ((1 << Sector_shift) - 1))
+           && nsegs + req->segs.size() <= Max_segments
+           && bytes + req->bytes <= Max_merge_bytes;
+  }
+
+  void submit(Blk_request *batch)
+  {
+    {
+      std::lock_guard<std::mutex> g(_work_lock);
+      if (_work_tail)
+        _work_tail->next = batch;
+      else
+        _work_head = batch;
+      _work_tail = batch;
+    }
+    _work_cv.notify_one();
+  }
+
+  /// Worker thread: process batches until the device is destroyed.
+  void work()
+  {
+    for (;;)
+      {
+        Blk_request *batch;
+        {
+          std::unique_lock<std::mutex> g(_work_lock);
+          _work_cv.wait(g, [this]() { return _stop || _work_head; });
+          if (_stop)
+            return;
+
+          batch = _work_head;
+          _work_head = batch->next;
+          if (!_work_head)
+            _work_tail = nullptr;
+          ++_busy;
+        }
+
+        if (!process_batch(batch))
+          for (Blk_request *r = batch; r; r = r->merged)
+            cxx::write_now(r->status, process(r));
+
+        for (Blk_request *r = batch; r;)
+          {
+            Blk_request *n = r->merged;
+            complete(r);
+            r = n;
+          }
+
+        _done_irq->trigger();
+
+        {
+          std::lock_guard<std::mutex> g(_work_lock);
+          --_busy;
+        }
+        _idle_cv.notify_all();
+      }
+  }
+
+  l4_uint8_t process(Blk_request *r)
+  {
+    switch (r->type)
+      {
+      case T_in:
+      case T_out:
+        break;
+      case T_flush:
+        // the dataspace has no write cache of its own
+        return S_ok;
+      default:
+        return S_unsupp;
+      }
+
+    if (r->type == T_out && _read_only)
+      return S_ioerr;
+
+    l4_uint64_t off = r->sector << Sector_shift;
+    if (r->sector > (_size >> Sector_shift) || r->bytes > _size - off)
+      return S_ioerr;
+
+    char *disk = _disk.get() + off;
+    for (auto const &s : r->segs)
+      {
+        if (r->type == T_in)
+          memcpy(s.data, disk, s.len);
+        else
+          memcpy(disk, s.data, s.len);
+        disk += s.len;
+      }
+
+    return S_ok;
+  }
+
+  /**
+   * Process the merged requests of `batch` as one disk operation.
+   *
+   * mergeable() only admits reads or writes that continue each other on
+   * disk, so the batch covers one contiguous disk range. It is checked
+   * once, and the segments of all requests are copied from or to it with
+   * one memcpy per run of adjacent guest buffers.
+   *
+   * \return false if `batch` is a single request or fails as a whole, e.g.
+   *         because it runs past the end of the disk. Then each request
+   *         has to be processed on its own, see process().
+   */
+  bool process_batch(Blk_request *batch)
+  {
+    if (!batch->merged)
+      return false;
+
+    if (batch->type == T_out && _read_only)
+      return false;
+
+    l4_uint64_t bytes = 0;
+    for (Blk_request *r = batch; r; r = r->merged)
+      bytes += r->bytes;
+
+    l4_uint64_t off = batch->sector << Sector_shift;
+    if (batch->sector > (_size >> Sector_shift) || bytes > _size - off)
+      return false;
+
+    char *disk = _disk.get() + off;
+    char *run = nullptr;
+    l4_uint64_t run_len = 0;
+    for (Blk_request *r = batch; r; r = r->merged)
+      for (auto const &s : r->segs)
+        {
+          if (run && run + run_len == s.data)
+            {
+              run_len += s.len;
+              continue;
+            }
+
+          copy(batch->type, run, disk, run_len);
+          disk += run_len;
+          run = s.data;
+          run_len = s.len;
+        }
+    copy(batch->type, run, disk, run_len);
+
+    for (Blk_request *r = batch; r; r = r->merged)
+      cxx::write_now(r->status, l4_uint8_t(S_ok));
+
+    return true;
+  }
+
+  static void copy(l4_uint32_t type, char *guest, char *disk,
+                   l4_uint64_t len)
+  {
+    if (!len)
+      return;
+
+    if (type == T_in)
+      memcpy(guest, disk, len);
+    else
+      memcpy(disk, guest, len);
+  }
+
+  void complete(Blk_request *r)
+  {
+    r->next = __atomic_load_n(&_done, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&_done, &r->next, r, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+  }
+
+  unsigned _num_queues;
+  cxx::unique_ptr<Queue[]> _queues;
+  bool _read_only;
+  l4_uint64_t _size;
+  L4Re::Rm::Unique_region<char *> _disk;
+  unsigned _generation = 0;
+
+  std::mutex _work_lock;
+  std::condition_variable _work_cv;
+  std::condition_variable _idle_cv;
+  Blk_request *_work_head = nullptr;
+  Blk_request *_work_tail = nullptr;
+  /// Number of workers processing a batch.
+  unsigned _busy = 0;
+  bool _stop = false;
+  std::vector<std::thread> _workers;
+
+  Blk_request *_done = nullptr;
+  L4::Cap<L4::Irq> _done_irq;
+  Virtio::Event_connector_irq _evcon;
+};
+
+l4_uint32_t
+get_u32_prop(Dt_node const &node, char const *name, l4_uint32_t def)
+{
+  int size;
+  auto *prop = node.get_prop<fdt32_t>(name, &size);
+  return prop ? node.get_prop_val(prop, size, true) : def;
+}
+
+struct F : Factory
+{
+  cxx::Ref_ptr<Device> create(Device_lookup *devs, Dt_node const &node) override
+  {
+    Dbg(Dbg::Dev, Dbg::Info).printf("Create virtual block device\n");
+
+    L4::Cap<L4Re::Dataspace> ds;
+    char const *image = node.get_prop<char>("l4vmm,image", nullptr);
+    if (image)
+      ds = L4Re::Util::Env_ns().query<L4Re::Dataspace>(image);
+    else
+      ds = Vdev::get_cap<L4Re::Dataspace>(node, "l4vmm,virtiocap");
+
+    if (!ds)
+      {
+        Dbg(Dbg::Dev, Dbg::Warn, "blk")
+          .printf("%s: no backing dataspace\n", node.get_name());
+        return nullptr;
+      }
+
+    unsigned queues = get_u32_prop(node, "l4vmm,queues",
+                                   devs->cpus()->max_cpuid() + 1);
+    unsigned workers = get_u32_prop(node, "l4vmm,workers", 2);
+    if (!queues || !workers)
+      L4Re::chksys(-L4_EINVAL, "virtio block needs queues and workers");
+
+    auto c = make_device<Virtio_block_mmio>(devs->ram().get(), ds,
+                                            node.has_prop("l4vmm,read-only"),
+                                            queues, workers);
+    if (c->init_irqs(devs, node) < 0)
+      return nullptr;
+
+    c->register_obj(devs->vmm()->registry());
+    devs->vmm()->register_mmio_device(c, node);
+    return c;
+  }
+};
+
+static F f;
+static Device_type t = { "virtio,mmio", "block", &f };
+
+}
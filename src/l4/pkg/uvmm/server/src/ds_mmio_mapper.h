@@ -8,9 +8,14 @@
  */
 #pragma once
 
+#include <l4/cxx/utils>
 #include <l4/re/dataspace>
+#include <l4/sys/cache.h>
 #include <l4/util/util.h>
 #include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
 
 #include "mmio_device.h"
 #include "vcpu_ptr.h"
@@ -123,4 +128,186 @@ public:
   }
 
   l4_addr_t local_start() const { return _local_start; }
+  L4::Cap<L4Re::Dataspace> ds() const { return _ds; }
+  l4_addr_t ds_offset() const { return _offset; }
+};
+
+/**
+ * Guest RAM that shows the contents of a read-only dataspace until the
+ * guest writes to it.
+ *
+ * Instead of copying a boot image into guest RAM before the guest starts,
+ * the guest gets the image mapped read-only, in pages as large as the
+ * alignment and the pages already written allow. The first write
+ * to a page copies it into the RAM underneath and maps the RAM page
+ * instead, so the guest sees the same memory as if the image had been
+ * copied, but only pays for the pages it modifies.
+ *
+ * The VMM itself only sees the RAM underneath. So devices must not access
+ * pages the guest did not write before, which holds for the initial ram
+ * disk of Linux: it is only read until Linux frees it, and freeing poisons
+ * the pages.
+ */
+class Cow_ds_handler : public Vmm::Mmio_device
+{
+  enum { Bits = sizeof(l4_umword_t) * 8 };
+
+  void map_eager(L4::Cap<L4::Task>, Vmm::Guest_addr, Vmm::Guest_addr) override
+  {} // pages are mapped on first access
+
+  int access(l4_addr_t pfa, l4_addr_t offset, Vmm::Vcpu_ptr vcpu,
+             L4::Cap<L4::Task> vm_task, l4_addr_t min, l4_addr_t max) override
+  {
+    l4_addr_t page = offset >> L4_PAGESHIFT;
+    l4_addr_t ram = _local_ram + (offset & L4_PAGEMASK);
+    l4_addr_t dest = l4_trunc_page(pfa);
+    l4_umword_t bit = 1UL << (page % Bits);
+    long res;
+
+    std::lock_guard<std::mutex> lock(_lock);
+
+    if (_copied[page / Bits] & bit)
+      res = map_page(vm_task, ram, dest, L4_FPAGE_RWX);
+    else if (!vcpu.pf_write())
+      {
+        // Map as much of the image as possible with one fault. As for
+        // Ds_handler, we assume that the region manager provided the
+        // largest possible page size.
+        unsigned char ps = read_page_shift(pfa, offset, min, max);
+        l4_addr_t file = l4_trunc_size(_local_file + offset, ps);
+        res = page_in(file, false);
+        if (res >= 0)
+          res = l4_error(vm_task->map(L4Re::This_task,
+                                      l4_fpage(file, ps, L4_FPAGE_RX),
+                                      l4_trunc_size(pfa, ps)));
+      }
+    else
+      {
+        l4_addr_t file = _local_file + (offset & L4_PAGEMASK);
+        res = page_in(ram, true);
+        if (res >= 0)
+          {
+            memcpy(reinterpret_cast<void *>(ram),
+                   reinterpret_cast<void const *>(file), L4_PAGESIZE);
+            l4_cache_coherent(ram, ram + L4_PAGESIZE);
+
+            // The read-only page may still be mapped, possibly as part of
+            // a larger page. Unmapping it drops the whole larger page, whose
+            // other pages are mapped again on their next access.
+            vm_task->unmap(l4_fpage(dest, L4_PAGESHIFT, L4_FPAGE_RWX),
+                           L4_FP_ALL_SPACES);
+            res = map_page(vm_task, ram, dest, L4_FPAGE_RWX);
+          }
+
+        if (res >= 0)
+          {
+            _copied[page / Bits] |= bit;
+            ++_num_copied;
+          }
+      }
+
+    if (res < 0)
+      {
+        Err().printf("cannot handle VM memory access @ %lx ip=%lx r=%ld\n",
+                     pfa, vcpu->r.ip, res);
+        return res;
+      }
+
+    return Vmm::Retry;
+  }
+
+  char const *dev_info(char *buf, size_t size) const override
+  {
+    snprintf(buf, size, "cow ds: [%lx - ?] -> [%lx - ?], %lu/%lu pages copied",
+             _local_file, _local_ram, cxx::access_once(&_num_copied), _pages);
+    return buf;
+  }
+
+  /**
+   * Size of the largest naturally aligned page around `pfa` that can map
+   * the image read-only: it lies within the region [`min`, `max`], has the
+   * same alignment in the image as in the guest and contains no page the
+   * guest has written yet.
+   *
+   * \pre `_lock` is held.
+   */
+  unsigned char read_page_shift(l4_addr_t pfa, l4_addr_t offset,
+                                l4_addr_t min, l4_addr_t max) const
+  {
+    for (unsigned char ps = L4_SUPERPAGESHIFT; ps > L4_PAGESHIFT; --ps)
+      {
+        l4_addr_t size = 1UL << ps;
+        l4_addr_t base = l4_trunc_size(pfa, ps);
+        if (base < min || base + size - 1 > max)
+          continue;
+
+        if ((pfa ^ (_local_file + offset)) & (size - 1))
+          continue;
+
+        l4_addr_t first = l4_trunc_size(offset, ps) >> L4_PAGESHIFT;
+        l4_addr_t count = size >> L4_PAGESHIFT;
+        if (first + count <= _pages && !any_copied(first, count))
+          return ps;
+      }
+
+    return L4_PAGESHIFT;
+  }
+
+  /// Has the guest written any of the `count` pages starting at `first`?
+  bool any_copied(l4_addr_t first, l4_addr_t count) const
+  {
+    if (!_num_copied)
+      return false;
+
+    for (l4_addr_t p = first; p < first + count;)
+      {
+        if (!(p % Bits) && p + Bits <= first + count)
+          {
+            if (_copied[p / Bits])
+              return true;
+            p += Bits;
+            continue;
+          }
+
+        if (_copied[p / Bits] & (1UL << (p % Bits)))
+          return true;
+        ++p;
+      }
+
+    return false;
+  }
+
+  static long map_page(L4::Cap<L4::Task> vm_task, l4_addr_t src,
+                       l4_addr_t dest, unsigned attr)
+  {
+    return l4_error(vm_task->map(L4Re::This_task,
+                                 l4_fpage(src, L4_PAGESHIFT, attr), dest));
+  }
+
+  l4_addr_t _local_file = 0;
+  l4_addr_t _local_ram;
+  unsigned long _pages;
+  unsigned long _num_copied = 0;
+  std::unique_ptr<l4_umword_t[]> _copied;
+  std::mutex _lock;
+
+public:
+  /**
+   * \param file       Read-only dataspace with the initial contents.
+   * \param local_ram  Local address of the RAM backing the region.
+   * \param size       Size of the region, a multiple of the page size.
+   */
+  Cow_ds_handler(L4::Cap<L4Re::Dataspace> file, l4_addr_t local_ram,
+                 l4_size_t size)
+  : _local_ram(local_ram), _pages(size >> L4_PAGESHIFT),
+    _copied(new l4_umword_t[(_pages + Bits - 1) / Bits]())
+  {
+    auto rm = L4Re::Env::env()->rm();
+    // superpage alignment allows to map the image with superpages
+    L4Re::chksys(rm->attach(&_local_file, size,
+                            L4Re::Rm::Search_addr | L4Re::Rm::Read_only,
+                            L4::Ipc::make_cap(file, L4_CAP_FPAGE_RO), 0,
+                            L4_SUPERPAGESHIFT),
+                 "Attach boot image for copy-on-write.");
+  }
 };
@@ -54,4 +54,30 @@ Generic_guest::register_mmio_device(cxx::Ref_ptr<Vmm::Mmio_device> const &dev,
 
   info().printf("New mmio mapping: @ %llx %llx\n", base, size);
 }
+
+void
+Generic_guest::show_mmio_stats(FILE *f) const
+{
+  char buf[40];
+
+  fprintf(f, "%-35s %-40s %s\n", "Region", "Device", "Exits");
+  for (auto const &e : _memmap)
+    {
+      unsigned long n = __atomic_load_n(&e.second->mmio_exits,
+                                        __ATOMIC_RELAXED);
+      if (!n)
+        continue;
+
+      fprintf(f, "[%16lx:%16lx] %-40s %lu\n",
+              e.first.start.get(), e.first.end.get(),
+              e.second->dev_info(buf, sizeof(buf)), n);
+    }
+}
+
+void
+Generic_guest::show_halt_poll_stats(FILE *f) const
+{
+  for (unsigned i = 0; i < Cpu_dev::Max_cpus; ++i)
+    _halt_poll[i].show(f, i);
+}
 } // namespace
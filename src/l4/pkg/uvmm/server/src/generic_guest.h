@@ -13,8 +13,10 @@
 #include <l4/re/util/object_registry>
 #include <l4/re/util/unique_cap>
 
+#include "cpu_dev.h"
 #include "debug.h"
 #include "ds_mmio_mapper.h"
+#include "halt_poll.h"
 #include "mem_types.h"
 #include "ram_ds.h"
 #include "vm_memmap.h"
@@ -22,6 +24,7 @@
 #include "vbus_event.h"
 #include "consts.h"
 
+#include <cassert>
 #include <cstdio>
 
 namespace Vmm {
@@ -70,12 +73,19 @@ public:
 
   int handle_mmio(l4_addr_t pfa, Vcpu_ptr vcpu)
   {
-    Vm_mem::const_iterator f = _memmap.find(Guest_addr(pfa));
+    unsigned id = vcpu.get_vcpu_id();
+    assert(id < Cpu_dev::Max_cpus);
+    Vm_mem::value_type const *f = _memmap.lookup(Guest_addr(pfa),
+                                                 &_mmio_hit[id]);
 
-    if (f != _memmap.end())
-      return f->second->access(pfa, pfa - f->first.start.get(),
-                               vcpu, _task.get(),
-                               f->first.start.get(), f->first.end.get());
+    if (f)
+      {
+        Mmio_device *dev = f->second.get();
+        __atomic_add_fetch(&dev->mmio_exits, 1, __ATOMIC_RELAXED);
+        return dev->access(pfa, pfa - f->first.start.get(),
+                           vcpu, _task.get(),
+                           f->first.start.get(), f->first.end.get());
+      }
 
     if (!_mmio_fallback)
        return -L4_EFAULT;
@@ -156,6 +166,19 @@ public:
     _memmap.add_mmio_device(region, dev);
   }
 
+  /// Print the number of trapped accesses of every MMIO region.
+  void show_mmio_stats(FILE *f) const;
+
+  /// Let halted vCPUs poll for up to `ns` nanoseconds before blocking.
+  void set_halt_poll_max(l4_uint32_t ns)
+  {
+    for (auto &h : _halt_poll)
+      h.set_max(ns);
+  }
+
+  /// Print how often halted vCPUs found work while polling.
+  void show_halt_poll_stats(FILE *f) const;
+
 protected:
   void process_pending_ipc(Vcpu_ptr vcpu, l4_utcb_t *utcb)
   {
@@ -181,6 +204,8 @@ protected:
   L4Re::Util::Br_manager _bm;
   L4Re::Util::Object_registry _registry;
   Vm_mem _memmap;
+  Vm_mem::Hit_cache _mmio_hit[Cpu_dev::Max_cpus];
+  Halt_poll _halt_poll[Cpu_dev::Max_cpus];
   L4Re::Util::Unique_cap<L4::Task> _task;
   Pm _pm;
   Vbus_event _vbus_event;
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018 Kernkonzept GmbH.
+ *
+ * This file is distributed under the terms of the GNU General Public
+ * License, version 2.  Please see the COPYING-GPL-2 file for details.
+ */
+#pragma once
+
+#include <l4/sys/compiler.h>
+#include <l4/sys/l4int.h>
+#include <l4/cxx/utils>
+
+#include <cstdio>
+
+namespace Vmm {
+
+/**
+ * Adaptive polling of a halted vCPU.
+ *
+ * Instead of blocking in the kernel right away, a halted vCPU first spins
+ * for up to window() nanoseconds looking for work. The window adapts to the
+ * time the vCPU actually sleeps when polling was not successful: a wakeup
+ * that came later than the window but within the maximum window grows it,
+ * a wakeup that came later than the maximum shrinks it, down to no polling
+ * at all. So a vCPU that is woken up shortly after halting ends up polling,
+ * while an idle vCPU does not burn its CPU.
+ *
+ * Polling is off as long as the maximum window is zero.
+ */
+class Halt_poll
+{
+public:
+  enum : l4_uint32_t
+  {
+    Start_ns = 10000, ///< window when growing from zero
+    Grow     = 2,
+    Shrink   = 2,
+  };
+
+  void set_max(l4_uint32_t ns)
+  {
+    _max_ns = ns;
+    if (_window_ns > ns)
+      _window_ns = 0;
+  }
+
+  l4_uint32_t window() const { return _window_ns; }
+
+  /**
+   * Spin for the current window until `work` returns true.
+   *
+   * \param now_ns  Returns a monotonic time in nanoseconds.
+   * \param work    Checks for and processes events of the vCPU, returns
+   *                true if the vCPU has to run again.
+   *
+   * \retval true   `work` returned true within the window.
+   * \retval false  The window closed, the caller shall block and report
+   *                the time it slept with blocked().
+   */
+  template <typename CLOCK, typename WORK>
+  bool poll(CLOCK now_ns, WORK work)
+  {
+    cxx::write_now(&_halts, _halts + 1);
+    if (!_window_ns)
+      return false;
+
+    l4_uint64_t start = now_ns();
+    do
+      {
+        if (work())
+          {
+            cxx::write_now(&_hits, _hits + 1);
+            return true;
+          }
+
+        l4_barrier();
+      }
+    while (now_ns() - start < _window_ns);
+
+    return false;
+  }
+
+  /// Adapt the window after the vCPU slept for `ns` after polling.
+  void blocked(l4_uint64_t ns)
+  {
+    if (ns > _max_ns)
+      shrink();
+    else if (ns > _window_ns)
+      grow();
+  }
+
+  void show(FILE *f, unsigned cpu) const
+  {
+    unsigned long halts = cxx::access_once(&_halts);
+    unsigned long hits = cxx::access_once(&_hits);
+    fprintf(f, "Cpu%u: %lu halts, %lu polled (%lu%%), window %u ns\n",
+            cpu, halts, hits, halts ? hits * 100 / halts : 0UL,
+            cxx::access_once(&_window_ns));
+  }
+
+private:
+  void grow()
+  {
+    l4_uint32_t w = _window_ns ? _window_ns * Grow : Start_ns;
+    cxx::write_now(&_window_ns, w < _max_ns ? w : _max_ns);
+  }
+
+  void shrink()
+  {
+    l4_uint32_t w = _window_ns / Shrink;
+    cxx::write_now(&_window_ns, w < Start_ns ? 0 : w);
+  }
+
+  // only written by the thread of the vCPU
+  l4_uint32_t _max_ns = 0;
+  l4_uint32_t _window_ns = 0;
+  unsigned long _halts = 0;
+  unsigned long _hits = 0;
+};
+
+} // namespace
@@ -25,6 +25,8 @@
 #include <getopt.h>
 
 #include <l4/re/env>
+#include <l4/re/env.h>
+#include <l4/sys/kip.h>
 
 #include "debug.h"
 #include "guest.h"
@@ -122,8 +124,61 @@ set_verbosity(char const *str)
     }
 }
 
+namespace {
+
+/**
+ * Time spent in the phases of starting the VM.
+ */
+class Start_timer
+{
+  enum { Max_phases = 8 };
+
+public:
+  Start_timer() : _start(now()), _last(_start) {}
+
+  /// End the current phase, which is reported as `name`.
+  void phase(char const *name)
+  {
+    l4_cpu_time_t t = now();
+    if (_num < Max_phases)
+      {
+        _phases[_num].name = name;
+        _phases[_num].us = t - _last;
+        ++_num;
+      }
+    _last = t;
+  }
+
+  void report() const
+  {
+    info.printf("VM start took %llu us:\n",
+                (unsigned long long)(_last - _start));
+    for (unsigned i = 0; i < _num; ++i)
+      info.printf("  %-16s %10llu us\n", _phases[i].name,
+                  (unsigned long long)_phases[i].us);
+  }
+
+private:
+  static l4_cpu_time_t now()
+  { return l4_kip_clock(l4re_kip()); }
+
+  struct Phase
+  {
+    char const *name;
+    l4_cpu_time_t us;
+  };
+
+  l4_cpu_time_t _start;
+  l4_cpu_time_t _last;
+  Phase _phases[Max_phases];
+  unsigned _num = 0;
+};
+
+}
+
 static int run(int argc, char *argv[])
 {
+  Start_timer timer;
   unsigned long verbosity = Dbg::Warn;
 
   Dbg::set_verbosity(verbosity);
@@ -148,6 +203,8 @@ static int run(int argc, char *argv[])
       { "verbose",                 no_argument,       NULL, 'v' },
       { "quiet",                   no_argument,       NULL, 'q' },
       { "wakeup-on-system-resume", no_argument,       NULL, 'W' },
+      { "halt-poll",               required_argument, NULL, 'H' },
+      { "cow-ramdisk",             no_argument,       NULL, 'C' },
       { 0, 0, 0, 0}
     };
 
@@ -193,6 +250,13 @@ static int run(int argc, char *argv[])
         case 'W':
           vmm->use_wakeup_inhibitor(true);
           break;
+        case 'H':
+          // maximum halt-poll window in microseconds
+          vmm->set_halt_poll_max(strtoul(optarg, nullptr, 0) * 1000);
+          break;
+        case 'C':
+          ram->set_cow_load(true);
+          break;
         default:
           Err().printf("unknown command-line option\n");
           return 1;
@@ -200,12 +264,15 @@ static int run(int argc, char *argv[])
     }
 
   warn.printf("Hello out there.\n");
+  timer.phase("setup");
 
   Vmm::Ram_free_list ram_free_list
     = ram->setup_from_device_tree(dt, vmm->memmap(), Vmm::Guest_addr(rambase));
+  timer.phase("RAM");
 
   info.printf("Loading kernel...\n");
   l4_addr_t entry = vmm->load_linux_kernel(ram, kernel_image, &ram_free_list);
+  timer.phase("kernel");
 
   if (dt.valid())
     {
@@ -235,6 +302,8 @@ static int run(int argc, char *argv[])
       vm_instance.cpus()->create_vcpu(nullptr);
     }
 
+  timer.phase("devices");
+
   if (ram_disk)
     {
       info.printf("Loading ram disk...\n");
@@ -254,6 +323,7 @@ static int run(int argc, char *argv[])
 
       info.printf("Loaded ramdisk image %s to %lx (size: %08zx)\n",
                   ram_disk, rd_start.get(), rd_size);
+      timer.phase("ram disk");
     }
 
   // finally copy in the device tree
@@ -263,9 +333,12 @@ static int run(int argc, char *argv[])
 
   vmm->prepare_linux_run(vm_instance.cpus()->vcpu(0), entry, ram, kernel_image,
                          cmd_line, dt_boot_addr);
+  timer.phase("boot setup");
 
   info.printf("Populating RAM of virtual machine\n");
   vmm->map_eager();
+  timer.phase("RAM mapping");
+  timer.report();
 
   vmm->run(vm_instance.cpus());
 
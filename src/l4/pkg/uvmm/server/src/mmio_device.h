@@ -34,6 +34,9 @@ struct Mmio_device : public virtual Vdev::Dev_ref
 {
   virtual ~Mmio_device() = 0;
 
+  /// Number of guest accesses that trapped into this device.
+  unsigned long mmio_exits = 0;
+
   bool mergable(cxx::Ref_ptr<Mmio_device> other,
                 Guest_addr start_other, Guest_addr start_this)
   {
@@ -111,6 +111,14 @@ public:
                       _devices->vmm()->show_state_interrupts(_f, cpu->vcpu());
                   break;
                 }
+              case 'm':
+                fputc('\n', _f);
+                _devices->vmm()->show_mmio_stats(_f);
+                break;
+              case 'h':
+                fputc('\n', _f);
+                _devices->vmm()->show_halt_poll_stats(_f);
+                break;
               case 't': Dbg::set_verbosity(Dbg::Trace | Dbg::Info | Dbg::Warn); break;
               case 'T': Dbg::set_verbosity(Dbg::Info | Dbg::Warn); break;
               case '\r':
@@ -7,6 +7,8 @@
  * License, version 2.  Please see the COPYING-GPL-2 file for details.
  */
 
+#include <algorithm>
+
 #include "debug.h"
 #include "vm_memmap.h"
 
@@ -30,6 +32,7 @@ Vmm::Vm_mem::add_mmio_device(Vmm::Region const &region,
   if (count(region) == 0)
     {
       insert(std::make_pair(region, dev));
+      update_table();
       return;
     }
 
@@ -65,5 +68,57 @@ Vmm::Vm_mem::add_mmio_device(Vmm::Region const &region,
   // [lower, upper) is a subset of region - erase it
   erase(lower, upper);
   insert(std::make_pair(region, dev));
+  update_table();
+}
+
+Vmm::Vm_mem::value_type const *const Vmm::Vm_mem::Ambiguous
+  = reinterpret_cast<Vmm::Vm_mem::value_type const *>(1);
+
+void
+Vmm::Vm_mem::update_table()
+{
+  invalidate();
+  _entries.clear();
+
+  l4_addr_t first = ~0UL;
+  l4_addr_t last = 0;
+  for (auto const &e : *this)
+    if (e.first.end - e.first.start < Max_window_region)
+      {
+        first = std::min(first, e.first.start.get() >> L4_PAGESHIFT);
+        last = std::max(last, e.first.end.get() >> L4_PAGESHIFT);
+      }
+
+  // without small regions, or with a too sparse window, only the map is
+  // searched
+  if (first > last || last - first >= Max_window_pages)
+    return;
+
+  _table_base = first;
+  _table.assign(last - first + 1, 0);
+
+  for (auto const &e : *this)
+    {
+      l4_addr_t s = std::max(e.first.start.get() >> L4_PAGESHIFT, first);
+      l4_addr_t t = std::min(e.first.end.get() >> L4_PAGESHIFT, last);
+      if (s > t)
+        continue;
+
+      if (_entries.size() + 1 >= Shared_page)
+        {
+          _table.clear();
+          return;
+        }
+
+      _entries.push_back(&e);
+      l4_uint16_t idx = _entries.size();
+      for (l4_addr_t p = s; p <= t; ++p)
+        _table[p - first] = _table[p - first] ? Shared_page : idx;
+    }
+
+  Dbg(Dbg::Mmio, Dbg::Info, "mmio")
+    .printf("MMIO window [%lx:%lx]: %zu pages, %zu regions\n",
+            first << L4_PAGESHIFT, ((last + 1) << L4_PAGESHIFT) - 1,
+            _table.size(), _entries.size());
 }
 
@@ -11,17 +11,134 @@
 #include <l4/cxx/ref_ptr>
 #include <l4/sys/l4int.h>
 #include <map>
+#include <vector>
 
 #include "mmio_device.h"
 #include "mem_types.h"
 
 namespace Vmm {
 
+/**
+ * Memory map of the guest.
+ *
+ * Besides the map itself, Vm_mem keeps a flat table with one entry per page
+ * of the MMIO window, the range covered by the small regions of the map,
+ * and supports a per-vCPU cache of the last region hit, see lookup().
+ *
+ * The table is built by add_mmio_device() and update_table(). Modifying the
+ * map through operator[]() or erase() invalidates the table and all
+ * caches, until update_table() is called.
+ */
 class Vm_mem : public std::map<Region, cxx::Ref_ptr<Vmm::Mmio_device>>
 {
+  typedef std::map<Region, cxx::Ref_ptr<Vmm::Mmio_device>> Base;
+
 public:
+  enum
+  {
+    /// Regions up to this size make up the MMIO window.
+    Max_window_region = 16 << 20,
+    /// Maximum number of pages of the MMIO window.
+    Max_window_pages  = 1 << 15,
+  };
+
+  /// Last region hit by one vCPU.
+  struct Hit_cache
+  {
+    value_type const *entry = nullptr;
+    unsigned gen = 0;
+  };
+
   void add_mmio_device(Region const &region,
                        cxx::Ref_ptr<Vmm::Mmio_device> const &dev);
+
+  /**
+   * Find the region containing `addr`.
+   *
+   * \param addr  Guest-physical address.
+   * \param hc    Cache of the calling vCPU, checked first and updated.
+   *
+   * \return the entry of the region, or nullptr if no region contains
+   *         `addr`.
+   */
+  value_type const *lookup(Guest_addr addr, Hit_cache *hc) const
+  {
+    if (hc->gen == _gen && hc->entry
+        && hc->entry->first.contains(Region(addr)))
+      return hc->entry;
+
+    value_type const *e = table_lookup(addr);
+    if (e == Ambiguous)
+      {
+        auto f = find(addr);
+        e = f != end() ? &*f : nullptr;
+      }
+
+    if (e)
+      {
+        hc->entry = e;
+        hc->gen = _gen;
+      }
+
+    return e;
+  }
+
+  /// Rebuild the MMIO window table after the map was modified.
+  void update_table();
+
+  mapped_type &operator [] (Region const &region)
+  {
+    invalidate();
+    return Base::operator [] (region);
+  }
+
+  iterator erase(const_iterator pos)
+  {
+    invalidate();
+    return Base::erase(pos);
+  }
+
+  iterator erase(const_iterator first, const_iterator last)
+  {
+    invalidate();
+    return Base::erase(first, last);
+  }
+
+private:
+  /// Table result if the map needs to be searched.
+  static value_type const *const Ambiguous;
+
+  /// Table entry of a page shared by several regions.
+  enum { Shared_page = 0xffff };
+
+  void invalidate()
+  {
+    ++_gen;
+    _table.clear();
+  }
+
+  value_type const *table_lookup(Guest_addr addr) const
+  {
+    l4_addr_t page = addr.get() >> L4_PAGESHIFT;
+    // large regions outside the window are only in the map
+    if (page - _table_base >= _table.size())
+      return Ambiguous;
+
+    l4_uint16_t idx = _table[page - _table_base];
+    if (idx == 0)
+      return nullptr;
+
+    if (idx == Shared_page)
+      return Ambiguous;
+
+    value_type const *e = _entries[idx - 1];
+    return e->first.contains(Region(addr)) ? e : nullptr;
+  }
+
+  unsigned _gen = 1;
+  l4_addr_t _table_base = 0;            ///< first page of the window
+  std::vector<l4_uint16_t> _table;      ///< index + 1 into _entries per page
+  std::vector<value_type const *> _entries;
 };
 
 } // namespace
@@ -129,11 +129,73 @@ Vmm::Ram_free_list::load_file_to_back(Vm_ram *ram, char const *name,
   if (size)
     *size = sz;
 
-  ram->load_file(f, addr, sz);
+  ram->map_file(f, addr, sz);
 
   return L4_EOK;
 }
 
+void
+Vmm::Vm_ram::map_file(L4::Cap<L4Re::Dataspace> const &file,
+                      Vmm::Guest_addr addr, l4_size_t sz)
+{
+#ifndef MAP_OTHER
+  if (_cow_load && map_file_cow(file, addr, l4_round_page(sz)))
+    return;
+#endif
+
+  load_file(file, addr, sz);
+}
+
+/**
+ * Split the area `[addr, addr + size)` off the RAM mapping and let a
+ * Cow_ds_handler map `file` there.
+ *
+ * \return false if the area is not page aligned or not part of a single
+ *         RAM mapping.
+ */
+bool
+Vmm::Vm_ram::map_file_cow(L4::Cap<L4Re::Dataspace> const &file,
+                          Vmm::Guest_addr addr, l4_size_t size)
+{
+  Region area = Region::ss(addr, size);
+  auto it = _memmap->find(area);
+
+  if ((addr.get() & ~L4_PAGEMASK) || it == _memmap->end()
+      || !it->first.contains(area))
+    return false;
+
+  auto *dsh = dynamic_cast<Ds_handler *>(it->second.get());
+  if (!dsh)
+    return false;
+
+  Region r = it->first;
+  L4::Cap<L4Re::Dataspace> ds = dsh->ds();
+  l4_addr_t local = dsh->local_start();
+  l4_addr_t ds_offset = dsh->ds_offset();
+  l4_addr_t offset = addr - r.start;
+
+  _memmap->erase(it);
+
+  if (offset)
+    _memmap->add_mmio_device(
+      Region(r.start, addr - 1),
+      Vdev::make_device<Ds_handler>(ds, local, offset, ds_offset));
+
+  if (area.end < r.end)
+    _memmap->add_mmio_device(
+      Region(area.end + 1, r.end),
+      Vdev::make_device<Ds_handler>(ds, local + offset + size,
+                                    r.end - area.end, ds_offset + offset + size));
+
+  _memmap->add_mmio_device(
+    area, Vdev::make_device<Cow_ds_handler>(file, local + offset, size));
+
+  info.printf("Mapping [%lx - %lx] copy-on-write\n", area.start.get(),
+              area.end.get());
+
+  return true;
+}
+
 l4_size_t
 Vmm::Vm_ram::add_memory_region(L4::Cap<L4Re::Dataspace> ds, Vmm::Guest_addr baseaddr,
                                l4_addr_t ds_offset, l4_size_t size, Vm_mem *memmap)
@@ -159,6 +221,8 @@ Vmm::Vm_ram::setup_from_device_tree(Vdev::Host_dt const &dt, Vm_mem *memmap,
 {
   bool has_memory_nodes = false;
 
+  _memmap = memmap;
+
   if (dt.valid())
     {
       dt.get().scan(
@@ -85,6 +85,28 @@ public:
     r->load_file(file, addr, sz);
   }
 
+  /**
+   * Make the contents of the given dataspace available in guest RAM.
+   *
+   * With copy-on-write loading enabled, the pages of `file` are mapped
+   * read-only into the guest and a page is only copied into RAM when the
+   * guest writes to it. guest2host() does not see the contents of a page
+   * before that. Without copy-on-write loading, or if the area cannot be
+   * split off the RAM mapping, the contents are copied like load_file() does.
+   *
+   * \param file  Dataspace to load from.
+   * \param addr  Guest physical address to load the data space to.
+   * \param sz    Number of bytes to make available.
+   */
+  void map_file(L4::Cap<L4Re::Dataspace> const &file,
+                Vmm::Guest_addr addr, l4_size_t sz);
+
+  /**
+   * Let map_file() map files copy-on-write instead of copying them.
+   */
+  void set_cow_load(bool cow_load)
+  { _cow_load = cow_load; }
+
   /**
    * Get a VMM-virtual pointer from a guest-physical address.
    */
@@ -205,12 +227,17 @@ private:
                               Vmm::Guest_addr baseaddr, l4_addr_t ds_offset,
                               l4_size_t size, Vm_mem *memmap);
 
+  bool map_file_cow(L4::Cap<L4Re::Dataspace> const &file,
+                    Vmm::Guest_addr addr, l4_size_t size);
+
   long add_from_dt_node(Vm_mem *memmap, bool *found, Vdev::Dt_node const &node);
   void setup_default_region(Vdev::Host_dt const &dt, Vm_mem *memmap,
                             Vmm::Guest_addr baseaddr);
 
   std::vector<Vmm::Ram_ds> _regions;
   l4_addr_t _boot_offset;
+  Vm_mem *_memmap = nullptr;
+  bool _cow_load = false;
 };
 
 }